@@ -0,0 +1,217 @@
+#include "Arduino.h"
+#include "avr/eeprom.h"
+
+unsigned long millis()
+{
+    Simulator::advance(SIM_CALL_CYCLES);
+    return (unsigned long)(Simulator::cycles() / (F_CPU / 1000UL));
+}
+
+unsigned long micros()
+{
+    Simulator::advance(SIM_CALL_CYCLES);
+    return (unsigned long)(Simulator::cycles() / (F_CPU / 1000000UL));
+}
+
+void delay(unsigned long ms)
+{
+    Simulator::advance((uint64_t)ms * (F_CPU / 1000UL));
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    Simulator::advance((uint64_t)us * (F_CPU / 1000000UL));
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    Simulator::pinMode(pin, mode);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    Simulator::digitalWrite(pin, value);
+}
+
+int digitalRead(uint8_t pin)
+{
+    return Simulator::digitalRead(pin);
+}
+
+int analogRead(uint8_t pin)
+{
+    return Simulator::analogRead(pin);
+}
+
+void eeprom_read_block(void *destination, const void *source, size_t size)
+{
+    uint8_t *bytes = (uint8_t *)destination;
+    uintptr_t address = (uintptr_t)source;
+    for (size_t i = 0; i < size; i++)
+        bytes[i] = Simulator::eepromRead(address + i);
+}
+
+void eeprom_update_block(const void *source, void *destination, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *)source;
+    uintptr_t address = (uintptr_t)destination;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (Simulator::eepromRead(address + i) != bytes[i])
+            Simulator::eepromWrite(address + i, bytes[i]);
+    }
+}
+
+uint8_t eeprom_read_byte(const uint8_t *address)
+{
+    return Simulator::eepromRead((uintptr_t)address);
+}
+
+size_t Print::_printNumber(unsigned long value, uint8_t base)
+{
+    char buffer[8 * sizeof(long) + 1];
+    char *text = buffer + sizeof(buffer) - 1;
+    *text = 0;
+
+    do
+    {
+        unsigned long digit = value % base;
+        value /= base;
+        *--text = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    } while (value > 0);
+
+    return this->write(text);
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t written = 0;
+    while (size-- > 0)
+        written += this->write(*buffer++);
+
+    return written;
+}
+
+size_t Print::write(const char *text)
+{
+    return text == NULL ? 0 : this->write((const uint8_t *)text, strlen(text));
+}
+
+size_t Print::print(const char *text)
+{
+    return this->write(text);
+}
+
+size_t Print::print(char c)
+{
+    return this->write((uint8_t)c);
+}
+
+size_t Print::print(unsigned char value, int base)
+{
+    return this->print((unsigned long)value, base);
+}
+
+size_t Print::print(int value, int base)
+{
+    return this->print((long)value, base);
+}
+
+size_t Print::print(unsigned int value, int base)
+{
+    return this->print((unsigned long)value, base);
+}
+
+size_t Print::print(long value, int base)
+{
+    if (base == DEC && value < 0)
+        return this->print('-') + this->_printNumber(-(unsigned long)value, DEC);
+
+    return this->_printNumber((unsigned long)value, base);
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+    return this->_printNumber(value, base);
+}
+
+size_t Print::println()
+{
+    return this->write("\r\n");
+}
+
+size_t Print::println(const char *text)
+{
+    return this->print(text) + this->println();
+}
+
+size_t Print::println(char c)
+{
+    return this->print(c) + this->println();
+}
+
+size_t Print::println(unsigned char value, int base)
+{
+    return this->print(value, base) + this->println();
+}
+
+size_t Print::println(int value, int base)
+{
+    return this->print(value, base) + this->println();
+}
+
+size_t Print::println(unsigned int value, int base)
+{
+    return this->print(value, base) + this->println();
+}
+
+size_t Print::println(long value, int base)
+{
+    return this->print(value, base) + this->println();
+}
+
+size_t Print::println(unsigned long value, int base)
+{
+    return this->print(value, base) + this->println();
+}
+
+void HardwareSerial::begin(unsigned long baud, uint8_t config)
+{
+    Simulator::serialBegin(baud);
+}
+
+void HardwareSerial::end()
+{
+    Simulator::serialEnd();
+}
+
+int HardwareSerial::available()
+{
+    return Simulator::serialAvailable();
+}
+
+int HardwareSerial::read()
+{
+    return Simulator::serialRead();
+}
+
+int HardwareSerial::peek()
+{
+    return Simulator::serialPeek();
+}
+
+int HardwareSerial::availableForWrite()
+{
+    return Simulator::serialAvailableForWrite();
+}
+
+void HardwareSerial::flush()
+{
+    Simulator::serialFlush();
+}
+
+size_t HardwareSerial::write(uint8_t value)
+{
+    Simulator::serialWrite(value);
+    return 1;
+}
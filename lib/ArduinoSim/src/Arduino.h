@@ -0,0 +1,97 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "avr/interrupt.h"
+#include "avr/io.h"
+#include "avr/pgmspace.h"
+#include "Simulator.h"
+
+#pragma once
+
+/**
+ * Arduino core API on top of Simulator, enough for the rotator firmware
+ */
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define LED_BUILTIN 13
+
+#define SERIAL_8N1 0x06
+#define DEC 10
+#define HEX 16
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+class Print
+{
+private:
+    size_t _printNumber(unsigned long value, uint8_t base);
+
+public:
+    virtual size_t write(uint8_t value) = 0;
+    size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *text);
+
+    size_t print(const char *text);
+    size_t print(char c);
+    size_t print(unsigned char value, int base = DEC);
+    size_t print(int value, int base = DEC);
+    size_t print(unsigned int value, int base = DEC);
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+
+    size_t println();
+    size_t println(const char *text);
+    size_t println(char c);
+    size_t println(unsigned char value, int base = DEC);
+    size_t println(int value, int base = DEC);
+    size_t println(unsigned int value, int base = DEC);
+    size_t println(long value, int base = DEC);
+    size_t println(unsigned long value, int base = DEC);
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+class HardwareSerial : public Stream
+{
+public:
+    void begin(unsigned long baud, uint8_t config = SERIAL_8N1);
+    void end();
+    int available() override;
+    int read() override;
+    int peek() override;
+    int availableForWrite();
+    void flush();
+    size_t write(uint8_t value) override;
+    using Print::write;
+    operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
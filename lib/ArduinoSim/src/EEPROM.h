@@ -0,0 +1,3 @@
+#include "avr/eeprom.h"
+
+#pragma once
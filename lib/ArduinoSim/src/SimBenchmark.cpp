@@ -0,0 +1,904 @@
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include "Arduino.h"
+#include "SimBenchmark.h"
+#include "util/crc16.h"
+
+void setup();
+void loop();
+
+std::vector<uint64_t> SimBenchmark::_loopCycles;
+std::vector<uint64_t> SimBenchmark::_responseCycles;
+uint64_t SimBenchmark::_maxResponseCycles = 0;
+
+static double _cyclesToMs(uint64_t cycles)
+{
+    return cycles * 1000.0 / F_CPU;
+}
+
+void SimBenchmark::_loopOnce()
+{
+    uint64_t start = Simulator::cycles();
+    loop();
+    _loopCycles.push_back(Simulator::cycles() - start);
+}
+
+bool SimBenchmark::_command(const char *text, std::string &reply, uint64_t &roundTripCycles, unsigned long timeoutSeconds)
+{
+    size_t lines = Simulator::deviceLines().size();
+    uint64_t start = Simulator::cycles() > Simulator::wireIdleCycle() ? Simulator::cycles() : Simulator::wireIdleCycle();
+    uint64_t timeout = start + (uint64_t)timeoutSeconds * F_CPU;
+    uint64_t byteCycles = Simulator::serialByteCycles(); // BR answers before the rate changes
+
+    Simulator::sendToDevice(std::string(text) + "\n");
+
+    while (Simulator::deviceLines().size() == lines)
+    {
+        if (Simulator::cycles() > timeout)
+            return false;
+
+        _loopOnce();
+    }
+
+    const SimLine &line = Simulator::deviceLines()[lines];
+    roundTripCycles = line.cycle - start;
+
+    // the device's share: round trip without the bytes on the wire (command + '\n', reply + "\r\n")
+    uint64_t wireCycles = (strlen(text) + 1 + line.text.size() + 2) * byteCycles;
+    uint64_t response = roundTripCycles > wireCycles ? roundTripCycles - wireCycles : 0;
+    _responseCycles.push_back(response);
+    _maxResponseCycles = std::max(_maxResponseCycles, response);
+
+    reply = line.text;
+    if (!reply.empty() && reply[reply.size() - 1] == ';')
+        reply.erase(reply.size() - 1);
+
+    return true;
+}
+
+double SimBenchmark::_percentileMs(std::vector<uint64_t> values, double percentile)
+{
+    if (values.empty())
+        return 0.0;
+
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(percentile / 100.0 * (values.size() - 1) + 0.5);
+
+    return _cyclesToMs(values[index]);
+}
+
+void SimBenchmark::_report(const char *workload, const char *metric, double value, const char *unit)
+{
+    printf("%-12s %-22s %12.3f %s\n", workload, metric, value, unit);
+}
+
+void SimBenchmark::_reportLatency(const char *workload, const char *metric, const std::vector<uint64_t> &cycles)
+{
+    char name[32];
+    static const double PERCENTILES[] = {50.0, 90.0, 99.0, 100.0};
+    static const char *const LABELS[] = {"p50", "p90", "p99", "max"};
+
+    for (int i = 0; i < 4; i++)
+    {
+        snprintf(name, sizeof(name), "%s_%s", metric, LABELS[i]);
+        _report(workload, name, _percentileMs(cycles, PERCENTILES[i]), "ms");
+    }
+}
+
+bool SimBenchmark::_bootWhilePolling()
+{
+    // status polls all through homing, the first accepted move marks the end of it
+    setup();
+    _loopCycles.clear();
+    _responseCycles.clear();
+
+    std::string reply;
+    uint64_t roundTrip;
+    unsigned long polls = 0;
+    do
+    {
+        if (!_command("F#", reply, roundTrip) || reply != "FR_OK")
+            return false;
+
+        if (!_command("MD:0", reply, roundTrip))
+            return false;
+
+        polls++;
+    } while (reply == "(KO)");
+
+    _report("boot", "homed", _cyclesToMs(Simulator::cycles()), "ms");
+    _report("boot", "polls", polls, "");
+    _report("boot", "motor_steps", Simulator::motorSteps(), "steps");
+    _report("boot", "home_deg", Simulator::rotatorDegrees(), "deg");
+    _reportLatency("boot", "response", _responseCycles);
+    _reportLatency("boot", "loop", _loopCycles);
+
+    return true;
+}
+
+bool SimBenchmark::_idlePolling()
+{
+    std::vector<uint64_t> roundTrips;
+    _loopCycles.clear();
+    _responseCycles.clear();
+
+    for (int i = 0; i < SIM_BENCHMARK_POLLS; i++)
+    {
+        std::string reply;
+        uint64_t roundTrip;
+        if (!_command("FA", reply, roundTrip))
+            return false;
+
+        roundTrips.push_back(roundTrip);
+    }
+
+    _reportLatency("idle_fa", "round_trip", roundTrips);
+    _reportLatency("idle_fa", "response", _responseCycles);
+    _reportLatency("idle_fa", "loop", _loopCycles);
+
+    return true;
+}
+
+bool SimBenchmark::_moveWhilePolling()
+{
+    std::string reply;
+    uint64_t roundTrip;
+    _loopCycles.clear();
+    _responseCycles.clear();
+
+    long startSteps = Simulator::motorSteps();
+    double startDegrees = Simulator::rotatorDegrees();
+    uint64_t start = Simulator::cycles();
+
+    if (!_command("MD:" SIM_BENCHMARK_MOVE_DEG, reply, roundTrip))
+        return false;
+
+    std::vector<uint64_t> roundTrips;
+    do
+    {
+        if (!_command("FR", reply, roundTrip))
+            return false;
+
+        roundTrips.push_back(roundTrip);
+    } while (reply != "FR:0");
+
+    double moveMs = _cyclesToMs(Simulator::cycles() - start);
+    long steps = labs(Simulator::motorSteps() - startSteps);
+
+    _report("move", "duration", moveMs, "ms");
+    _report("move", "steps", steps, "steps");
+    _report("move", "step_rate", steps / (moveMs / 1000.0), "steps/s");
+    _report("move", "rotator_deg", Simulator::rotatorDegrees() - startDegrees, "deg");
+    _reportLatency("move", "round_trip", roundTrips);
+    _reportLatency("move", "response", _responseCycles);
+    _reportLatency("move", "loop", _loopCycles);
+
+    return true;
+}
+
+bool SimBenchmark::_haltWhileMoving()
+{
+    static const unsigned long DELAYS_MS[] = SIM_BENCHMARK_HALT_DELAYS_MS;
+    std::vector<uint64_t> detects;
+    std::vector<uint64_t> stops;
+    std::vector<uint64_t> replies;
+    double maxCoastDegrees = 0.0;
+    std::string reply;
+    uint64_t roundTrip;
+    int trial = 0;
+
+    for (unsigned long delayMs : DELAYS_MS)
+    {
+        // back and forth between 0 and the move target
+        const char *move = trial++ % 2 == 0 ? "MD:0" : "MD:" SIM_BENCHMARK_MOVE_DEG;
+        if (!_command(move, reply, roundTrip))
+            return false;
+
+        uint64_t haltAt = Simulator::cycles() + (uint64_t)delayMs * (F_CPU / 1000UL);
+        while (Simulator::cycles() < haltAt)
+            _loopOnce();
+
+        size_t lines = Simulator::deviceLines().size();
+        uint64_t arrival = Simulator::sendToDevice("FH\n") - Simulator::serialByteCycles();
+
+        while (Simulator::serialReadCycle() < arrival)
+            _loopOnce();
+
+        detects.push_back(Simulator::serialReadCycle() - arrival);
+        double detectDegrees = Simulator::rotatorDegrees();
+
+        uint64_t timeout = arrival + (uint64_t)SIM_BENCHMARK_TIMEOUT_SECONDS * F_CPU;
+        while (Simulator::deviceLines().size() == lines)
+        {
+            if (Simulator::cycles() > timeout)
+                return false;
+
+            _loopOnce();
+        }
+
+        const SimLine &line = Simulator::deviceLines()[lines];
+        if (line.text != "FH:1;")
+            return false;
+
+        uint64_t replyStart = line.cycle - (line.text.size() + 2) * Simulator::serialByteCycles();
+        replies.push_back(replyStart > arrival ? replyStart - arrival : 0);
+        stops.push_back(Simulator::motorStepCycle() > arrival ? Simulator::motorStepCycle() - arrival : 0);
+        maxCoastDegrees = std::max(maxCoastDegrees, fabs(Simulator::rotatorDegrees() - detectDegrees));
+
+        // the motor has to stand still when the reply arrives
+        if (Simulator::motorStepCycle() > replyStart || !_command("FR", reply, roundTrip) || reply != "FR:0")
+            return false;
+    }
+
+    _reportLatency("halt", "detect", detects);
+    _reportLatency("halt", "stop", stops);
+    _reportLatency("halt", "reply", replies);
+    _report("halt", "coast_max", maxCoastDegrees, "deg");
+
+    return true;
+}
+
+bool SimBenchmark::_waitForStop()
+{
+    std::string reply;
+    uint64_t roundTrip;
+    do
+    {
+        if (!_command("FR", reply, roundTrip))
+            return false;
+    } while (reply != "FR:0");
+
+    return true;
+}
+
+bool SimBenchmark::_pushEvents()
+{
+    std::string reply;
+    uint64_t roundTrip;
+
+    if (!_command("MD:0", reply, roundTrip) || !_waitForStop())
+        return false;
+
+    // polling: FA until the moving field of "FR_OK:steps:deg:moving:..." is 0
+    unsigned long bytes = Simulator::bytesToDevice() + Simulator::bytesFromDevice();
+    unsigned long polls = 0;
+    if (!_command("MD:" SIM_BENCHMARK_MOVE_DEG, reply, roundTrip))
+        return false;
+
+    do
+    {
+        if (!_command("FA", reply, roundTrip))
+            return false;
+
+        polls++;
+    } while (reply.compare(reply.find(':', reply.find(':', reply.find(':') + 1) + 1), 3, ":1:") == 0);
+
+    _report("push", "polling_bytes", Simulator::bytesToDevice() + Simulator::bytesFromDevice() - bytes, "bytes");
+    _report("push", "polling_polls", polls, "");
+
+    // push: one command, then events until the move is complete
+    if (!_command(SIM_BENCHMARK_PUSH_SUBSCRIPTION, reply, roundTrip) || reply != SIM_BENCHMARK_PUSH_SUBSCRIPTION)
+        return false;
+
+    bytes = Simulator::bytesToDevice() + Simulator::bytesFromDevice();
+    size_t line = Simulator::deviceLines().size();
+    unsigned long events = 0;
+    uint64_t timeout = Simulator::cycles() + (uint64_t)SIM_BENCHMARK_TIMEOUT_SECONDS * F_CPU;
+    Simulator::sendToDevice("MD:0\n");
+
+    for (;;)
+    {
+        if (Simulator::cycles() > timeout)
+            return false;
+
+        _loopOnce();
+        if (line == Simulator::deviceLines().size())
+            continue;
+
+        const std::string text = Simulator::deviceLines()[line++].text;
+        if (text.compare(0, 3, "PP:") == 0)
+            events++;
+        else if (text.compare(0, 3, "PC:") == 0)
+        {
+            _report("push", "complete_deg", atof(text.c_str() + text.find(':', 3) + 1), "deg");
+            break;
+        }
+    }
+
+    _report("push", "push_bytes", Simulator::bytesToDevice() + Simulator::bytesFromDevice() - bytes, "bytes");
+    _report("push", "push_events", events, "");
+
+    return _command("PS:0:0", reply, roundTrip) && reply == "PS:0:0";
+}
+
+bool SimBenchmark::_batchedCommands()
+{
+    static const char *const COMMANDS[] = {"FV", "FD", "GS", "GG", "FR"};
+    std::string reply;
+    uint64_t roundTrip;
+
+    uint64_t start = Simulator::cycles();
+    for (const char *command : COMMANDS)
+    {
+        if (!_command(command, reply, roundTrip))
+            return false;
+    }
+    uint64_t separate = Simulator::cycles() - start;
+
+    start = Simulator::cycles();
+    if (!_command("FV;FD;GS;GG;FR", reply, roundTrip))
+        return false;
+    uint64_t batched = Simulator::cycles() - start;
+
+    _report("batch", "separate", _cyclesToMs(separate), "ms");
+    _report("batch", "batched", _cyclesToMs(batched), "ms");
+
+    return true;
+}
+
+bool SimBenchmark::_waitForBaud(unsigned long baud, unsigned long timeoutMs)
+{
+    // the host follows the device, the simulated wire has one rate for both sides
+    uint64_t timeout = Simulator::cycles() + (uint64_t)timeoutMs * (F_CPU / 1000UL);
+    while (Simulator::serialBaud() != baud)
+    {
+        if (Simulator::cycles() > timeout)
+            return false;
+
+        _loopOnce();
+    }
+
+    return true;
+}
+
+bool SimBenchmark::_pollFullStatus(const char *workload)
+{
+    std::vector<uint64_t> roundTrips;
+    for (int i = 0; i < SIM_BENCHMARK_POLLS; i++)
+    {
+        std::string reply;
+        uint64_t roundTrip;
+        if (!_command("FA", reply, roundTrip))
+            return false;
+
+        roundTrips.push_back(roundTrip);
+    }
+
+    char metric[32];
+    snprintf(metric, sizeof(metric), "fa_%lu", Simulator::serialBaud());
+    _report(workload, metric, _percentileMs(roundTrips, 50.0), "ms");
+
+    return true;
+}
+
+bool SimBenchmark::_baudRates()
+{
+    static const unsigned long BAUD_RATES[] = SIM_BENCHMARK_BAUD_RATES;
+    std::string reply;
+    uint64_t roundTrip;
+
+    if (!_pollFullStatus("baud"))
+        return false;
+
+    for (unsigned long baud : BAUD_RATES)
+    {
+        std::string rate = std::to_string(baud);
+        if (!_command(("BR:" + rate).c_str(), reply, roundTrip) || reply != "BR:" + rate)
+            return false;
+
+        if (!_waitForBaud(baud, 100) || !_command("BC", reply, roundTrip) || reply != "BC:" + rate)
+            return false;
+
+        if (!_pollFullStatus("baud"))
+            return false;
+    }
+
+    // a switch nobody confirms falls back to the rate in use before
+    unsigned long confirmed = Simulator::serialBaud();
+    if (!_command("BR:9600", reply, roundTrip) || !_waitForBaud(9600, 100))
+        return false;
+
+    uint64_t start = Simulator::cycles();
+    if (!_waitForBaud(confirmed, 10000))
+        return false;
+
+    _report("baud", "revert_after", _cyclesToMs(Simulator::cycles() - start), "ms");
+
+    if (!_command("F#", reply, roundTrip) || reply != "FR_OK")
+        return false;
+
+    // the confirmed rate reaches the EEPROM with the next configuration write
+    uint64_t stored = Simulator::cycles() + (uint64_t)10 * F_CPU;
+    while (Simulator::cycles() < stored)
+        _loopOnce();
+
+    // EEPROM_OFFSET_SERIAL_BAUD of CustomEEPROM.h in the copy with the newer EEPROM_OFFSET_GENERATION
+    // (copies at 0 and 48, the other one may be blank), little endian
+    unsigned int copy = (int8_t)(Simulator::eepromRead(48 + 4) - Simulator::eepromRead(4)) > 0 && Simulator::eepromRead(48) != 0xFF ? 48 : 0;
+    uint32_t storedBaud = 0;
+    for (int i = 3; i >= 0; i--)
+        storedBaud = (storedBaud << 8) | Simulator::eepromRead(copy + 31 + i);
+
+    _report("baud", "stored", storedBaud, "baud");
+
+    return storedBaud == confirmed;
+}
+
+std::string SimBenchmark::_binaryRequest(uint8_t id, uint8_t operation, uint32_t value, int size)
+{
+    std::string frame;
+    frame += (char)SIM_BENCHMARK_BINARY_SYNC;
+    frame += (char)(size + 2);
+    frame += (char)id;
+    frame += (char)operation;
+    for (int i = 0; i < size; i++)
+        frame += (char)(value >> (8 * i));
+
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 1; i < frame.size(); i++)
+        crc = _crc_ccitt_update(crc, (uint8_t)frame[i]);
+
+    frame += (char)crc;
+    frame += (char)(crc >> 8);
+
+    return frame;
+}
+
+static uint32_t _readNumber(const std::string &bytes, size_t offset, int size)
+{
+    uint32_t value = 0;
+    for (int i = size - 1; i >= 0; i--)
+        value = (value << 8) | (uint8_t)bytes[offset + i];
+
+    return value;
+}
+
+bool SimBenchmark::_binaryFrame(uint8_t operation, uint32_t value, int size, std::string &payload, uint64_t &roundTripCycles)
+{
+    // payload of the reply: status byte, then the data
+    static uint8_t id = 0;
+    id++;
+
+    Simulator::takeDeviceOutput();
+    uint64_t start = Simulator::cycles() > Simulator::wireIdleCycle() ? Simulator::cycles() : Simulator::wireIdleCycle();
+    uint64_t timeout = start + (uint64_t)SIM_BENCHMARK_TIMEOUT_SECONDS * F_CPU;
+
+    Simulator::sendToDevice(_binaryRequest(id, operation, value, size));
+
+    std::string output;
+    while (output.size() < 2 || output.size() < (size_t)(uint8_t)output[1] + 4)
+    {
+        if (Simulator::cycles() > timeout)
+            return false;
+
+        _loopOnce();
+        output += Simulator::takeDeviceOutput();
+    }
+
+    roundTripCycles = Simulator::cycles() - start;
+
+    uint8_t length = output[1];
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 1; i < (size_t)length + 2; i++)
+        crc = _crc_ccitt_update(crc, (uint8_t)output[i]);
+
+    if ((uint8_t)output[0] != SIM_BENCHMARK_BINARY_SYNC || (uint8_t)output[2] != id || (uint8_t)output[3] != (operation | 0x80) ||
+        output.size() != (size_t)length + 4 || crc != _readNumber(output, length + 2, 2))
+        return false;
+
+    payload = output.substr(4, length - 2);
+
+    return true;
+}
+
+bool SimBenchmark::_binaryFrames()
+{
+    std::string reply;
+    std::string payload;
+    uint64_t roundTrip;
+    std::vector<uint64_t> roundTrips;
+
+    // ASCII full status at the same rate for comparison
+    unsigned long bytes = Simulator::bytesToDevice() + Simulator::bytesFromDevice();
+    for (int i = 0; i < SIM_BENCHMARK_POLLS; i++)
+    {
+        if (!_command("FA", reply, roundTrip))
+            return false;
+
+        roundTrips.push_back(roundTrip);
+    }
+
+    _report("binary", "ascii_fa_bytes", (Simulator::bytesToDevice() + Simulator::bytesFromDevice() - bytes) / (double)SIM_BENCHMARK_POLLS, "bytes");
+    _report("binary", "ascii_fa_p50", _percentileMs(roundTrips, 50.0), "ms");
+
+    if (!_command("BM", reply, roundTrip) || reply != "BM:1")
+        return false;
+
+    roundTrips.clear();
+    bytes = Simulator::bytesToDevice() + Simulator::bytesFromDevice();
+    for (int i = 0; i < SIM_BENCHMARK_POLLS; i++)
+    {
+        if (!_binaryFrame(SIM_BENCHMARK_BINARY_OP_STATUS, 0, 0, payload, roundTrip) || payload.size() != 4 || payload[0] != 0)
+            return false;
+
+        roundTrips.push_back(roundTrip);
+    }
+
+    _report("binary", "status_bytes", (Simulator::bytesToDevice() + Simulator::bytesFromDevice() - bytes) / (double)SIM_BENCHMARK_POLLS, "bytes");
+    _report("binary", "status_p50", _percentileMs(roundTrips, 50.0), "ms");
+
+    // move by frame and follow it with status frames until the moving flag is gone
+    double startDegrees = Simulator::rotatorDegrees();
+    if (!_binaryFrame(SIM_BENCHMARK_BINARY_OP_MOVE, 9000, 4, payload, roundTrip) || payload[0] != 0)
+        return false;
+
+    do
+    {
+        if (!_binaryFrame(SIM_BENCHMARK_BINARY_OP_STATUS, 0, 0, payload, roundTrip))
+            return false;
+    } while (payload[3] & 0x01);
+
+    _report("binary", "move_reported_deg", _readNumber(payload, 1, 2) / 100.0, "deg");
+    _report("binary", "move_rotator_deg", Simulator::rotatorDegrees() - startDegrees, "deg");
+
+    // halt mid-move, the reply comes once the motor stands still
+    if (!_binaryFrame(SIM_BENCHMARK_BINARY_OP_MOVE, 0, 4, payload, roundTrip) || payload[0] != 0)
+        return false;
+
+    uint64_t haltAt = Simulator::cycles() + F_CPU / 2;
+    while (Simulator::cycles() < haltAt)
+        _loopOnce();
+
+    if (!_binaryFrame(SIM_BENCHMARK_BINARY_OP_HALT, 0, 0, payload, roundTrip) || payload[0] != 0 || Simulator::motorStepCycle() > Simulator::cycles())
+        return false;
+
+    _report("binary", "halt_reply", _cyclesToMs(roundTrip), "ms");
+
+    if (!_binaryFrame(SIM_BENCHMARK_BINARY_OP_STATUS, 0, 0, payload, roundTrip) || (payload[3] & 0x01))
+        return false;
+
+    // step mode read back and written unchanged
+    if (!_binaryFrame(SIM_BENCHMARK_BINARY_OP_GET_STEP_MODE, 0, 0, payload, roundTrip) || payload.size() != 3)
+        return false;
+
+    uint32_t stepMode = _readNumber(payload, 1, 2);
+    if (!_binaryFrame(SIM_BENCHMARK_BINARY_OP_SET_STEP_MODE, stepMode, 2, payload, roundTrip) || payload[0] != 0)
+        return false;
+
+    // a corrupted frame is dropped without reply
+    std::string corrupted = _binaryRequest(0, SIM_BENCHMARK_BINARY_OP_STATUS, 0, 0);
+    corrupted[corrupted.size() - 1] ^= 0x55;
+    Simulator::takeDeviceOutput();
+    Simulator::sendToDevice(corrupted);
+
+    uint64_t quietUntil = Simulator::cycles() + F_CPU / 10;
+    while (Simulator::cycles() < quietUntil)
+        _loopOnce();
+
+    if (!Simulator::takeDeviceOutput().empty())
+        return false;
+
+    // back to ASCII
+    if (!_binaryFrame(SIM_BENCHMARK_BINARY_OP_EXIT, 0, 0, payload, roundTrip) || payload[0] != 0)
+        return false;
+
+    Simulator::discardDeviceLine();
+
+    return _command("F#", reply, roundTrip) && reply == "FR_OK";
+}
+
+bool SimBenchmark::_driverRegisters()
+{
+    std::string reply;
+    uint64_t roundTrip;
+
+    // nothing to count without a UART driver, native_bench_tmc220x builds the TMC2208 backend
+    if (Simulator::tmcTransactions() == 0)
+        return true;
+
+    if (!_command("MD:0", reply, roundTrip) || !_waitForStop())
+        return false;
+
+    unsigned long transactions = Simulator::tmcTransactions();
+    for (int i = 0; i < SIM_BENCHMARK_REGISTER_MOVES; i++)
+    {
+        if (!_command(i % 2 == 0 ? "MD:" SIM_BENCHMARK_REGISTER_MOVE_DEG : "MD:0", reply, roundTrip) || !_waitForStop())
+            return false;
+    }
+
+    _report("registers", "tmc_per_move", (double)(Simulator::tmcTransactions() - transactions) / SIM_BENCHMARK_REGISTER_MOVES, "");
+
+    // another step mode changes CHOPCONF once, the move after it writes it again
+    if (!_command("GS", reply, roundTrip) || reply.compare(0, 3, "GS:") != 0)
+        return false;
+
+    std::string stepMode = reply.substr(3);
+    std::string otherStepMode = stepMode == "16" ? "8" : "16";
+    if (!_command(("SS:" + otherStepMode).c_str(), reply, roundTrip) || reply != "(OK)")
+        return false;
+
+    transactions = Simulator::tmcTransactions();
+    if (!_command("MD:" SIM_BENCHMARK_REGISTER_MOVE_DEG, reply, roundTrip) || !_waitForStop())
+        return false;
+
+    _report("registers", "tmc_step_change", Simulator::tmcTransactions() - transactions, "");
+
+    return _command(("SS:" + stepMode).c_str(), reply, roundTrip) && reply == "(OK)" &&
+           _command("MD:0", reply, roundTrip) && _waitForStop();
+}
+
+bool SimBenchmark::_waitForStopRate(double &maxStepRate)
+{
+    std::string reply;
+    uint64_t roundTrip;
+    uint64_t windowCycles = (uint64_t)SIM_BENCHMARK_STEP_RATE_WINDOW_MS * (F_CPU / 1000UL);
+    uint64_t windowStart = Simulator::cycles();
+    long windowSteps = Simulator::motorSteps();
+
+    maxStepRate = 0.0;
+    do
+    {
+        if (!_command("FR", reply, roundTrip))
+            return false;
+
+        uint64_t elapsed = Simulator::cycles() - windowStart;
+        if (elapsed < windowCycles)
+            continue;
+
+        maxStepRate = std::max(maxStepRate, labs(Simulator::motorSteps() - windowSteps) * (double)F_CPU / elapsed);
+        windowStart = Simulator::cycles();
+        windowSteps = Simulator::motorSteps();
+    } while (reply != "FR:0");
+
+    return true;
+}
+
+bool SimBenchmark::_stepModes()
+{
+    static const unsigned int STEP_MODES[] = SIM_BENCHMARK_STEP_MODES;
+    std::string reply;
+    uint64_t roundTrip;
+
+    if (!_command("MD:0", reply, roundTrip) || !_waitForStop())
+        return false;
+
+    if (!_command("GS", reply, roundTrip) || reply.compare(0, 3, "GS:") != 0)
+        return false;
+
+    std::string stepMode = reply.substr(3);
+    if (!_command("GG", reply, roundTrip) || reply.compare(0, 3, "SG:") != 0)
+        return false;
+
+    std::string speedMode = reply.substr(3);
+    if (!_command("SG:" SIM_BENCHMARK_STEP_SPEED_MODE, reply, roundTrip) || reply != "(OK)")
+        return false;
+
+    int trial = 0;
+    for (unsigned int mode : STEP_MODES)
+    {
+        if (!_command(("SS:" + std::to_string(mode)).c_str(), reply, roundTrip) || reply != "(OK)")
+            return false;
+
+        long startSteps = Simulator::motorSteps();
+        uint64_t startCycles = Simulator::stepInterruptCycles();
+        double maxStepRate;
+        if (!_command(trial++ % 2 == 0 ? "MD:" SIM_BENCHMARK_STEP_MOVE_DEG : "MD:0", reply, roundTrip) || !_waitForStopRate(maxStepRate))
+            return false;
+
+        long steps = labs(Simulator::motorSteps() - startSteps);
+        if (steps == 0)
+            return false;
+
+        char metric[32];
+        snprintf(metric, sizeof(metric), "ss%u_cycles_per_step", mode);
+        _report("steps", metric, (double)(Simulator::stepInterruptCycles() - startCycles) / steps, "cycles");
+        snprintf(metric, sizeof(metric), "ss%u_max_rate", mode);
+        _report("steps", metric, maxStepRate, "steps/s");
+    }
+
+    return _command(("SS:" + stepMode).c_str(), reply, roundTrip) && reply == "(OK)" &&
+           _command(("SG:" + speedMode).c_str(), reply, roundTrip) && reply == "(OK)" &&
+           _command("MD:0", reply, roundTrip) && _waitForStop();
+}
+
+bool SimBenchmark::_configurationSave()
+{
+    std::string reply;
+    uint64_t roundTrip;
+
+    if (!_command("GG", reply, roundTrip) || reply.compare(0, 3, "SG:") != 0)
+        return false;
+
+    std::string speedMode = reply.substr(3);
+    std::string otherSpeedMode = speedMode == "1" ? "2" : "1";
+    if (!_command(("SG:" + otherSpeedMode).c_str(), reply, roundTrip) || reply != "(OK)")
+        return false;
+
+    // the EEPROM task picks the change up within EEPROM_CHECK_PERIOD_MS of CustomEEPROM.h
+    unsigned long before = Simulator::eepromWrites();
+    while (Simulator::eepromWrites() == before)
+    {
+        if (!_command("FA", reply, roundTrip, 1))
+            return false;
+    }
+
+    _loopCycles.clear();
+    _responseCycles.clear();
+    uint64_t start = Simulator::cycles();
+    uint64_t quietCycles = (uint64_t)SIM_BENCHMARK_SAVE_QUIET_MS * (F_CPU / 1000UL);
+    uint64_t lastWrite = start;
+    unsigned long writes = Simulator::eepromWrites();
+    while (Simulator::cycles() - lastWrite < quietCycles)
+    {
+        if (!_command("FA", reply, roundTrip))
+            return false;
+
+        if (Simulator::eepromWrites() != writes)
+        {
+            writes = Simulator::eepromWrites();
+            lastWrite = Simulator::cycles();
+        }
+    }
+
+    _report("save", "duration", _cyclesToMs(lastWrite - start), "ms");
+    _report("save", "bytes", writes - before, "bytes");
+    _reportLatency("save", "response", _responseCycles);
+    _reportLatency("save", "loop", _loopCycles);
+
+    return _command(("SG:" + speedMode).c_str(), reply, roundTrip) && reply == "(OK)";
+}
+
+bool SimBenchmark::_parseCommands()
+{
+    static const char *const COMMANDS[] = SIM_BENCHMARK_PARSE_COMMANDS;
+    std::string reply;
+    uint64_t roundTrip;
+
+    _responseCycles.clear();
+    for (int i = 0; i < SIM_BENCHMARK_POLLS; i++)
+    {
+        for (const char *command : COMMANDS)
+        {
+            if (!_command(command, reply, roundTrip))
+                return false;
+        }
+    }
+
+    _reportLatency("parse", "response", _responseCycles);
+
+    // the whole burst is on the wire at once, the device drains it at its own pace
+    std::string burst;
+    for (int i = 0; i < SIM_BENCHMARK_PARSE_BURST; i++)
+        burst += "F#\n";
+
+    size_t lines = Simulator::deviceLines().size();
+    uint64_t start = Simulator::cycles() > Simulator::wireIdleCycle() ? Simulator::cycles() : Simulator::wireIdleCycle();
+    uint64_t timeout = start + (uint64_t)SIM_BENCHMARK_TIMEOUT_SECONDS * F_CPU;
+    Simulator::sendToDevice(burst);
+
+    while (Simulator::deviceLines().size() < lines + SIM_BENCHMARK_PARSE_BURST)
+    {
+        if (Simulator::cycles() > timeout)
+            return false;
+
+        _loopOnce();
+    }
+
+    for (size_t line = lines; line < lines + SIM_BENCHMARK_PARSE_BURST; line++)
+    {
+        if (Simulator::deviceLines()[line].text != "FR_OK;")
+            return false;
+    }
+
+    double seconds = (Simulator::deviceLines()[lines + SIM_BENCHMARK_PARSE_BURST - 1].cycle - start) / (double)F_CPU;
+    _report("parse", "burst_commands_per_s", SIM_BENCHMARK_PARSE_BURST / seconds, "1/s");
+    _report("parse", "burst_baud", Simulator::serialBaud(), "baud");
+
+    return true;
+}
+
+uint64_t SimBenchmark::_hostLoopNs()
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    loop();
+
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool SimBenchmark::_dispatchCommands()
+{
+    static const char *const COMMANDS[] = SIM_BENCHMARK_DISPATCH_COMMANDS;
+    std::vector<uint64_t> idle;
+    std::vector<uint64_t> times;
+
+    for (int i = 0; i < SIM_BENCHMARK_DISPATCH_RUNS; i++)
+        idle.push_back(_hostLoopNs());
+
+    std::sort(idle.begin(), idle.end());
+    uint64_t idleNs = idle[idle.size() / 2];
+
+    for (const char *command : COMMANDS)
+    {
+        times.clear();
+        for (int i = 0; i < SIM_BENCHMARK_DISPATCH_RUNS; i++)
+        {
+            // the whole line waits in the receive buffer, one loop() reads it and queues the reply
+            size_t lines = Simulator::deviceLines().size();
+            Simulator::advanceTo(Simulator::sendToDevice(std::string(command) + "\n"));
+
+            uint64_t ns = _hostLoopNs();
+            if (Simulator::serialAvailable() != 0)
+                return false;
+
+            uint64_t timeout = Simulator::cycles() + (uint64_t)SIM_BENCHMARK_TIMEOUT_SECONDS * F_CPU;
+            while (Simulator::deviceLines().size() == lines)
+            {
+                if (Simulator::cycles() > timeout)
+                    return false;
+
+                loop();
+            }
+
+            times.push_back(ns > idleNs ? ns - idleNs : 0);
+        }
+
+        std::sort(times.begin(), times.end());
+        char metric[32];
+        snprintf(metric, sizeof(metric), "%s_ns", command);
+        _report("dispatch", metric, times[times.size() / 2], "ns");
+    }
+
+    _report("dispatch", "idle_loop_ns", idleNs, "ns");
+
+    return true;
+}
+
+bool SimBenchmark::_telemetry()
+{
+    // counters of the firmware since boot, no reply when built without telemetry
+    std::string reply;
+    uint64_t roundTrip;
+    if (_command("TM", reply, roundTrip, 1))
+        printf("%-12s %s\n", "telemetry", reply.c_str());
+
+    // scheduler statistics per task, until the first unknown task id
+    for (int task = 0;; task++)
+    {
+        std::string command = "TS:" + std::to_string(task);
+        if (!_command(command.c_str(), reply, roundTrip, 1) || reply == "(KO)")
+            break;
+
+        printf("%-12s %s\n", "tasks", reply.c_str());
+    }
+
+    return true;
+}
+
+int SimBenchmark::run()
+{
+    printf("%-12s %-22s %12s\n", "workload", "metric", "value");
+
+    bool isOk = _bootWhilePolling() && _idlePolling() && _moveWhilePolling() && _haltWhileMoving() && _pushEvents() && _batchedCommands() && _baudRates() && _binaryFrames() && _driverRegisters() && _stepModes() && _configurationSave() && _parseCommands() && _dispatchCommands() && _telemetry();
+
+    _report("total", "simulated", Simulator::seconds() * 1000.0, "ms");
+    _report("total", "bytes_to_device", Simulator::bytesToDevice(), "bytes");
+    _report("total", "bytes_from_device", Simulator::bytesFromDevice(), "bytes");
+    _report("total", "serial_rx_dropped", Simulator::serialDropped(), "bytes");
+    _report("total", "tmc_transactions", Simulator::tmcTransactions(), "");
+
+    _report("total", "response_max", _cyclesToMs(_maxResponseCycles), "ms");
+
+    if (!isOk)
+        fprintf(stderr, "benchmark: workload failed or timed out\n");
+
+    // the guarantee of the scheduler: every command is answered in time, homing included
+    if (_cyclesToMs(_maxResponseCycles) > SIM_BENCHMARK_MAX_RESPONSE_MS)
+    {
+        fprintf(stderr, "benchmark: response took %.3f ms, more than %d ms\n", _cyclesToMs(_maxResponseCycles), SIM_BENCHMARK_MAX_RESPONSE_MS);
+        isOk = false;
+    }
+
+    return isOk ? 0 : 1;
+}
@@ -0,0 +1,132 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#pragma once
+
+/**
+ * Fixed workloads against the firmware in simulated time, built with
+ * -D SIM_BENCHMARK (env:native_bench). The numbers are deterministic, run
+ * them before and after a change to compare. Response is the device's share
+ * of a round trip, the time the bytes spend on the wire is taken out.
+ */
+#define SIM_BENCHMARK_POLLS 200
+#define SIM_BENCHMARK_MOVE_DEG "180"
+#define SIM_BENCHMARK_TIMEOUT_SECONDS 600
+
+/**
+ * FH sent at these times after the start of a move, through the ramp into
+ * cruise. Latencies count from the 'H' byte arriving at the device: detect
+ * when the firmware reads it, stop at the last step, reply at the first byte
+ * of "FH:1".
+ */
+#define SIM_BENCHMARK_HALT_DELAYS_MS {20, 100, 250, 500, 1000, 2000}
+
+/**
+ * The same 180 deg move followed by FA polls and by PS events
+ */
+#define SIM_BENCHMARK_PUSH_SUBSCRIPTION "PS:100:0"
+
+/**
+ * Serial rates switched to with BR and BC, FA is polled at each of them
+ */
+#define SIM_BENCHMARK_BAUD_RATES {115200UL, 250000UL}
+
+/**
+ * Binary frames (BinaryProtocol.h of the firmware), replies are taken from
+ * the raw device output
+ */
+#define SIM_BENCHMARK_BINARY_SYNC 0xA5
+#define SIM_BENCHMARK_BINARY_OP_STATUS 1
+#define SIM_BENCHMARK_BINARY_OP_MOVE 2
+#define SIM_BENCHMARK_BINARY_OP_HALT 5
+#define SIM_BENCHMARK_BINARY_OP_GET_STEP_MODE 6
+#define SIM_BENCHMARK_BINARY_OP_SET_STEP_MODE 7
+#define SIM_BENCHMARK_BINARY_OP_EXIT 8
+
+/**
+ * Short moves back and forth, TMC2208 UART transactions are counted per
+ * move with the step mode unchanged and for the move after an SS
+ */
+#define SIM_BENCHMARK_REGISTER_MOVES 10
+#define SIM_BENCHMARK_REGISTER_MOVE_DEG "5"
+
+/**
+ * A move at the fastest speed mode (SG) in each of these step modes, the
+ * cycles of the step interrupt are counted per step. The step rate is
+ * sampled between FR polls, the highest one over a window is the maximum.
+ */
+#define SIM_BENCHMARK_STEP_MODES {1, 2, 4, 8, 16, 32, 64, 128, 256}
+#define SIM_BENCHMARK_STEP_MOVE_DEG "45"
+#define SIM_BENCHMARK_STEP_SPEED_MODE "5"
+#define SIM_BENCHMARK_STEP_RATE_WINDOW_MS 50
+
+/**
+ * FA polls while SG to another speed mode is saved, loop() is timed from
+ * the first EEPROM byte programmed until none was for SIM_BENCHMARK_SAVE_QUIET_MS
+ */
+#define SIM_BENCHMARK_SAVE_QUIET_MS 50
+
+/**
+ * Commands of every argument type, each sent SIM_BENCHMARK_POLLS times. The
+ * worst response is the parse latency. Then a burst of F# sent back to back,
+ * answered commands per second of simulated time.
+ */
+#define SIM_BENCHMARK_PARSE_COMMANDS {"F#", "FA", "GR", "TS:4", "PS:0:0", "FR;FV;GG", "SG:9"}
+#define SIM_BENCHMARK_PARSE_BURST 32
+
+/**
+ * Commands without side effects, each line is put into the receive buffer
+ * and the loop() reading it is timed on the host clock, less an idle loop():
+ * tokenizing, table lookup, the command and queuing its reply. The
+ * simulated clock does not charge for computation, so these are host
+ * nanoseconds (median of SIM_BENCHMARK_DISPATCH_RUNS) and differ between
+ * machines, compare them within one run.
+ */
+#define SIM_BENCHMARK_DISPATCH_COMMANDS {"F#", "FS", "FA", "FV", "FD", "FP", "FR", "VS", "GS", "GG", "GR", "TS:0"}
+#define SIM_BENCHMARK_DISPATCH_RUNS 1000
+
+/**
+ * Longest accepted response, from the last byte of a command to the first
+ * byte of its reply. A longer one fails the run (exit code 1).
+ */
+#define SIM_BENCHMARK_MAX_RESPONSE_MS 10
+
+class SimBenchmark
+{
+private:
+    static std::vector<uint64_t> _loopCycles;
+    static std::vector<uint64_t> _responseCycles;
+    static uint64_t _maxResponseCycles;
+
+    static void _loopOnce();
+    static bool _command(const char *text, std::string &reply, uint64_t &roundTripCycles, unsigned long timeoutSeconds = SIM_BENCHMARK_TIMEOUT_SECONDS);
+    static double _percentileMs(std::vector<uint64_t> values, double percentile);
+    static void _report(const char *workload, const char *metric, double value, const char *unit);
+    static void _reportLatency(const char *workload, const char *metric, const std::vector<uint64_t> &cycles);
+
+    static bool _bootWhilePolling();
+    static bool _idlePolling();
+    static bool _moveWhilePolling();
+    static bool _haltWhileMoving();
+    static bool _waitForStop();
+    static bool _pushEvents();
+    static bool _batchedCommands();
+    static bool _waitForBaud(unsigned long baud, unsigned long timeoutMs);
+    static bool _pollFullStatus(const char *workload);
+    static bool _baudRates();
+    static std::string _binaryRequest(uint8_t id, uint8_t operation, uint32_t value, int size);
+    static bool _binaryFrame(uint8_t operation, uint32_t value, int size, std::string &payload, uint64_t &roundTripCycles);
+    static bool _binaryFrames();
+    static bool _driverRegisters();
+    static bool _waitForStopRate(double &maxStepRate);
+    static bool _stepModes();
+    static bool _configurationSave();
+    static bool _parseCommands();
+    static uint64_t _hostLoopNs();
+    static bool _dispatchCommands();
+    static bool _telemetry();
+
+public:
+    static int run();
+};
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/select.h>
+#include <time.h>
+#include <unistd.h>
+#include "Arduino.h"
+#include "SimBenchmark.h"
+
+void setup();
+void loop();
+
+// unit tests (pio test -e native) bring their own main()
+#ifndef PIO_UNIT_TESTING
+
+#ifndef SIM_BENCHMARK
+
+/**
+ * Interactive simulation: stdin is the host side of the serial line, the
+ * replies of the firmware go to stdout and simulated time follows the wall
+ * clock. An optional file keeps the EEPROM across runs (warm boot).
+ *
+ *   .pio/build/native/program [eeprom.bin]
+ */
+static double _wallSeconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static bool _pollInput(std::string &input)
+{
+    fd_set descriptors;
+    FD_ZERO(&descriptors);
+    FD_SET(STDIN_FILENO, &descriptors);
+    struct timeval timeout = {0, 0};
+
+    if (select(STDIN_FILENO + 1, &descriptors, NULL, NULL, &timeout) <= 0)
+        return true;
+
+    char buffer[256];
+    ssize_t size = read(STDIN_FILENO, buffer, sizeof(buffer));
+    if (size <= 0)
+        return false;
+
+    input.append(buffer, size);
+
+    return true;
+}
+
+static int _runInteractive(const char *eepromPath)
+{
+    if (eepromPath != NULL && Simulator::loadEeprom(eepromPath))
+        fprintf(stderr, "sim: EEPROM loaded from %s\n", eepromPath);
+
+    setup();
+
+    double wallStart = _wallSeconds();
+    double simStart = Simulator::seconds();
+    bool isOpen = true;
+
+    while (isOpen || Simulator::cycles() < Simulator::wireIdleCycle())
+    {
+        std::string input;
+        isOpen = isOpen && _pollInput(input);
+        if (!input.empty())
+            Simulator::sendToDevice(input);
+
+        loop();
+
+        std::string output = Simulator::takeDeviceOutput();
+        if (!output.empty())
+        {
+            fwrite(output.data(), 1, output.size(), stdout);
+            fflush(stdout);
+        }
+
+        // never run ahead of the wall clock
+        double ahead = (Simulator::seconds() - simStart) - (_wallSeconds() - wallStart);
+        if (ahead > 0.001)
+            usleep((useconds_t)(ahead * 1e6));
+    }
+
+    // let the last reply and pending EEPROM writes finish
+    Simulator::advance(F_CPU / 10);
+    loop();
+    std::string output = Simulator::takeDeviceOutput();
+    fwrite(output.data(), 1, output.size(), stdout);
+
+    if (eepromPath != NULL && Simulator::saveEeprom(eepromPath))
+        fprintf(stderr, "sim: EEPROM saved to %s\n", eepromPath);
+
+    return 0;
+}
+
+#endif
+
+int main(int argc, char **argv)
+{
+#ifdef SIM_BENCHMARK
+    return SimBenchmark::run();
+#else
+    return _runInteractive(argc > 1 ? argv[1] : NULL);
+#endif
+}
+
+#endif
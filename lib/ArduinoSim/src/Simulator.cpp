@@ -0,0 +1,866 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+#include "Arduino.h"
+#include "avr/eeprom.h"
+#include "Simulator.h"
+
+#define SIM_REGISTER_CYCLES 2
+#define SIM_PIN_COUNT 20
+#define SIM_NEVER UINT64_MAX
+
+// bits of the registers the simulator has to interpret
+#define SIM_TIMER_CS_MASK 0x07
+#define SIM_TIFR_OCF1A 0x02
+#define SIM_TIMSK_OCIE1A 0x02
+#define SIM_EECR_EERE 0x01
+#define SIM_EECR_EEPE 0x02
+#define SIM_EECR_EEMPE 0x04
+#define SIM_EECR_EERIE 0x08
+#define SIM_ADCSRA_ADIE 0x08
+#define SIM_ADCSRA_ADIF 0x10
+#define SIM_ADCSRA_ADATE 0x20
+#define SIM_ADCSRA_ADSC 0x40
+#define SIM_ADCSRA_ADEN 0x80
+#define SIM_ADCSRA_ADPS_MASK 0x07
+
+SimRegister8 TCCR1A(SIM_REG_TCCR1A);
+SimRegister8 TCCR1B(SIM_REG_TCCR1B);
+SimRegister8 TIMSK1(SIM_REG_TIMSK1);
+SimRegister8 TIFR1(SIM_REG_TIFR1);
+SimRegister16 TCNT1(SIM_REG_TCNT1);
+SimRegister16 OCR1A(SIM_REG_OCR1A);
+SimRegister8 EECR(SIM_REG_EECR);
+SimRegister8 EEDR(SIM_REG_EEDR);
+SimRegister16 EEAR(SIM_REG_EEAR);
+SimRegister8 ADMUX(SIM_REG_ADMUX);
+SimRegister8 ADCSRA(SIM_REG_ADCSRA);
+SimRegister8 ADCSRB(SIM_REG_ADCSRB);
+SimRegister8 DIDR0(SIM_REG_DIDR0);
+SimRegister16 ADC(SIM_REG_ADC);
+
+HardwareSerial Serial;
+
+class SimRxByte
+{
+public:
+    uint64_t cycle;
+    uint8_t value;
+};
+
+class SimState
+{
+public:
+    uint64_t now = 0;
+    bool interruptsEnabled = true;
+    bool isInInterrupt = false;
+    uint16_t registers[SIM_REG_COUNT] = {};
+
+    // Timer1, TCNT1 is derived from the cycle it was last 0
+    uint64_t timerZeroCycle = 0;
+    uint16_t timerFrozenCount = 0;
+    bool isTimerTopPassed = false;
+
+    // ADC
+    uint64_t adcDoneCycle = SIM_NEVER;
+    uint8_t adcConvertingPin = A0;
+    uint32_t noiseSeed = 12345;
+
+    // EEPROM
+    uint8_t eeprom[SIM_EEPROM_SIZE];
+    uint64_t eepromDoneCycle = SIM_NEVER;
+    uint16_t eepromWriteAddress = 0;
+    uint8_t eepromWriteValue = 0;
+    unsigned long eepromWrites = 0;
+
+    // UART
+    unsigned long baud = 9600;
+    std::deque<SimRxByte> rxWire;
+    std::deque<uint8_t> rxFifo; // UDR and the two level receive FIFO
+    std::deque<uint8_t> rxBuffer;
+    std::deque<uint8_t> txBuffer;
+    uint64_t txDoneCycle = SIM_NEVER;
+    uint8_t txShift = 0;
+    uint64_t wireIdleCycle = 0;
+    unsigned long rxDropped = 0;
+    uint64_t rxReadCycle = 0;
+    unsigned long bytesToDevice = 0;
+    unsigned long bytesFromDevice = 0;
+    std::string lineText;
+    std::string output;
+    std::vector<SimLine> lines;
+
+    // pins and mechanics
+    uint8_t pins[SIM_PIN_COUNT] = {};
+    uint8_t pinModes[SIM_PIN_COUNT] = {};
+    unsigned int microsteps = 1;
+    long motorSteps = 0;
+    uint64_t motorStepCycle = 0;
+    uint64_t stepInterruptCycles = 0;
+    double motorRevolutions = 0.0;
+    int8_t uln2003Phase = 0;
+    double homeDegrees = SIM_HOME_DEG;
+    unsigned long tmcTransactions = 0;
+    unsigned long tmcWrites[SIM_TMC_REGISTER_COUNT] = {};
+    uint32_t tmcRegisters[SIM_TMC_REGISTER_COUNT] = {};
+
+    SimState()
+    {
+        memset(eeprom, 0xFF, sizeof(eeprom));
+    }
+};
+
+static SimState _sim;
+
+static const uint8_t ULN2003_SEQUENCE[8] = {0x01, 0x03, 0x02, 0x06, 0x04, 0x0C, 0x08, 0x09};
+
+static unsigned int _timerPrescaler()
+{
+    switch (_sim.registers[SIM_REG_TCCR1B] & SIM_TIMER_CS_MASK)
+    {
+    case 1:
+        return 1;
+    case 2:
+        return 8;
+    case 3:
+        return 64;
+    case 4:
+        return 256;
+    case 5:
+        return 1024;
+    default:
+        return 0;
+    }
+}
+
+static uint16_t _timerCount()
+{
+    unsigned int prescaler = _timerPrescaler();
+    if (prescaler == 0)
+        return _sim.timerFrozenCount;
+
+    return (uint16_t)((_sim.now - _sim.timerZeroCycle) / prescaler);
+}
+
+static uint64_t _timerMatchCycle()
+{
+    unsigned int prescaler = _timerPrescaler();
+    if (prescaler == 0)
+        return SIM_NEVER;
+
+    // TOP set below the counter: the counter runs up to 0xFFFF and wraps first
+    uint64_t top = _sim.registers[SIM_REG_OCR1A];
+    if (_sim.isTimerTopPassed)
+        top += 0x10000;
+
+    return _sim.timerZeroCycle + (top + 1) * prescaler;
+}
+
+static unsigned int _adcPrescaler()
+{
+    unsigned int adps = _sim.registers[SIM_REG_ADCSRA] & SIM_ADCSRA_ADPS_MASK;
+    return adps == 0 ? 2 : 1 << adps;
+}
+
+static uint8_t _adcPin()
+{
+    return A0 + (_sim.registers[SIM_REG_ADMUX] & 0x0F);
+}
+
+static void _startAdcConversion(uint64_t cycle)
+{
+    _sim.adcConvertingPin = _adcPin();
+    _sim.adcDoneCycle = cycle + SIM_ADC_CONVERSION_CLOCKS * _adcPrescaler();
+}
+
+static int _noise()
+{
+    _sim.noiseSeed = _sim.noiseSeed * 1103515245u + 12345u;
+    return (int)((_sim.noiseSeed >> 16) % (2 * SIM_HOME_SENSOR_NOISE + 1)) - SIM_HOME_SENSOR_NOISE;
+}
+
+static uint16_t _sampleAnalog(uint8_t pin)
+{
+    if (pin == A0)
+    {
+        double distance = fmod(fabs(Simulator::rotatorDegrees() - _sim.homeDegrees), 360.0);
+        if (distance > 180.0)
+            distance = 360.0 - distance;
+
+        double dip = SIM_HOME_SENSOR_DIP * exp(-(distance * distance) / (2.0 * SIM_HOME_SENSOR_WIDTH_DEG * SIM_HOME_SENSOR_WIDTH_DEG));
+        return (uint16_t)(SIM_HOME_SENSOR_IDLE - dip + _noise());
+    }
+
+    if (pin == A1)
+        return (uint16_t)(SIM_SUPPLY_VOLTS / SIM_VOLTAGE_FULL_SCALE * 1023.0);
+
+    return 0;
+}
+
+static void _serialStartTransmit()
+{
+    if (_sim.txDoneCycle != SIM_NEVER || _sim.txBuffer.empty())
+        return;
+
+    _sim.txShift = _sim.txBuffer.front();
+    _sim.txBuffer.pop_front();
+    _sim.txDoneCycle = _sim.now + Simulator::serialByteCycles();
+}
+
+// MOTOR_DRIVER comes from build_flags, unset is the ULN2003 default of MotorDriver.h
+static void _moveMotor(int direction)
+{
+    unsigned long stepsPerRevolution;
+#if MOTOR_DRIVER == 1
+    stepsPerRevolution = (unsigned long)SIM_TMC220X_STEPS_PER_REVOLUTION * _sim.microsteps;
+#else
+    stepsPerRevolution = SIM_ULN2003_STEPS_PER_REVOLUTION;
+#endif
+
+    _sim.motorSteps += direction;
+    _sim.motorStepCycle = _sim.now;
+    _sim.motorRevolutions += (double)direction / stepsPerRevolution;
+}
+
+static void _decodeMotorPins(uint8_t pin, uint8_t previous)
+{
+#if MOTOR_DRIVER == 1
+    // TMC220x: a step on the rising edge of STEP, DIR high is forward
+    if (pin == SIM_TMC220X_PIN_STEP && previous == LOW && _sim.pins[pin] == HIGH)
+        _moveMotor(_sim.pins[SIM_TMC220X_PIN_DIR] == HIGH ? 1 : -1);
+#else
+    // ULN2003: the half step sequence changes one coil at a time, every
+    // intermediate pattern is either the old or the new phase
+    if (pin < SIM_ULN2003_PIN_IN1 || pin > SIM_ULN2003_PIN_IN1 + 3)
+        return;
+
+    uint8_t coils = 0;
+    for (uint8_t i = 0; i < 4; i++)
+        coils |= _sim.pins[SIM_ULN2003_PIN_IN1 + i] ? 1 << i : 0;
+
+    for (int8_t phase = 0; phase < 8; phase++)
+    {
+        if (ULN2003_SEQUENCE[phase] != coils)
+            continue;
+
+        int8_t delta = (phase - _sim.uln2003Phase) & 7;
+        if (delta == 1)
+            _moveMotor(1);
+        else if (delta == 7)
+            _moveMotor(-1);
+
+        _sim.uln2003Phase = phase;
+        return;
+    }
+#endif
+}
+
+static void _runInterrupt(void (*vector)(void))
+{
+    uint64_t start = _sim.now;
+    _sim.isInInterrupt = true;
+    _sim.interruptsEnabled = false;
+    _sim.now += SIM_ISR_CYCLES;
+
+    if (vector != NULL)
+        vector();
+
+    if (vector != NULL && vector == TIMER1_COMPA_vect)
+        _sim.stepInterruptCycles += _sim.now - start;
+
+    _sim.interruptsEnabled = true;
+    _sim.isInInterrupt = false;
+}
+
+/**
+ * Runs pending interrupts in vector order, like the AVR does after every
+ * instruction while the I flag is set
+ */
+static void _dispatchInterrupts()
+{
+    while (_sim.interruptsEnabled && !_sim.isInInterrupt)
+    {
+        uint16_t *registers = _sim.registers;
+
+        if ((registers[SIM_REG_TIFR1] & SIM_TIFR_OCF1A) && (registers[SIM_REG_TIMSK1] & SIM_TIMSK_OCIE1A))
+        {
+            registers[SIM_REG_TIFR1] &= ~SIM_TIFR_OCF1A;
+            _runInterrupt(TIMER1_COMPA_vect);
+        }
+        else if (!_sim.rxFifo.empty())
+        {
+            // USART_RX_vect of the Arduino core
+            _runInterrupt(NULL);
+            if (_sim.rxBuffer.size() < SERIAL_RX_BUFFER_SIZE - 1)
+                _sim.rxBuffer.push_back(_sim.rxFifo.front());
+            else
+                _sim.rxDropped++;
+
+            _sim.rxFifo.pop_front();
+        }
+        else if ((registers[SIM_REG_ADCSRA] & SIM_ADCSRA_ADIF) && (registers[SIM_REG_ADCSRA] & SIM_ADCSRA_ADIE))
+        {
+            registers[SIM_REG_ADCSRA] &= ~SIM_ADCSRA_ADIF;
+            _runInterrupt(ADC_vect);
+        }
+        else if ((registers[SIM_REG_EECR] & SIM_EECR_EERIE) && !(registers[SIM_REG_EECR] & SIM_EECR_EEPE))
+        {
+            // level triggered, fires until EERIE is cleared or a write is started
+            if (EE_READY_vect == NULL)
+                registers[SIM_REG_EECR] &= ~SIM_EECR_EERIE;
+            _runInterrupt(EE_READY_vect);
+        }
+        else
+        {
+            return;
+        }
+    }
+}
+
+static void _processEvents(uint64_t until)
+{
+    for (;;)
+    {
+        uint64_t timerCycle = _timerMatchCycle();
+        uint64_t rxCycle = _sim.rxWire.empty() ? SIM_NEVER : _sim.rxWire.front().cycle;
+        uint64_t next = timerCycle;
+        next = _sim.adcDoneCycle < next ? _sim.adcDoneCycle : next;
+        next = _sim.eepromDoneCycle < next ? _sim.eepromDoneCycle : next;
+        next = _sim.txDoneCycle < next ? _sim.txDoneCycle : next;
+        next = rxCycle < next ? rxCycle : next;
+
+        if (next > until)
+            break;
+
+        if (next > _sim.now)
+            _sim.now = next;
+
+        if (next == timerCycle)
+        {
+            // CTC: the counter restarts at 0 on the match
+            _sim.timerZeroCycle = timerCycle;
+            _sim.isTimerTopPassed = false;
+            _sim.registers[SIM_REG_TIFR1] |= SIM_TIFR_OCF1A;
+        }
+        else if (next == _sim.adcDoneCycle)
+        {
+            _sim.registers[SIM_REG_ADC] = _sampleAnalog(_sim.adcConvertingPin);
+            _sim.registers[SIM_REG_ADCSRA] |= SIM_ADCSRA_ADIF;
+
+            // free running (ADTS = 0) starts the next conversion right away, on the ADC clock
+            // even when the event is processed late (during an interrupt)
+            bool isFreeRunning = (_sim.registers[SIM_REG_ADCSRA] & SIM_ADCSRA_ADATE) && (_sim.registers[SIM_REG_ADCSRB] & 0x07) == 0;
+            if (isFreeRunning && (_sim.registers[SIM_REG_ADCSRA] & SIM_ADCSRA_ADEN))
+            {
+                _startAdcConversion(next);
+            }
+            else
+            {
+                _sim.adcDoneCycle = SIM_NEVER;
+                _sim.registers[SIM_REG_ADCSRA] &= ~SIM_ADCSRA_ADSC;
+            }
+        }
+        else if (next == _sim.eepromDoneCycle)
+        {
+            _sim.eeprom[_sim.eepromWriteAddress % SIM_EEPROM_SIZE] = _sim.eepromWriteValue;
+            _sim.eepromWrites++;
+            _sim.registers[SIM_REG_EECR] &= ~SIM_EECR_EEPE;
+            _sim.eepromDoneCycle = SIM_NEVER;
+        }
+        else if (next == _sim.txDoneCycle)
+        {
+            char c = (char)_sim.txShift;
+            _sim.bytesFromDevice++;
+            _sim.output += c;
+
+            if (c == '\n')
+            {
+                SimLine line;
+                line.cycle = next;
+                line.text = _sim.lineText;
+                _sim.lines.push_back(line);
+                _sim.lineText.clear();
+            }
+            else if (c != '\r')
+            {
+                _sim.lineText += c;
+            }
+
+            _sim.txDoneCycle = SIM_NEVER;
+            _serialStartTransmit();
+        }
+        else
+        {
+            // overrun when the receive FIFO is full
+            if (_sim.rxFifo.size() < 3)
+                _sim.rxFifo.push_back(_sim.rxWire.front().value);
+            else
+                _sim.rxDropped++;
+
+            _sim.rxWire.pop_front();
+        }
+
+        _dispatchInterrupts();
+    }
+}
+
+void Simulator::reset()
+{
+    _sim = SimState();
+}
+
+void Simulator::powerCycle(bool isWriteTorn)
+{
+    // the EEPROM and the rotator keep their state, everything else starts over at cycle 0
+    SimState state;
+    memcpy(state.eeprom, _sim.eeprom, sizeof(state.eeprom));
+    state.eepromWrites = _sim.eepromWrites;
+    state.noiseSeed = _sim.noiseSeed;
+    state.motorSteps = _sim.motorSteps;
+    state.motorRevolutions = _sim.motorRevolutions;
+    state.uln2003Phase = _sim.uln2003Phase;
+    state.homeDegrees = _sim.homeDegrees;
+
+    // the byte being programmed was already erased when a torn write lost power
+    if (_sim.eepromDoneCycle != SIM_NEVER && isWriteTorn)
+        state.eeprom[_sim.eepromWriteAddress % SIM_EEPROM_SIZE] = 0xFF;
+
+    _sim = state;
+}
+
+uint64_t Simulator::cycles()
+{
+    return _sim.now;
+}
+
+double Simulator::seconds()
+{
+    return (double)_sim.now / F_CPU;
+}
+
+void Simulator::advance(uint64_t cycles)
+{
+    Simulator::advanceTo(_sim.now + cycles);
+}
+
+void Simulator::advanceTo(uint64_t cycle)
+{
+    // an interrupt handler only accumulates its cost, events are caught up afterwards
+    if (_sim.isInInterrupt)
+    {
+        if (cycle > _sim.now)
+            _sim.now = cycle;
+        return;
+    }
+
+    _processEvents(cycle);
+    if (cycle > _sim.now)
+        _sim.now = cycle;
+    _dispatchInterrupts();
+}
+
+void Simulator::tick()
+{
+    Simulator::advance(SIM_REGISTER_CYCLES);
+}
+
+bool Simulator::interruptsEnabled()
+{
+    return _sim.interruptsEnabled;
+}
+
+void Simulator::setInterruptsEnabled(bool value)
+{
+    if (_sim.isInInterrupt)
+        return;
+
+    _sim.interruptsEnabled = value;
+    if (value)
+        _dispatchInterrupts();
+}
+
+uint16_t Simulator::readRegister(uint8_t id)
+{
+    Simulator::tick();
+
+    switch (id)
+    {
+    case SIM_REG_TCNT1:
+        return _timerCount();
+
+    default:
+        return _sim.registers[id];
+    }
+}
+
+void Simulator::writeRegister(uint8_t id, uint16_t value)
+{
+    Simulator::tick();
+    uint16_t *registers = _sim.registers;
+
+    switch (id)
+    {
+    case SIM_REG_TCCR1B:
+    {
+        // keep the count across prescaler changes
+        uint16_t count = _timerCount();
+        registers[id] = value;
+        unsigned int prescaler = _timerPrescaler();
+        _sim.timerFrozenCount = count;
+        if (prescaler > 0)
+            _sim.timerZeroCycle = _sim.now - (uint64_t)count * prescaler;
+        break;
+    }
+
+    case SIM_REG_TCNT1:
+    {
+        unsigned int prescaler = _timerPrescaler();
+        _sim.timerFrozenCount = value;
+        _sim.isTimerTopPassed = value > registers[SIM_REG_OCR1A];
+        if (prescaler > 0)
+            _sim.timerZeroCycle = _sim.now - (uint64_t)value * prescaler;
+        break;
+    }
+
+    case SIM_REG_OCR1A:
+        // decided when TOP is written, a match caught up late (another interrupt ran) still counts
+        _sim.isTimerTopPassed = _timerCount() > value;
+        registers[id] = value;
+        break;
+
+    case SIM_REG_TIFR1:
+        // flags are cleared by writing a one
+        registers[id] &= ~value;
+        break;
+
+    case SIM_REG_EECR:
+        if (value & SIM_EECR_EERE)
+        {
+            registers[SIM_REG_EEDR] = _sim.eeprom[registers[SIM_REG_EEAR] % SIM_EEPROM_SIZE];
+            _sim.now += 4; // the CPU is halted for four cycles
+        }
+
+        if ((value & SIM_EECR_EEPE) && (registers[id] & SIM_EECR_EEMPE) && !(registers[id] & SIM_EECR_EEPE))
+        {
+            _sim.eepromWriteAddress = registers[SIM_REG_EEAR];
+            _sim.eepromWriteValue = (uint8_t)registers[SIM_REG_EEDR];
+            _sim.eepromDoneCycle = _sim.now + SIM_EEPROM_WRITE_CYCLES;
+            registers[id] = (registers[id] & ~SIM_EECR_EEMPE) | SIM_EECR_EEPE;
+        }
+        else
+        {
+            // EERE is a strobe and EEPE can only be set with EEMPE
+            uint16_t busy = registers[id] & SIM_EECR_EEPE;
+            registers[id] = (value & ~(SIM_EECR_EERE | SIM_EECR_EEPE)) | busy;
+        }
+        break;
+
+    case SIM_REG_ADCSRA:
+    {
+        bool wasConverting = registers[id] & SIM_ADCSRA_ADSC;
+        uint16_t flag = (registers[id] & SIM_ADCSRA_ADIF) && !(value & SIM_ADCSRA_ADIF) ? SIM_ADCSRA_ADIF : 0;
+        registers[id] = (value & ~SIM_ADCSRA_ADIF) | flag;
+
+        if (!(value & SIM_ADCSRA_ADEN))
+        {
+            registers[id] &= ~SIM_ADCSRA_ADSC;
+            _sim.adcDoneCycle = SIM_NEVER;
+        }
+        else if ((value & SIM_ADCSRA_ADSC) && !wasConverting)
+        {
+            _startAdcConversion(_sim.now);
+        }
+        else if (wasConverting)
+        {
+            registers[id] |= SIM_ADCSRA_ADSC;
+        }
+        break;
+    }
+
+    case SIM_REG_ADC:
+        break;
+
+    default:
+        registers[id] = value;
+        break;
+    }
+
+    _dispatchInterrupts();
+}
+
+void Simulator::pinMode(uint8_t pin, uint8_t mode)
+{
+    Simulator::advance(SIM_CALL_CYCLES);
+    if (pin < SIM_PIN_COUNT)
+        _sim.pinModes[pin] = mode;
+}
+
+void Simulator::digitalWrite(uint8_t pin, uint8_t value)
+{
+    Simulator::advance(SIM_CALL_CYCLES);
+    if (pin >= SIM_PIN_COUNT)
+        return;
+
+    uint8_t previous = _sim.pins[pin];
+    _sim.pins[pin] = value ? HIGH : LOW;
+    _decodeMotorPins(pin, previous);
+}
+
+int Simulator::digitalRead(uint8_t pin)
+{
+    Simulator::advance(SIM_CALL_CYCLES);
+    return pin < SIM_PIN_COUNT ? _sim.pins[pin] : LOW;
+}
+
+int Simulator::analogRead(uint8_t pin)
+{
+    // a single conversion with the Arduino default prescaler 128
+    Simulator::advance(SIM_CALL_CYCLES + SIM_ADC_CONVERSION_CLOCKS * 128);
+    return _sampleAnalog(pin < A0 ? pin + A0 : pin);
+}
+
+uint8_t Simulator::eepromRead(unsigned int address)
+{
+    Simulator::eepromWait();
+    Simulator::advance(SIM_CALL_CYCLES);
+    return _sim.eeprom[address % SIM_EEPROM_SIZE];
+}
+
+void Simulator::eepromWrite(unsigned int address, uint8_t value)
+{
+    Simulator::eepromWait();
+    _sim.eepromWriteAddress = address;
+    _sim.eepromWriteValue = value;
+    _sim.eepromDoneCycle = _sim.now + SIM_EEPROM_WRITE_CYCLES;
+    _sim.registers[SIM_REG_EECR] |= SIM_EECR_EEPE;
+    Simulator::advance(SIM_CALL_CYCLES);
+}
+
+void Simulator::eepromWait()
+{
+    while (_sim.registers[SIM_REG_EECR] & SIM_EECR_EEPE)
+        Simulator::advanceTo(_sim.eepromDoneCycle);
+}
+
+unsigned long Simulator::eepromWrites()
+{
+    return _sim.eepromWrites;
+}
+
+bool Simulator::loadEeprom(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+
+    size_t size = fread(_sim.eeprom, 1, SIM_EEPROM_SIZE, file);
+    fclose(file);
+
+    return size == SIM_EEPROM_SIZE;
+}
+
+bool Simulator::saveEeprom(const char *path)
+{
+    Simulator::eepromWait();
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        return false;
+
+    size_t size = fwrite(_sim.eeprom, 1, SIM_EEPROM_SIZE, file);
+    fclose(file);
+
+    return size == SIM_EEPROM_SIZE;
+}
+
+void Simulator::serialBegin(unsigned long baud)
+{
+    Simulator::advance(SIM_CALL_CYCLES);
+    _sim.baud = baud;
+}
+
+void Simulator::serialEnd()
+{
+    // HardwareSerial::end() waits for the transmitter and empties the receive buffer
+    Simulator::serialFlush();
+    _sim.rxBuffer.clear();
+}
+
+unsigned long Simulator::serialBaud()
+{
+    return _sim.baud;
+}
+
+int Simulator::serialAvailable()
+{
+    Simulator::advance(SIM_CALL_CYCLES);
+    return (int)_sim.rxBuffer.size();
+}
+
+int Simulator::serialRead()
+{
+    Simulator::advance(SIM_CALL_CYCLES);
+    if (_sim.rxBuffer.empty())
+        return -1;
+
+    uint8_t value = _sim.rxBuffer.front();
+    _sim.rxBuffer.pop_front();
+    _sim.rxReadCycle = _sim.now;
+
+    return value;
+}
+
+int Simulator::serialPeek()
+{
+    Simulator::advance(SIM_CALL_CYCLES);
+    return _sim.rxBuffer.empty() ? -1 : _sim.rxBuffer.front();
+}
+
+void Simulator::serialWrite(uint8_t value)
+{
+    Simulator::advance(SIM_CALL_CYCLES);
+
+    // HardwareSerial blocks while its transmit buffer is full
+    while (_sim.txBuffer.size() >= SERIAL_TX_BUFFER_SIZE - 1)
+        Simulator::advanceTo(_sim.txDoneCycle);
+
+    _sim.txBuffer.push_back(value);
+    _serialStartTransmit();
+}
+
+void Simulator::serialFlush()
+{
+    while (_sim.txDoneCycle != SIM_NEVER)
+        Simulator::advanceTo(_sim.txDoneCycle);
+}
+
+int Simulator::serialAvailableForWrite()
+{
+    Simulator::advance(SIM_CALL_CYCLES);
+    return SERIAL_TX_BUFFER_SIZE - 1 - (int)_sim.txBuffer.size();
+}
+
+uint64_t Simulator::serialByteCycles()
+{
+    // start bit, 8 data bits, stop bit
+    return (uint64_t)F_CPU * 10 / _sim.baud;
+}
+
+unsigned long Simulator::serialDropped()
+{
+    return _sim.rxDropped;
+}
+
+uint64_t Simulator::serialReadCycle()
+{
+    return _sim.rxReadCycle;
+}
+
+uint64_t Simulator::sendToDevice(const std::string &text)
+{
+    uint64_t cycle = _sim.wireIdleCycle > _sim.now ? _sim.wireIdleCycle : _sim.now;
+
+    for (char c : text)
+    {
+        cycle += Simulator::serialByteCycles();
+        _sim.rxWire.push_back({cycle, (uint8_t)c});
+        _sim.bytesToDevice++;
+    }
+
+    _sim.wireIdleCycle = cycle;
+
+    return cycle;
+}
+
+uint64_t Simulator::wireIdleCycle()
+{
+    return _sim.wireIdleCycle;
+}
+
+const std::vector<SimLine> &Simulator::deviceLines()
+{
+    return _sim.lines;
+}
+
+void Simulator::discardDeviceLine()
+{
+    _sim.lineText.clear();
+}
+
+std::string Simulator::takeDeviceOutput()
+{
+    std::string output;
+    output.swap(_sim.output);
+
+    return output;
+}
+
+unsigned long Simulator::bytesToDevice()
+{
+    return _sim.bytesToDevice;
+}
+
+unsigned long Simulator::bytesFromDevice()
+{
+    return _sim.bytesFromDevice;
+}
+
+void Simulator::setMicrosteps(unsigned int microsteps)
+{
+    _sim.microsteps = microsteps;
+}
+
+long Simulator::motorSteps()
+{
+    return _sim.motorSteps;
+}
+
+uint64_t Simulator::motorStepCycle()
+{
+    return _sim.motorStepCycle;
+}
+
+uint64_t Simulator::stepInterruptCycles()
+{
+    return _sim.stepInterruptCycles;
+}
+
+double Simulator::rotatorDegrees()
+{
+    return _sim.motorRevolutions * 360.0 * SIM_MOTOR_GEAR_TEETH / SIM_ROTATOR_GEAR_TEETH;
+}
+
+void Simulator::setHomeDegrees(double degrees)
+{
+    _sim.homeDegrees = degrees;
+}
+
+unsigned long Simulator::tmcTransactions()
+{
+    return _sim.tmcTransactions;
+}
+
+unsigned long Simulator::tmcWrites(uint8_t address)
+{
+    return _sim.tmcWrites[address % SIM_TMC_REGISTER_COUNT];
+}
+
+uint32_t Simulator::tmcRegister(uint8_t address)
+{
+    return _sim.tmcRegisters[address % SIM_TMC_REGISTER_COUNT];
+}
+
+void Simulator::writeTmcRegister(uint8_t address, uint32_t value)
+{
+    _sim.tmcWrites[address % SIM_TMC_REGISTER_COUNT]++;
+    _sim.tmcRegisters[address % SIM_TMC_REGISTER_COUNT] = value;
+    Simulator::countTmcTransaction();
+}
+
+void Simulator::countTmcTransaction()
+{
+    // one 8 byte datagram at the SoftwareSerial rate of TMCStepper (115200 baud)
+    _sim.tmcTransactions++;
+    Simulator::advance((uint64_t)F_CPU * 80 / 115200);
+}
@@ -0,0 +1,151 @@
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#pragma once
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#ifndef SERIAL_RX_BUFFER_SIZE
+#define SERIAL_RX_BUFFER_SIZE 64
+#endif
+#define SERIAL_TX_BUFFER_SIZE 64
+
+/**
+ * Cycle counted simulation of the ATmega328P peripherals the firmware uses.
+ * Time only moves when the firmware touches the hardware: every API call and
+ * register access costs SIM_CALL_CYCLES, delay() and blocking serial writes
+ * cost their real duration. Peripheral events (Timer1 compare match, ADC
+ * conversion, EEPROM write, serial bytes on the wire) are processed in time
+ * order and raise their interrupts like the hardware does.
+ */
+#define SIM_CALL_CYCLES 16
+#define SIM_ISR_CYCLES 40          // interrupt entry and exit
+#define SIM_EEPROM_SIZE 1024
+#define SIM_EEPROM_WRITE_CYCLES (F_CPU / 1000000UL * 3400) // 3.4ms per byte
+#define SIM_ADC_CONVERSION_CLOCKS 13
+
+/**
+ * Wiring of MotorDriver.h, the simulated motor follows the driver pins
+ */
+#define SIM_TMC220X_PIN_DIR 2
+#define SIM_TMC220X_PIN_STEP 3
+#define SIM_TMC220X_STEPS_PER_REVOLUTION 400
+#define SIM_ULN2003_PIN_IN1 8
+#define SIM_ULN2003_STEPS_PER_REVOLUTION 4096
+
+/**
+ * TMC2208 register addresses, the simulated driver counts the writes to each
+ */
+#define SIM_TMC_GCONF 0x00
+#define SIM_TMC_IHOLD_IRUN 0x10
+#define SIM_TMC_TPOWERDOWN 0x11
+#define SIM_TMC_CHOPCONF 0x6C
+#define SIM_TMC_REGISTER_COUNT 0x80
+
+/**
+ * Mechanics and sensors: gear between motor and rotator ring, Hall sensor
+ * dip around the home angle, input voltage behind a 3:1 divider
+ */
+#define SIM_ROTATOR_GEAR_TEETH 100
+#define SIM_MOTOR_GEAR_TEETH 20
+#define SIM_HOME_DEG 137.5
+#define SIM_HOME_SENSOR_IDLE 880
+#define SIM_HOME_SENSOR_DIP 560
+#define SIM_HOME_SENSOR_WIDTH_DEG 4.0
+#define SIM_HOME_SENSOR_NOISE 3
+#define SIM_SUPPLY_VOLTS 12.0
+#define SIM_VOLTAGE_FULL_SCALE 15.0
+
+enum SimRegisterId
+{
+    SIM_REG_TCCR1A,
+    SIM_REG_TCCR1B,
+    SIM_REG_TIMSK1,
+    SIM_REG_TIFR1,
+    SIM_REG_TCNT1,
+    SIM_REG_OCR1A,
+    SIM_REG_EECR,
+    SIM_REG_EEDR,
+    SIM_REG_EEAR,
+    SIM_REG_ADMUX,
+    SIM_REG_ADCSRA,
+    SIM_REG_ADCSRB,
+    SIM_REG_DIDR0,
+    SIM_REG_ADC,
+    SIM_REG_COUNT
+};
+
+class SimLine
+{
+public:
+    uint64_t cycle; // when the last byte (the '\n') left the wire
+    std::string text;
+};
+
+class Simulator
+{
+public:
+    static void reset();
+    static void powerCycle(bool isWriteTorn); // a byte write in progress is lost, or left erased when torn
+    static uint64_t cycles();
+    static double seconds();
+    static void advance(uint64_t cycles);
+    static void advanceTo(uint64_t cycle);
+    static void tick();
+
+    static bool interruptsEnabled();
+    static void setInterruptsEnabled(bool value);
+
+    static uint16_t readRegister(uint8_t id);
+    static void writeRegister(uint8_t id, uint16_t value);
+
+    static void pinMode(uint8_t pin, uint8_t mode);
+    static void digitalWrite(uint8_t pin, uint8_t value);
+    static int digitalRead(uint8_t pin);
+    static int analogRead(uint8_t pin);
+
+    static uint8_t eepromRead(unsigned int address);
+    static void eepromWrite(unsigned int address, uint8_t value);
+    static void eepromWait();
+    static unsigned long eepromWrites(); // bytes programmed, kept across power cycles
+    static bool loadEeprom(const char *path);
+    static bool saveEeprom(const char *path);
+
+    static void serialBegin(unsigned long baud);
+    static void serialEnd();
+    static unsigned long serialBaud();
+    static int serialAvailable();
+    static int serialRead();
+    static int serialPeek();
+    static void serialWrite(uint8_t value);
+    static void serialFlush();
+    static int serialAvailableForWrite();
+    static uint64_t serialByteCycles();
+    static unsigned long serialDropped();
+    static uint64_t serialReadCycle(); // when the firmware last took a byte from the receive buffer
+
+    // host side of the wire
+    static uint64_t sendToDevice(const std::string &text);
+    static uint64_t wireIdleCycle();
+    static const std::vector<SimLine> &deviceLines();
+    static void discardDeviceLine(); // bytes since the last '\n' are not text, e.g. binary frames
+    static std::string takeDeviceOutput();
+    static unsigned long bytesToDevice();
+    static unsigned long bytesFromDevice();
+
+    // mechanics
+    static void setMicrosteps(unsigned int microsteps);
+    static long motorSteps();
+    static uint64_t motorStepCycle(); // when the last step reached the motor
+    static uint64_t stepInterruptCycles(); // spent in the Timer1 compare interrupt, entry and exit included
+    static double rotatorDegrees();
+    static void setHomeDegrees(double degrees);
+    static unsigned long tmcTransactions();
+    static unsigned long tmcWrites(uint8_t address);
+    static uint32_t tmcRegister(uint8_t address); // last value written
+    static void countTmcTransaction();
+    static void writeTmcRegister(uint8_t address, uint32_t value);
+};
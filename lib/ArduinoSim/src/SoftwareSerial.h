@@ -0,0 +1,18 @@
+#include "Arduino.h"
+
+#pragma once
+
+/**
+ * Debug port of the firmware, nothing is connected in the simulation
+ */
+class SoftwareSerial : public Stream
+{
+public:
+    SoftwareSerial(uint8_t receivePin, uint8_t transmitPin) {}
+    void begin(long speed) {}
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    size_t write(uint8_t value) override { return 1; }
+    using Print::write;
+};
@@ -0,0 +1,48 @@
+#include <stdint.h>
+#include "Simulator.h"
+
+#pragma once
+
+/**
+ * Stand-in for the TMC2208 UART driver. Every register access counts as one
+ * UART transaction, writes are kept per register for the tests, the MRES
+ * field of CHOPCONF goes to the simulated motor.
+ */
+class TMC2208Stepper
+{
+private:
+    uint32_t _gconf = 0x101;
+    uint32_t _chopconf = 0x10000053;
+    uint32_t _iholdIrun = 0x00011F10;
+
+public:
+    TMC2208Stepper(uint16_t receivePin, uint16_t transmitPin, float senseResistor) {}
+    void begin() {}
+    uint8_t test_connection()
+    {
+        Simulator::countTmcTransaction();
+        return 0;
+    }
+    void GCONF(uint32_t value)
+    {
+        Simulator::writeTmcRegister(SIM_TMC_GCONF, value);
+        _gconf = value;
+    }
+    uint32_t GCONF() { return _gconf; }
+    void CHOPCONF(uint32_t value)
+    {
+        Simulator::writeTmcRegister(SIM_TMC_CHOPCONF, value);
+        _chopconf = value;
+
+        // MRES 0 is 256 microsteps, 8 full steps
+        Simulator::setMicrosteps(256 >> ((value >> 24) & 0x0F));
+    }
+    uint32_t CHOPCONF() { return _chopconf; }
+    void IHOLD_IRUN(uint32_t value)
+    {
+        Simulator::writeTmcRegister(SIM_TMC_IHOLD_IRUN, value);
+        _iholdIrun = value;
+    }
+    uint32_t IHOLD_IRUN() { return _iholdIrun; }
+    void TPOWERDOWN(uint8_t value) { Simulator::writeTmcRegister(SIM_TMC_TPOWERDOWN, value); }
+};
@@ -0,0 +1,8 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#pragma once
+
+void eeprom_read_block(void *destination, const void *source, size_t size);
+void eeprom_update_block(const void *source, void *destination, size_t size);
+uint8_t eeprom_read_byte(const uint8_t *address);
@@ -0,0 +1,22 @@
+#include "../Simulator.h"
+
+#pragma once
+
+/**
+ * ISR(vector) defines the handler the simulator calls for that vector
+ */
+#define ISR(vector) extern "C" void vector(void)
+
+extern "C" void TIMER1_COMPA_vect(void) __attribute__((weak));
+extern "C" void ADC_vect(void) __attribute__((weak));
+extern "C" void EE_READY_vect(void) __attribute__((weak));
+
+inline void cli()
+{
+    Simulator::setInterruptsEnabled(false);
+}
+
+inline void sei()
+{
+    Simulator::setInterruptsEnabled(true);
+}
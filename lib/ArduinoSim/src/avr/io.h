@@ -0,0 +1,89 @@
+#include <stdint.h>
+#include "../Simulator.h"
+
+#pragma once
+
+/**
+ * ATmega328P registers used by the firmware. Reads and writes go through
+ * Simulator, which keeps the peripheral state and the simulated time.
+ */
+template <typename T>
+class SimRegister
+{
+private:
+    uint8_t _id;
+
+public:
+    constexpr SimRegister(uint8_t id) : _id(id) {}
+
+    operator T() const
+    {
+        return (T)Simulator::readRegister(_id);
+    }
+
+    SimRegister &operator=(T value)
+    {
+        Simulator::writeRegister(_id, value);
+        return *this;
+    }
+
+    SimRegister &operator|=(T value)
+    {
+        Simulator::writeRegister(_id, (T)(Simulator::readRegister(_id) | value));
+        return *this;
+    }
+
+    SimRegister &operator&=(T value)
+    {
+        Simulator::writeRegister(_id, (T)(Simulator::readRegister(_id) & value));
+        return *this;
+    }
+};
+
+typedef SimRegister<uint8_t> SimRegister8;
+typedef SimRegister<uint16_t> SimRegister16;
+
+extern SimRegister8 TCCR1A;
+extern SimRegister8 TCCR1B;
+extern SimRegister8 TIMSK1;
+extern SimRegister8 TIFR1;
+extern SimRegister16 TCNT1;
+extern SimRegister16 OCR1A;
+extern SimRegister8 EECR;
+extern SimRegister8 EEDR;
+extern SimRegister16 EEAR;
+extern SimRegister8 ADMUX;
+extern SimRegister8 ADCSRA;
+extern SimRegister8 ADCSRB;
+extern SimRegister8 DIDR0;
+extern SimRegister16 ADC;
+
+#define _BV(bit) (1 << (bit))
+
+// TCCR1B
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define WGM13 4
+// TIMSK1, TIFR1
+#define OCIE1A 1
+#define OCF1A 1
+// EECR
+#define EERE 0
+#define EEPE 1
+#define EEMPE 2
+#define EERIE 3
+// ADMUX
+#define MUX0 0
+#define REFS0 6
+#define REFS1 7
+// ADCSRA
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE 3
+#define ADIF 4
+#define ADATE 5
+#define ADSC 6
+#define ADEN 7
@@ -0,0 +1,13 @@
+#include <stdint.h>
+#include <string.h>
+
+#pragma once
+
+/**
+ * Flash and RAM share one address space on the host
+ */
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(address))
+#define memcpy_P memcpy
@@ -0,0 +1,36 @@
+#include "../Simulator.h"
+
+#pragma once
+
+/**
+ * ATOMIC_BLOCK(ATOMIC_RESTORESTATE): interrupts are disabled for the block
+ * and restored (pending ones are raised) when it is left
+ */
+class SimAtomicGuard
+{
+private:
+    bool _wasEnabled;
+    bool _isDone = false;
+
+public:
+    SimAtomicGuard() : _wasEnabled(Simulator::interruptsEnabled())
+    {
+        Simulator::setInterruptsEnabled(false);
+        Simulator::tick();
+    }
+
+    ~SimAtomicGuard()
+    {
+        Simulator::setInterruptsEnabled(_wasEnabled);
+    }
+
+    bool once()
+    {
+        bool isFirst = !_isDone;
+        _isDone = true;
+        return isFirst;
+    }
+};
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_BLOCK(type) for (SimAtomicGuard _simAtomicGuard; _simAtomicGuard.once();)
@@ -0,0 +1,12 @@
+#include <stdint.h>
+
+#pragma once
+
+// same algorithm as avr-libc (CRC-CCITT, polynomial 0x1021, reflected)
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data)
+{
+    data ^= (uint8_t)(crc & 0xFF);
+    data ^= data << 4;
+
+    return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
@@ -0,0 +1,113 @@
+#include <avr/pgmspace.h>
+#include "BaudRate.h"
+
+// 250000 is exact at 16MHz, 115200 is 2.1% off and still within the UART tolerance
+static const uint32_t BAUD_RATES[] PROGMEM = {9600, 19200, 38400, 57600, 115200, 250000};
+
+bool BaudRate::isSupported(unsigned long baud)
+{
+    for (unsigned char i = 0; i < sizeof(BAUD_RATES) / sizeof(BAUD_RATES[0]); i++)
+    {
+        if (pgm_read_dword(&BAUD_RATES[i]) == baud)
+            return true;
+    }
+
+    return false;
+}
+
+void BaudRate::_begin(unsigned long baud)
+{
+    // end() waits for the last byte and drops whatever arrived at the old rate
+    Serial.flush();
+    Serial.end();
+    Serial.begin(baud, SERIAL_8N1);
+
+    _baud = baud;
+    _sinceMs = millis();
+}
+
+void BaudRate::init(CustomEEPROM &eeprom)
+{
+    _eeprom = &eeprom;
+
+    if (!BaudRate::isSupported(_eeprom->getSerialBaud()))
+        _eeprom->setSerialBaud(SERIAL_BAUD_DEFAULT);
+
+    Serial.begin(SERIAL_BAUD_DEFAULT, SERIAL_8N1);
+    _baud = SERIAL_BAUD_DEFAULT;
+    _sinceMs = millis();
+    _isRecovering = _eeprom->getSerialBaud() != SERIAL_BAUD_DEFAULT;
+}
+
+bool BaudRate::handle()
+{
+    // true when the rate changed, bytes received up to now are gone
+    if (_requestedBaud != 0)
+    {
+        // the BR reply still goes out at the old rate
+        if (Serial.availableForWrite() < SERIAL_TX_BUFFER_SIZE - 1)
+            return false;
+
+        _previousBaud = _baud;
+        this->_begin(_requestedBaud);
+        _requestedBaud = 0L;
+
+        return true;
+    }
+
+    if (_previousBaud != 0 && millis() - _sinceMs > BAUD_RATE_CONFIRM_MS)
+    {
+        // not confirmed, the host does not talk at this rate
+        this->_begin(_previousBaud);
+        _previousBaud = 0L;
+
+        return true;
+    }
+
+    if (_isRecovering && millis() - _sinceMs > BAUD_RATE_RECOVERY_MS)
+    {
+        _isRecovering = false;
+        this->_begin(_eeprom->getSerialBaud());
+
+        return true;
+    }
+
+    return false;
+}
+
+bool BaudRate::request(unsigned long baud)
+{
+    if (!BaudRate::isSupported(baud) || _requestedBaud != 0)
+        return false;
+
+    _requestedBaud = baud;
+    _isRecovering = false;
+
+    return true;
+}
+
+bool BaudRate::confirm()
+{
+    if (_previousBaud == 0 || _requestedBaud != 0)
+        return false;
+
+    _previousBaud = 0L;
+    _eeprom->setSerialBaud(_baud);
+
+    return true;
+}
+
+void BaudRate::keepRecoveryRate()
+{
+    _isRecovering = false;
+}
+
+bool BaudRate::isSwitchPending()
+{
+    return _requestedBaud != 0;
+}
+
+unsigned long BaudRate::getBaud()
+{
+    return _baud;
+}
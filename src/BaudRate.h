@@ -0,0 +1,44 @@
+#include <Arduino.h>
+#include "CustomEEPROM.h"
+
+#pragma once
+
+/**
+ * The serial rate is switched with a handshake, so a rate the host can not
+ * use never locks it out:
+ * - BR:n answers at the current rate, then the port runs at n
+ * - BC sent at the new rate confirms it and stores it in EEPROM, without
+ *   it the previous rate is back after BAUD_RATE_CONFIRM_MS
+ * Recovery: boot listens at SERIAL_BAUD_DEFAULT for BAUD_RATE_RECOVERY_MS
+ * before it switches to the stored rate. A command answered meanwhile keeps
+ * the default rate until the next reset.
+ */
+#define BAUD_RATE_CONFIRM_MS 3000UL
+#define BAUD_RATE_RECOVERY_MS 2000UL
+
+// set by HardwareSerial.h of the core, the switch waits until the transmit buffer is empty
+#ifndef SERIAL_TX_BUFFER_SIZE
+#define SERIAL_TX_BUFFER_SIZE 64
+#endif
+
+class BaudRate
+{
+private:
+    CustomEEPROM *_eeprom;
+    unsigned long _baud = SERIAL_BAUD_DEFAULT;
+    unsigned long _previousBaud = 0L;  // to revert to until BC, 0 when confirmed
+    unsigned long _requestedBaud = 0L; // switched to once the BR reply is sent
+    unsigned long _sinceMs = 0L;
+    bool _isRecovering = false;
+    void _begin(unsigned long baud);
+
+public:
+    static bool isSupported(unsigned long baud);
+    void init(CustomEEPROM &eeprom);
+    bool handle();
+    bool request(unsigned long baud);
+    bool confirm();
+    void keepRecoveryRate();
+    bool isSwitchPending();
+    unsigned long getBaud();
+};
@@ -0,0 +1,195 @@
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+#include "BinaryProtocol.h"
+
+// indexed by operation - 1
+static const BinaryOperationLayout BINARY_OPERATIONS[BINARY_OP_COUNT - 1] PROGMEM = {
+    {{0, 0}, 0},     // STATUS
+    {{'M', 'D'}, 4}, // MOVE
+    {{'M', 'S'}, 4}, // MOVE_STEPS
+    {{'S', 'D'}, 4}, // SYNC
+    {{'F', 'H'}, 0}, // HALT
+    {{0, 0}, 0},     // GET_STEP_MODE
+    {{'S', 'S'}, 2}, // SET_STEP_MODE
+    {{0, 0}, 0}};    // EXIT
+
+static_assert(STEP_CONVERTER_HUNDREDTHS_PER_REVOLUTION <= 0xFFFF, "STATUS sends the position in deg * 100 as u16");
+
+static unsigned short _crcUpdate(unsigned short crc, const unsigned char *bytes, unsigned char size)
+{
+    for (unsigned char i = 0; i < size; i++)
+        crc = _crc_ccitt_update(crc, bytes[i]);
+
+    return crc;
+}
+
+unsigned long BinaryProtocol::_readNumber(const unsigned char *bytes, unsigned char size)
+{
+    unsigned long value = 0;
+    for (unsigned char i = size; i > 0; i--)
+        value = (value << 8) | bytes[i - 1];
+
+    return value;
+}
+
+unsigned char *BinaryProtocol::_writeNumber(unsigned char *bytes, unsigned long value, unsigned char size)
+{
+    for (unsigned char i = 0; i < size; i++)
+    {
+        *bytes++ = (unsigned char)value;
+        value >>= 8;
+    }
+
+    return bytes;
+}
+
+void BinaryProtocol::_receive(unsigned char c)
+{
+    // bytes between frames are skipped until the next sync byte
+    if (_frameSize == 0 && c != BINARY_SYNC)
+        return;
+
+    if (_frameSize == 1 && (c < 2 || c > BINARY_MAX_PAYLOAD + 2))
+    {
+        // no frame is that long, the sync byte was part of something else
+        _frameSize = c == BINARY_SYNC ? 1 : 0;
+        return;
+    }
+
+    _frame[_frameSize++] = c;
+
+    // sync and length, length bytes, CRC
+    if (_frameSize < 2 || _frameSize < _frame[1] + 4)
+        return;
+
+    _frameSize = 0;
+
+    unsigned char length = _frame[1];
+    unsigned short crc = _frame[length + 2] | (_frame[length + 3] << 8);
+    if (crc != _crcUpdate(0xFFFF, _frame + 1, length + 1))
+        return;
+
+    _lastFrameMs = millis();
+    this->_process();
+}
+
+void BinaryProtocol::_process()
+{
+    // _frame holds the request until the reply is sent, a pending halt keeps it
+    unsigned char operation = _frame[3];
+    unsigned char size = _frame[1] - 2;
+    const unsigned char *payload = _frame + 4;
+    unsigned char data[BINARY_MAX_PAYLOAD];
+    unsigned char *out;
+    BinaryOperationLayout layout;
+
+    if (operation < BINARY_OP_STATUS || operation >= BINARY_OP_COUNT)
+    {
+        this->_reply(BINARY_STATUS_INVALID, NULL, 0);
+        return;
+    }
+
+    memcpy_P(&layout, &BINARY_OPERATIONS[operation - 1], sizeof(layout));
+    if (size != layout.requestSize)
+    {
+        this->_reply(BINARY_STATUS_INVALID, NULL, 0);
+        return;
+    }
+
+    switch (operation)
+    {
+    case BINARY_OP_STATUS:
+        out = _writeNumber(data, _stringProxy->stepsToHundredths(_eeprom->getPosition()), 2);
+        *out++ = (_motor->isMoving() ? BINARY_FLAG_MOVING : 0) |
+                 (_motor->isDerotating() ? BINARY_FLAG_DEROTATING : 0) |
+                 (_eeprom->getReverseDirection() ? BINARY_FLAG_REVERSE : 0) |
+                 (_eeprom->isHoming() ? BINARY_FLAG_HOMING : 0);
+
+        this->_reply(BINARY_STATUS_OK, data, out - data);
+        return;
+
+    case BINARY_OP_GET_STEP_MODE:
+        out = _writeNumber(data, _eeprom->getStepMode(), 2);
+
+        this->_reply(BINARY_STATUS_OK, data, out - data);
+        return;
+
+    case BINARY_OP_EXIT:
+        this->_reply(BINARY_STATUS_OK, NULL, 0);
+        _isActive = false;
+        return;
+
+    case BINARY_OP_HALT:
+        // same as FH in ASCII: decelerate now, reply once the motor stands still
+        if (_motor->halt())
+        {
+            _isHaltPending = true;
+            return;
+        }
+        break;
+    }
+
+    FalconArgument argument;
+    argument.value = _readNumber(payload, size);
+    argument.value2 = 0L;
+    argument.hundredths = argument.value;
+    argument.flag = false;
+
+    char const *output = _stringProxy->executeFalconCommand(layout.opcode, argument);
+    bool isOk = output[0] != 0 && strcmp(output, RESPONSE_KO) != 0;
+
+    this->_reply(isOk ? BINARY_STATUS_OK : BINARY_STATUS_REFUSED, NULL, 0);
+}
+
+void BinaryProtocol::_reply(unsigned char status, const unsigned char *data, unsigned char size)
+{
+    unsigned char header[5] = {BINARY_SYNC, (unsigned char)(size + 3), _frame[2], (unsigned char)(_frame[3] | BINARY_REPLY_FLAG), status};
+    unsigned short crc = _crcUpdate(_crcUpdate(0xFFFF, header + 1, sizeof(header) - 1), data, size);
+
+    Serial.write(header, sizeof(header));
+    if (size > 0)
+        Serial.write(data, size);
+    Serial.write((unsigned char)crc);
+    Serial.write((unsigned char)(crc >> 8));
+}
+
+void BinaryProtocol::init(StringProxy &stringProxy, Motor &motor, CustomEEPROM &eeprom)
+{
+    _stringProxy = &stringProxy;
+    _motor = &motor;
+    _eeprom = &eeprom;
+}
+
+void BinaryProtocol::begin()
+{
+    _isActive = true;
+    _frameSize = 0;
+    _lastFrameMs = millis();
+}
+
+bool BinaryProtocol::isActive()
+{
+    return _isActive;
+}
+
+void BinaryProtocol::handle()
+{
+    if (_isHaltPending)
+    {
+        if (_motor->isMoving())
+            return;
+
+        // the motor is halted, FH now only confirms it
+        _isHaltPending = false;
+        this->_process();
+    }
+
+    while (_isActive && !_isHaltPending && Serial.available())
+        this->_receive(Serial.read());
+
+    if (_isActive && !_isHaltPending && millis() - _lastFrameMs > BINARY_IDLE_TIMEOUT_MS)
+    {
+        _isActive = false;
+        _frameSize = 0;
+    }
+}
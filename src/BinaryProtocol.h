@@ -0,0 +1,97 @@
+#include <Arduino.h>
+#include "CustomEEPROM.h"
+#include "Motor.h"
+#include "StringProxy.h"
+
+#pragma once
+
+/**
+ * Binary mode, entered with the ASCII command BM (answered "BM:1"). Stock
+ * drivers never send it and keep the ASCII protocol. Every frame is
+ *
+ *   BINARY_SYNC, length, id, operation, payload, CRC16 (low byte first)
+ *
+ * length counts id, operation and payload, the CRC (CCITT, as in the EEPROM
+ * journal) covers length up to the end of the payload. Numbers are little
+ * endian. A reply echoes the id, sets BINARY_REPLY_FLAG on the operation and
+ * starts its payload with a BinaryStatus, the data follows only for
+ * BINARY_STATUS_OK. Frames with a bad CRC are dropped without reply.
+ *
+ * Operations and payloads (request -> reply):
+ *   STATUS         -          -> position deg * 100 u16, flags u8
+ *   MOVE           deg * 100 u32 -> -  (MD)
+ *   MOVE_STEPS     steps u32  -> -  (MS)
+ *   SYNC           deg * 100 u32 -> -  (SD)
+ *   HALT           -          -> -  (FH, sent once the motor stands still)
+ *   GET_STEP_MODE  -          -> step mode u16 (GS)
+ *   SET_STEP_MODE  step mode u16 -> -  (SS)
+ *   EXIT           -          -> -  then ASCII again
+ *
+ * A status poll is 6 bytes out and 10 back. Positions stay within one
+ * revolution, deg * 100 fits 16 bit, steps are left to FP in ASCII.
+ *
+ * Without a valid frame for BINARY_IDLE_TIMEOUT_MS the port falls back to
+ * ASCII, so a stock driver connecting later is understood. A binary host
+ * that paused that long enters again with "\nBM\n".
+ */
+#define BINARY_SYNC 0xA5
+#define BINARY_REPLY_FLAG 0x80
+#define BINARY_MAX_PAYLOAD 4
+#define BINARY_FRAME_SIZE (BINARY_MAX_PAYLOAD + 6)
+#define BINARY_IDLE_TIMEOUT_MS 10000UL
+
+#define BINARY_FLAG_MOVING 0x01
+#define BINARY_FLAG_DEROTATING 0x02
+#define BINARY_FLAG_REVERSE 0x04
+#define BINARY_FLAG_HOMING 0x08
+
+enum BinaryOperation
+{
+    BINARY_OP_STATUS = 1,
+    BINARY_OP_MOVE,
+    BINARY_OP_MOVE_STEPS,
+    BINARY_OP_SYNC,
+    BINARY_OP_HALT,
+    BINARY_OP_GET_STEP_MODE,
+    BINARY_OP_SET_STEP_MODE,
+    BINARY_OP_EXIT,
+    BINARY_OP_COUNT
+};
+
+enum BinaryStatus
+{
+    BINARY_STATUS_OK,
+    BINARY_STATUS_REFUSED, // the ASCII command would answer RESPONSE_KO
+    BINARY_STATUS_INVALID  // unknown operation or wrong payload size
+};
+
+class BinaryOperationLayout
+{
+public:
+    char opcode[2]; // Falcon command run by the operation, 0 if answered here
+    unsigned char requestSize;
+};
+
+class BinaryProtocol
+{
+private:
+    StringProxy *_stringProxy;
+    Motor *_motor;
+    CustomEEPROM *_eeprom;
+    bool _isActive = false;
+    unsigned char _frame[BINARY_FRAME_SIZE];
+    unsigned char _frameSize = 0;
+    bool _isHaltPending = false;
+    unsigned long _lastFrameMs = 0L;
+    static unsigned long _readNumber(const unsigned char *bytes, unsigned char size);
+    static unsigned char *_writeNumber(unsigned char *bytes, unsigned long value, unsigned char size);
+    void _receive(unsigned char c);
+    void _process();
+    void _reply(unsigned char status, const unsigned char *data, unsigned char size);
+
+public:
+    void init(StringProxy &stringProxy, Motor &motor, CustomEEPROM &eeprom);
+    void begin();
+    bool isActive();
+    void handle();
+};
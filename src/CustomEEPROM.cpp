@@ -1,175 +1,431 @@
 #include <Arduino.h>
 #include <EEPROM.h>
+#include <util/crc16.h>
 #include "CustomEEPROM.h"
+#include "Telemetry.h"
 
-unsigned long CustomEEPROM::_calculateChecksum(EEPROMState state)
+// avr-libc takes EEPROM addresses as pointers, on the host a pointer is wider than the address
+static void _eepromRead(uintptr_t address, void *data, size_t size)
 {
-    return state.position + state.maxPosition + state.maxMovement + (unsigned char)state.stepMode + (unsigned char)state.stepModeManual + (unsigned char)state.speedMode + state.settleBufferMs + state.idleEepromWriteMs + state.reverseDirection + state.motorIMoveMultiplier + state.motorIHoldMultiplier;
+    eeprom_read_block(data, (const void *)address, size);
 }
 
-void CustomEEPROM::_readEeprom()
+static void _eepromUpdate(uintptr_t address, const void *data, size_t size)
+{
+    eeprom_update_block(data, (void *)address, size);
+}
+
+unsigned short CustomEEPROM::_crcUpdate(unsigned short crc, const void *data, int size)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (int i = 0; i < size; i++)
+    {
+        crc = _crc_ccitt_update(crc, bytes[i]);
+    }
+
+    return crc;
+}
+
+static const EEPROMFieldLayout EEPROM_FIELD_LAYOUT[EEPROM_FIELD_COUNT] PROGMEM = {
+    {EEPROM_OFFSET_MAX_POSITION, offsetof(EEPROMState, maxPosition), sizeof(uint32_t)},
+    {EEPROM_OFFSET_MAX_MOVEMENT, offsetof(EEPROMState, maxMovement), sizeof(uint32_t)},
+    {EEPROM_OFFSET_STEP_MODE, offsetof(EEPROMState, stepMode), sizeof(unsigned short)},
+    {EEPROM_OFFSET_STEP_MODE_MANUAL, offsetof(EEPROMState, stepModeManual), sizeof(unsigned short)},
+    {EEPROM_OFFSET_SPEED_MODE, offsetof(EEPROMState, speedMode), sizeof(unsigned char)},
+    {EEPROM_OFFSET_SETTLE_BUFFER_MS, offsetof(EEPROMState, settleBufferMs), sizeof(uint32_t)},
+    {EEPROM_OFFSET_IDLE_EEPROM_WRITE_MS, offsetof(EEPROMState, idleEepromWriteMs), sizeof(uint32_t)},
+    {EEPROM_OFFSET_REVERSE_DIRECTION, offsetof(EEPROMState, reverseDirection), sizeof(bool)},
+    {EEPROM_OFFSET_MOTOR_I_MOVE_MULTIPLIER, offsetof(EEPROMState, motorIMoveMultiplier), sizeof(unsigned char)},
+    {EEPROM_OFFSET_MOTOR_I_HOLD_MULTIPLIER, offsetof(EEPROMState, motorIHoldMultiplier), sizeof(unsigned char)},
+    {EEPROM_OFFSET_ROTATOR_GEAR_TEETH, offsetof(EEPROMState, rotatorGearTeeth), sizeof(unsigned char)},
+    {EEPROM_OFFSET_MOTOR_GEAR_TEETH, offsetof(EEPROMState, motorGearTeeth), sizeof(unsigned char)},
+    {EEPROM_OFFSET_SERIAL_BAUD, offsetof(EEPROMState, serialBaud), sizeof(uint32_t)}};
+
+void CustomEEPROM::_getFieldLayout(unsigned char field, EEPROMFieldLayout &layout)
+{
+    memcpy_P(&layout, &EEPROM_FIELD_LAYOUT[field], sizeof(layout));
+}
+
+void CustomEEPROM::_markDirty(unsigned char field)
+{
+    _dirtyFields |= (1UL << field);
+}
+
+unsigned short CustomEEPROM::_calculateConfigurationCrc(unsigned char generation)
+{
+    // generation and fields are contiguous in layout order, so this equals the CRC over the stored bytes
+    EEPROMFieldLayout layout;
+    unsigned short crc = _crcUpdate(0xFFFF, &generation, sizeof(generation));
+    for (unsigned char field = 0; field < EEPROM_FIELD_COUNT; field++)
+    {
+        _getFieldLayout(field, layout);
+        crc = _crcUpdate(crc, ((unsigned char *)&_state) + layout.stateOffset, layout.size);
+    }
+
+    return crc;
+}
+
+bool CustomEEPROM::_isStoredCrcValid(unsigned int address, unsigned int size, unsigned short crc)
+{
+    unsigned short storedCrc = 0xFFFF;
+    for (unsigned int i = 0; i < size; i++)
+    {
+        unsigned char value;
+        _eepromRead(address + i, &value, 1);
+        storedCrc = _crcUpdate(storedCrc, &value, 1);
+    }
+
+    return storedCrc == crc;
+}
+
+bool CustomEEPROM::_readConfigurationCopy(unsigned int address, unsigned char &generation)
+{
+    unsigned char layoutVersion, configurationSize;
+    unsigned short configurationCrc;
+    _eepromRead(address + EEPROM_OFFSET_LAYOUT_VERSION, &layoutVersion, sizeof(layoutVersion));
+    _eepromRead(address + EEPROM_OFFSET_CONFIGURATION_SIZE, &configurationSize, sizeof(configurationSize));
+    _eepromRead(address + EEPROM_OFFSET_CONFIGURATION_CRC, &configurationCrc, sizeof(configurationCrc));
+    _eepromRead(address + EEPROM_OFFSET_GENERATION, &generation, sizeof(generation));
+
+    return layoutVersion >= 3 && layoutVersion <= EEPROM_LAYOUT_VERSION &&
+           EEPROM_OFFSET_FIELDS + configurationSize <= EEPROM_CONFIGURATION_COPY_SIZE &&
+           _isStoredCrcValid(address + EEPROM_OFFSET_GENERATION, EEPROM_OFFSET_FIELDS - EEPROM_OFFSET_GENERATION + configurationSize, configurationCrc);
+}
+
+void CustomEEPROM::_readFields(unsigned int address, unsigned char size)
 {
-    int address = 0;
-    eeprom_read_block((void *)&_state.maxPosition, (const void *)address, sizeof(_state.maxPosition));
-    address += sizeof(_state.maxPosition);
-    eeprom_read_block((void *)&_state.maxMovement, (const void *)address, sizeof(_state.maxMovement));
-    address += sizeof(_state.maxMovement);
-    eeprom_read_block((void *)&_state.stepMode, (const void *)address, sizeof(_state.stepMode));
-    address += sizeof(_state.stepMode);
-    eeprom_read_block((void *)&_state.stepModeManual, (const void *)address, sizeof(_state.stepModeManual));
-    address += sizeof(_state.stepModeManual);
-    eeprom_read_block((void *)&_state.speedMode, (const void *)address, sizeof(_state.speedMode));
-    address += sizeof(_state.speedMode);
-    eeprom_read_block((void *)&_state.settleBufferMs, (const void *)address, sizeof(_state.settleBufferMs));
-    address += sizeof(_state.settleBufferMs);
-    eeprom_read_block((void *)&_state.idleEepromWriteMs, (const void *)address, sizeof(_state.idleEepromWriteMs));
-    address += sizeof(_state.idleEepromWriteMs);
-    eeprom_read_block((void *)&_state.reverseDirection, (const void *)address, sizeof(_state.reverseDirection));
-    address += sizeof(_state.reverseDirection);
-    eeprom_read_block((void *)&_state.motorIMoveMultiplier, (const void *)address, sizeof(_state.motorIMoveMultiplier));
-    address += sizeof(_state.motorIMoveMultiplier);
-    eeprom_read_block((void *)&_state.motorIHoldMultiplier, (const void *)address, sizeof(_state.motorIHoldMultiplier));
-    address += sizeof(_state.motorIHoldMultiplier);
-
-    bool found = false;
-    for (int i = 0; i < _slidingAddressCount; i++)
-    {
-        /*Serial.print("EEPROM address ");
-        Serial.print(address);
-        Serial.print(" checksum: ");*/
-
-        eeprom_read_block((void *)&_state.position, (const void *)address, sizeof(_state.position));
-        address += sizeof(_state.position);
-        eeprom_read_block((void *)&_state.targetPosition, (const void *)address, sizeof(_state.targetPosition));
-        address += sizeof(_state.targetPosition);
-        eeprom_read_block((void *)&_state.checksum, (const void *)address, sizeof(_state.checksum));
-        address += sizeof(_state.checksum);
-
-        /*Serial.print(_state.checksum);
-        Serial.print(", calculated: ");
-        Serial.println(_calculateChecksum(_state));*/
-
-        if (_state.checksum == _calculateChecksum(_state))
+    // fields missing from an older stored layout get their defaults, all stored fields are kept
+    _state = _stateDefaults;
+
+    EEPROMFieldLayout layout;
+    for (unsigned char field = 0; field < EEPROM_FIELD_COUNT; field++)
+    {
+        _getFieldLayout(field, layout);
+        unsigned char offset = layout.address - EEPROM_OFFSET_FIELDS;
+        if (offset + layout.size <= size)
         {
-            _slidingCurrentAddress = address - _slidingSize;
-            found = true;
-            break;
+            _eepromRead(address + offset, ((unsigned char *)&_state) + layout.stateOffset, layout.size);
+        }
+        else
+        {
+            _markDirty(field);
         }
     }
+}
 
-    if (!found)
+bool CustomEEPROM::_readV0Position()
+{
+    // the checksum adds the stored bytes of the narrow fields, not their values
+    unsigned char stepMode, stepModeManual, speedMode, reverseDirection;
+    _eepromRead(EEPROM_OFFSET_STEP_MODE - EEPROM_OFFSET_FIELDS, &stepMode, 1);
+    _eepromRead(EEPROM_OFFSET_STEP_MODE_MANUAL - EEPROM_OFFSET_FIELDS, &stepModeManual, 1);
+    _eepromRead(EEPROM_OFFSET_SPEED_MODE - EEPROM_OFFSET_FIELDS, &speedMode, 1);
+    _eepromRead(EEPROM_OFFSET_REVERSE_DIRECTION - EEPROM_OFFSET_FIELDS, &reverseDirection, 1);
+    uint32_t configurationSum = _state.maxPosition + _state.maxMovement + stepMode + stepModeManual + speedMode + _state.settleBufferMs +
+                                _state.idleEepromWriteMs + reverseDirection + _state.motorIMoveMultiplier + _state.motorIHoldMultiplier;
+
+    for (unsigned int address = EEPROM_V0_CONFIGURATION_SIZE; address + EEPROM_V0_SLOT_SIZE <= EEPROM_SIZE; address += EEPROM_V0_SLOT_SIZE)
+    {
+        uint32_t slot[3]; // position, target position, checksum
+        _eepromRead(address, slot, sizeof(slot));
+
+        if (slot[2] == (uint32_t)(configurationSum + slot[0]))
+        {
+            _state.position = slot[0];
+            _state.targetPosition = slot[1];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool CustomEEPROM::_readRecord(unsigned int journalAddress, int slot, EEPROMRecord &record)
+{
+    _eepromRead(journalAddress + slot * sizeof(EEPROMRecord), &record, sizeof(EEPROMRecord));
+
+    return record.crc == _crcUpdate(0xFFFF, &record, offsetof(EEPROMRecord, crc));
+}
+
+int CustomEEPROM::_findNewestRecord(unsigned int journalAddress, int slotCount)
+{
+    EEPROMRecord first, record;
+
+    if (_readRecord(journalAddress, 0, first))
+    {
+        // slots 0..newest hold consecutive sequence numbers, binary search for the end of that run
+        int low = 0;
+        int high = slotCount - 1;
+        while (low < high)
+        {
+            int mid = (low + high + 1) / 2;
+            uint32_t sequence;
+            _eepromRead(journalAddress + mid * sizeof(EEPROMRecord), &sequence, sizeof(sequence));
+
+            if (sequence == first.sequence + mid)
+                low = mid;
+            else
+                high = mid - 1;
+        }
+
+        // a torn write leaves the newest slot with a bad CRC, fall back to its predecessor
+        for (int slot = low; slot >= 0; slot--)
+        {
+            if (_readRecord(journalAddress, slot, record))
+                return slot;
+        }
+    }
+
+    // slot 0 itself is torn or corrupted: scan the whole ring
+    int newest = -1;
+    unsigned long newestSequence = 0;
+    for (int slot = 0; slot < slotCount; slot++)
+    {
+        if (_readRecord(journalAddress, slot, record) && (newest < 0 || record.sequence > newestSequence))
+        {
+            newest = slot;
+            newestSequence = record.sequence;
+        }
+    }
+
+    return newest;
+}
+
+void CustomEEPROM::_formatJournal()
+{
+    TelemetryScope telemetry(TELEMETRY_TIMER_EEPROM);
+
+    // formatting is rare (lost journal), write synchronously once the queue is idle
+    _writer.flush();
+
+    // sequence 0 never continues a run that starts with sequence 1 in slot 0
+    uint32_t sequence = 0;
+    for (int slot = 0; slot < _journalSlotCount; slot++)
+    {
+        _eepromUpdate(EEPROM_JOURNAL_ADDRESS + slot * sizeof(EEPROMRecord), &sequence, sizeof(sequence));
+    }
+
+    _journalCurrentSlot = _journalSlotCount - 1;
+    _state.sequence = 0;
+    _isJournalValid = false;
+}
+
+void CustomEEPROM::_migrateEeprom()
+{
+    unsigned char layoutVersion, configurationSize;
+    unsigned short configurationCrc;
+    _eepromRead(EEPROM_OFFSET_LAYOUT_VERSION, &layoutVersion, sizeof(layoutVersion));
+    _eepromRead(EEPROM_OFFSET_CONFIGURATION_SIZE, &configurationSize, sizeof(configurationSize));
+    _eepromRead(EEPROM_OFFSET_CONFIGURATION_CRC, &configurationCrc, sizeof(configurationCrc));
+
+    bool isMigrated = layoutVersion >= 1 && layoutVersion <= 2 &&
+                      EEPROM_V2_ADDRESS_FIELDS + configurationSize <= EEPROM_V2_JOURNAL_ADDRESS &&
+                      _isStoredCrcValid(EEPROM_V2_ADDRESS_FIELDS, configurationSize, configurationCrc);
+    if (isMigrated)
+    {
+        _readFields(EEPROM_V2_ADDRESS_FIELDS, configurationSize);
+
+        // records of layout version 1 have no flags, a different size and cannot be read
+        EEPROMRecord record;
+        int slot = layoutVersion < 2 ? -1 : _findNewestRecord(EEPROM_V2_JOURNAL_ADDRESS, (EEPROM_SIZE - EEPROM_V2_JOURNAL_ADDRESS) / sizeof(EEPROMRecord));
+        if (slot >= 0 && _readRecord(EEPROM_V2_JOURNAL_ADDRESS, slot, record))
+        {
+            _state.position = record.position;
+            _state.targetPosition = record.targetPosition;
+        }
+    }
+    else
+    {
+        // no header: the original firmware, valid once a slot matches. Its slots lie
+        // where copy B and the journal go, a migration cut short resets to the defaults
+        _readFields(0, EEPROM_V0_CONFIGURATION_SIZE);
+        isMigrated = _readV0Position();
+    }
+
+    // the first save goes to copy B, the old layout from address 0 stays readable until it is complete
+    _configurationAddress = EEPROM_CONFIGURATION_ADDRESS_A;
+    _configurationGeneration = 0;
+    _staleFields = EEPROM_DIRTY_CONFIGURATION;
+
+    _formatJournal();
+
+    if (!isMigrated)
     {
         // Serial.println("RESET");
         _resetEeprom();
+        return;
     }
+
+    // the position stays untrusted, a migration cut short may have left an older record as the newest
+    _dirtyFields = EEPROM_DIRTY_CONFIGURATION | EEPROM_DIRTY_POSITION;
+    _writeEeprom();
 }
 
-void CustomEEPROM::_writeEeprom(bool isReset)
+void CustomEEPROM::_readEeprom()
 {
+    unsigned char generationA, generationB;
+    bool isValidA = _readConfigurationCopy(EEPROM_CONFIGURATION_ADDRESS_A, generationA);
+    bool isValidB = _readConfigurationCopy(EEPROM_CONFIGURATION_ADDRESS_B, generationB);
+    if (!isValidA && !isValidB)
+    {
+        _migrateEeprom();
+        return;
+    }
+
+    // the other copy is older or torn
+    bool isNewerA = isValidA && (!isValidB || (signed char)(generationA - generationB) > 0);
+    _configurationAddress = isNewerA ? EEPROM_CONFIGURATION_ADDRESS_A : EEPROM_CONFIGURATION_ADDRESS_B;
+    _configurationGeneration = isNewerA ? generationA : generationB;
+
+    unsigned char layoutVersion, configurationSize;
+    _eepromRead(_configurationAddress + EEPROM_OFFSET_LAYOUT_VERSION, &layoutVersion, sizeof(layoutVersion));
+    _eepromRead(_configurationAddress + EEPROM_OFFSET_CONFIGURATION_SIZE, &configurationSize, sizeof(configurationSize));
+
+    _dirtyFields = layoutVersion < EEPROM_LAYOUT_VERSION ? EEPROM_DIRTY_CONFIGURATION : 0; // rewrites the header with the current version
+    _readFields(_configurationAddress + EEPROM_OFFSET_FIELDS, configurationSize);
+
+    // what the older copy misses is not known, all fields are queued and equal bytes skipped
+    _staleFields = EEPROM_DIRTY_CONFIGURATION;
+
+    int slot = _findNewestRecord(EEPROM_JOURNAL_ADDRESS, _journalSlotCount);
+    if (slot < 0)
+    {
+        // configuration is intact, only the position is lost
+        _formatJournal();
+        _state.position = 0;
+        _state.targetPosition = 0;
+        _dirtyFields |= EEPROM_DIRTY_POSITION;
+        _writeEeprom();
+        return;
+    }
+
+    EEPROMRecord record;
+    _readRecord(EEPROM_JOURNAL_ADDRESS, slot, record);
+
+    _journalCurrentSlot = slot;
+    _journalPosition = record.position;
+    _journalTargetPosition = record.targetPosition;
+    _journalFlags = record.flags;
+    _isJournalValid = true;
+    _isPositionTrusted = (record.flags & EEPROM_RECORD_AT_REST) != 0;
+    _wasPositionTrusted = _isPositionTrusted;
+
+    _state.sequence = record.sequence;
+    _state.position = record.position;
+    _state.targetPosition = record.targetPosition;
+}
+
+bool CustomEEPROM::_writeEeprom()
+{
+    TelemetryScope telemetry(TELEMETRY_TIMER_EEPROM);
+
+    EEPROMRecord record;
+    EEPROMFieldLayout layout;
+    unsigned char flags = _isPositionTrusted ? EEPROM_RECORD_AT_REST : 0;
+    bool appendRecord = !_isJournalValid || _state.position != _journalPosition || _state.targetPosition != _journalTargetPosition || flags != _journalFlags;
+    unsigned int size = appendRecord ? sizeof(EEPROMRecord) : 0;
+
+    // the older copy gets the changed fields and those it missed since it was written
+    uint32_t fields = _dirtyFields & EEPROM_DIRTY_CONFIGURATION ? (_dirtyFields | _staleFields) & EEPROM_DIRTY_CONFIGURATION : 0;
+    if (fields != 0)
+    {
+        size += EEPROM_OFFSET_FIELDS;
+        for (unsigned char field = 0; field < EEPROM_FIELD_COUNT; field++)
+        {
+            if (fields & (1UL << field))
+            {
+                _getFieldLayout(field, layout);
+                size += layout.size;
+            }
+        }
+    }
+
+    // writes with a trusted position leave room for one record, so the record of a move or homing
+    // start is queued at once. When the record and the configuration do not fit, the record goes
+    // first and the configuration stays dirty for the next check
+    unsigned int reserve = _isPositionTrusted ? sizeof(EEPROMRecord) : 0;
+    if (fields != 0 && appendRecord && _writer.available() < size + reserve)
+    {
+        fields = 0;
+        size = sizeof(EEPROMRecord);
+    }
+
+    // nothing is blocking here: bytes are queued and programmed by the EEPROM ready interrupt
+    if (_writer.available() < size + reserve)
+    {
+        Telemetry::count(TELEMETRY_COUNTER_EEPROM_DEFERRED);
+        return false;
+    }
+
     _lastEepromCheckMs = millis();
-    _isConfigDirty = false;
     _lastPositionChangeMs = 0L;
-    _state.checksum = _calculateChecksum(_state);
-
-    // write new state
-
-    int address = 0;
-
-    // write configuration
-    eeprom_update_block((void *)&_state.maxPosition, (void *)address, sizeof(_state.maxPosition));
-    address += sizeof(_state.maxPosition);
-    delay(1);
-    eeprom_update_block((void *)&_state.maxMovement, (void *)address, sizeof(_state.maxMovement));
-    address += sizeof(_state.maxMovement);
-    delay(1);
-    eeprom_update_block((void *)&_state.stepMode, (void *)address, sizeof(_state.stepMode));
-    address += sizeof(_state.stepMode);
-    delay(1);
-    eeprom_update_block((void *)&_state.stepModeManual, (void *)address, sizeof(_state.stepModeManual));
-    address += sizeof(_state.stepModeManual);
-    delay(1);
-    eeprom_update_block((void *)&_state.speedMode, (void *)address, sizeof(_state.speedMode));
-    address += sizeof(_state.speedMode);
-    delay(1);
-    eeprom_update_block((void *)&_state.settleBufferMs, (void *)address, sizeof(_state.settleBufferMs));
-    address += sizeof(_state.settleBufferMs);
-    delay(1);
-    eeprom_update_block((void *)&_state.idleEepromWriteMs, (void *)address, sizeof(_state.idleEepromWriteMs));
-    address += sizeof(_state.idleEepromWriteMs);
-    delay(1);
-    eeprom_update_block((void *)&_state.reverseDirection, (void *)address, sizeof(_state.reverseDirection));
-    address += sizeof(_state.reverseDirection);
-    delay(1);
-    eeprom_update_block((void *)&_state.motorIMoveMultiplier, (void *)address, sizeof(_state.motorIMoveMultiplier));
-    address += sizeof(_state.motorIMoveMultiplier);
-    delay(1);
-    eeprom_update_block((void *)&_state.motorIHoldMultiplier, (void *)address, sizeof(_state.motorIHoldMultiplier));
-    address += sizeof(_state.motorIHoldMultiplier);
-    delay(1);
-
-    delay(10);
-
-    if (isReset)
-    {
-        _slidingCurrentAddress = _configurationSize;
-    }
-    else
+
+    if (fields != 0)
     {
-        unsigned long storedPosition, storedTargetPosition, storedChecksum;
-        address = _slidingCurrentAddress;
-        eeprom_read_block((void *)&storedPosition, (const void *)address, sizeof(storedPosition));
-        address += sizeof(storedPosition);
-        delay(1);
-        eeprom_read_block((void *)&storedTargetPosition, (const void *)address, sizeof(storedTargetPosition));
-        address += sizeof(storedTargetPosition);
-        delay(1);
-        eeprom_read_block((void *)&storedChecksum, (const void *)address, sizeof(storedChecksum));
-        address += sizeof(storedChecksum);
-        delay(1);
-
-        delay(10);
-
-        if (storedPosition != _state.position || storedTargetPosition != _state.targetPosition || storedChecksum != _state.checksum)
+        // fields, then the header with the CRC last: until that lands the newer copy stays the valid one
+        unsigned int address = _configurationAddress == EEPROM_CONFIGURATION_ADDRESS_A ? EEPROM_CONFIGURATION_ADDRESS_B : EEPROM_CONFIGURATION_ADDRESS_A;
+        for (unsigned char field = 0; field < EEPROM_FIELD_COUNT; field++)
         {
-            // invalidate previous sliding state checksum
-            address = _slidingCurrentAddress + _slidingSize - sizeof(_state.checksum);
-            unsigned long invalidChecksum = 99999999;
-            eeprom_update_block((void *)&invalidChecksum, (void *)address, sizeof(invalidChecksum));
-            address += sizeof(invalidChecksum);
-            delay(1);
-
-            // slide address for position, target position, checksum
-            _slidingCurrentAddress += _slidingSize;
-            if (_slidingCurrentAddress + _slidingSize > EEPROM_SIZE)
+            if (fields & (1UL << field))
             {
-                _slidingCurrentAddress = _configurationSize;
+                _getFieldLayout(field, layout);
+                _writer.write(address + layout.address, ((unsigned char *)&_state) + layout.stateOffset, layout.size);
             }
         }
+
+        unsigned char layoutVersion = EEPROM_LAYOUT_VERSION;
+        unsigned char configurationSize = EEPROM_OFFSET_FIELDS_END - EEPROM_OFFSET_FIELDS;
+        unsigned char generation = _configurationGeneration + 1;
+        unsigned short configurationCrc = _calculateConfigurationCrc(generation);
+        _writer.write(address + EEPROM_OFFSET_LAYOUT_VERSION, &layoutVersion, sizeof(layoutVersion));
+        _writer.write(address + EEPROM_OFFSET_CONFIGURATION_SIZE, &configurationSize, sizeof(configurationSize));
+        _writer.write(address + EEPROM_OFFSET_GENERATION, &generation, sizeof(generation));
+        _writer.write(address + EEPROM_OFFSET_CONFIGURATION_CRC, &configurationCrc, sizeof(configurationCrc));
+
+        // the copy written before misses what changed since
+        _staleFields = _dirtyFields & EEPROM_DIRTY_CONFIGURATION;
+        _configurationAddress = address;
+        _configurationGeneration = generation;
     }
 
-    address = _slidingCurrentAddress;
+    _dirtyFields = fields != 0 ? 0 : _dirtyFields & EEPROM_DIRTY_CONFIGURATION;
+
+    if (!appendRecord)
+    {
+        return true;
+    }
 
-    delay(10);
+    // append a record to the next slot, the previous one stays valid until this one is complete
+    record.sequence = _state.sequence + 1;
+    record.position = _state.position;
+    record.targetPosition = _state.targetPosition;
+    record.flags = flags;
+    record.crc = _crcUpdate(0xFFFF, &record, offsetof(EEPROMRecord, crc));
 
-    eeprom_update_block((void *)&_state.position, (void *)address, sizeof(_state.position));
-    address += sizeof(_state.position);
-    delay(1);
-    eeprom_update_block((void *)&_state.targetPosition, (void *)address, sizeof(_state.targetPosition));
-    address += sizeof(_state.targetPosition);
-    delay(1);
-    eeprom_update_block((void *)&_state.checksum, (void *)address, sizeof(_state.checksum));
-    address += sizeof(_state.checksum);
-    delay(1);
+    _journalCurrentSlot = (_journalCurrentSlot + 1) % _journalSlotCount;
+    _writer.write(EEPROM_JOURNAL_ADDRESS + _journalCurrentSlot * sizeof(EEPROMRecord), &record, sizeof(EEPROMRecord));
+
+    _state.sequence = record.sequence;
+    _journalPosition = record.position;
+    _journalTargetPosition = record.targetPosition;
+    _journalFlags = record.flags;
+    _isJournalValid = true;
+
+    return true;
 }
 
 void CustomEEPROM::_resetEeprom()
 {
+    uint32_t sequence = _state.sequence;
     _state = _stateDefaults;
-    _writeEeprom(true);
+    _state.sequence = sequence;
+    _dirtyFields = EEPROM_DIRTY_CONFIGURATION | EEPROM_DIRTY_POSITION;
+    _writeEeprom();
 }
 
 void CustomEEPROM::init()
 {
+    _writer.init();
     _readEeprom();
     _isHoming = false;
     _lastEepromCheckMs = millis();
@@ -179,9 +435,9 @@ void CustomEEPROM::handleEeprom()
 {
     if ((_lastEepromCheckMs + EEPROM_CHECK_PERIOD_MS) < millis())
     {
-        if (_isConfigDirty)
+        if (_dirtyFields != 0)
         {
-            _writeEeprom(false);
+            _writeEeprom();
         }
         _lastEepromCheckMs = millis();
     }
@@ -189,11 +445,23 @@ void CustomEEPROM::handleEeprom()
     {
         if ((_lastPositionChangeMs + _state.idleEepromWriteMs) < millis())
         {
-            _writeEeprom(false);
+            _writeEeprom();
         }
     }
 }
 
+bool CustomEEPROM::isWriting()
+{
+    return _writer.isBusy();
+}
+
+void CustomEEPROM::flush()
+{
+    TelemetryScope telemetry(TELEMETRY_TIMER_EEPROM);
+
+    _writer.flush();
+}
+
 void CustomEEPROM::resetToDefaults()
 {
     _resetEeprom();
@@ -203,10 +471,10 @@ void CustomEEPROM::debug()
 {
     Serial.print("EEPROM size: ");
     Serial.println(EEPROM_SIZE);
-    Serial.print("current sliding address: ");
-    Serial.println(_slidingCurrentAddress);
-    Serial.print("sliding slots count: ");
-    Serial.println(_slidingAddressCount);
+    Serial.print("current journal slot: ");
+    Serial.println(_journalCurrentSlot);
+    Serial.print("journal slots count: ");
+    Serial.println(_journalSlotCount);
     Serial.print("maxPosition: ");
     Serial.println(_state.maxPosition);
     Serial.print("maxMovement: ");
@@ -227,12 +495,20 @@ void CustomEEPROM::debug()
     Serial.println(_state.motorIMoveMultiplier);
     Serial.print("motorIHoldMultiplier: ");
     Serial.println(_state.motorIHoldMultiplier);
+    Serial.print("rotatorGearTeeth: ");
+    Serial.println(_state.rotatorGearTeeth);
+    Serial.print("motorGearTeeth: ");
+    Serial.println(_state.motorGearTeeth);
+    Serial.print("serialBaud: ");
+    Serial.println(_state.serialBaud);
     Serial.print("position: ");
     Serial.println(_state.position);
     Serial.print("targetPosition: ");
     Serial.println(_state.targetPosition);
-    Serial.print("checksum: ");
-    Serial.println(_state.checksum);
+    Serial.print("sequence: ");
+    Serial.println(_state.sequence);
+    Serial.print("positionTrusted: ");
+    Serial.println(_isPositionTrusted);
 }
 
 bool CustomEEPROM::isHoming()
@@ -242,9 +518,42 @@ bool CustomEEPROM::isHoming()
 
 void CustomEEPROM::setHoming(bool value)
 {
+    // positions during homing are relative to wherever the search started
+    if (value)
+    {
+        this->setPositionTrusted(false);
+        _isHomingAborted = false;
+    }
+
     _isHoming = value;
 }
 
+void CustomEEPROM::abortHoming()
+{
+    // home was not found, moves no longer lock but nothing is trusted until homing runs again
+    _isHoming = false;
+    _isHomingAborted = true;
+}
+
+bool CustomEEPROM::wasPositionTrusted()
+{
+    return _wasPositionTrusted;
+}
+
+void CustomEEPROM::setPositionTrusted(bool value)
+{
+    if (_isPositionTrusted == value || (value && _isHomingAborted))
+        return;
+
+    _isPositionTrusted = value;
+    _dirtyFields |= EEPROM_DIRTY_POSITION;
+
+    // a power loss while moving must not leave an at rest record behind, record the start at once
+    // (the room for it is reserved, see _writeEeprom)
+    if (!value)
+        _writeEeprom();
+}
+
 unsigned long CustomEEPROM::getPosition()
 {
     return _state.position;
@@ -282,7 +591,7 @@ void CustomEEPROM::syncPosition(unsigned long value)
         }
     }
 
-    _isConfigDirty = true;
+    _dirtyFields |= EEPROM_DIRTY_POSITION;
     _state.targetPosition = value;
     _state.position = value;
 }
@@ -329,7 +638,9 @@ void CustomEEPROM::setMaxPosition(unsigned long value)
     if (_state.position > value)
         _state.position = value;
 
-    _isConfigDirty = true;
+    if (_state.maxPosition != value)
+        _markDirty(EEPROM_FIELD_MAX_POSITION);
+
     _state.maxPosition = value;
 }
 
@@ -343,7 +654,9 @@ void CustomEEPROM::setMaxMovement(unsigned long value)
     if (value < 1)
         value = 1;
 
-    _isConfigDirty = true;
+    if (_state.maxMovement != value)
+        _markDirty(EEPROM_FIELD_MAX_MOVEMENT);
+
     _state.maxMovement = value;
 }
 
@@ -359,7 +672,9 @@ bool CustomEEPROM::setStepMode(unsigned short value)
         return false;
     }
 
-    _isConfigDirty = true;
+    if (_state.stepMode != value)
+        _markDirty(EEPROM_FIELD_STEP_MODE);
+
     _state.stepMode = value;
     return true;
 }
@@ -376,7 +691,9 @@ bool CustomEEPROM::setStepModeManual(unsigned short value)
         return false;
     }
 
-    _isConfigDirty = true;
+    if (_state.stepModeManual != value)
+        _markDirty(EEPROM_FIELD_STEP_MODE_MANUAL);
+
     _state.stepModeManual = value;
     return true;
 }
@@ -393,7 +710,9 @@ bool CustomEEPROM::setSpeedMode(unsigned char value)
         return false;
     }
 
-    _isConfigDirty = true;
+    if (_state.speedMode != value)
+        _markDirty(EEPROM_FIELD_SPEED_MODE);
+
     _state.speedMode = value;
     return true;
 }
@@ -405,7 +724,9 @@ unsigned long CustomEEPROM::getSettleBufferMs()
 
 void CustomEEPROM::setSettleBufferMs(unsigned long value)
 {
-    _isConfigDirty = true;
+    if (_state.settleBufferMs != value)
+        _markDirty(EEPROM_FIELD_SETTLE_BUFFER_MS);
+
     _state.settleBufferMs = value;
 }
 
@@ -416,7 +737,9 @@ bool CustomEEPROM::getReverseDirection()
 
 void CustomEEPROM::setReverseDirection(bool value)
 {
-    _isConfigDirty = true;
+    if (_state.reverseDirection != value)
+        _markDirty(EEPROM_FIELD_REVERSE_DIRECTION);
+
     _state.reverseDirection = value;
 }
 
@@ -427,7 +750,9 @@ unsigned long CustomEEPROM::getIdleEepromWriteMs()
 
 void CustomEEPROM::setIdleEepromWriteMs(unsigned long value)
 {
-    _isConfigDirty = true;
+    if (_state.idleEepromWriteMs != value)
+        _markDirty(EEPROM_FIELD_IDLE_EEPROM_WRITE_MS);
+
     _state.idleEepromWriteMs = value;
 }
 
@@ -447,7 +772,9 @@ void CustomEEPROM::setMotorIMoveMultiplier(unsigned char value)
         value = 100;
     }
 
-    _isConfigDirty = true;
+    if (_state.motorIMoveMultiplier != value)
+        _markDirty(EEPROM_FIELD_MOTOR_I_MOVE_MULTIPLIER);
+
     _state.motorIMoveMultiplier = value;
 }
 
@@ -467,6 +794,49 @@ void CustomEEPROM::setMotorIHoldMultiplier(unsigned char value)
         value = 100;
     }
 
-    _isConfigDirty = true;
+    if (_state.motorIHoldMultiplier != value)
+        _markDirty(EEPROM_FIELD_MOTOR_I_HOLD_MULTIPLIER);
+
     _state.motorIHoldMultiplier = value;
 }
+
+unsigned char CustomEEPROM::getRotatorGearTeeth()
+{
+    return _state.rotatorGearTeeth;
+}
+
+unsigned char CustomEEPROM::getMotorGearTeeth()
+{
+    return _state.motorGearTeeth;
+}
+
+bool CustomEEPROM::setGearTeeth(unsigned char rotatorGearTeeth, unsigned char motorGearTeeth)
+{
+    if (rotatorGearTeeth < 1 || motorGearTeeth < 1)
+    {
+        return false;
+    }
+
+    if (_state.rotatorGearTeeth != rotatorGearTeeth)
+        _markDirty(EEPROM_FIELD_ROTATOR_GEAR_TEETH);
+
+    if (_state.motorGearTeeth != motorGearTeeth)
+        _markDirty(EEPROM_FIELD_MOTOR_GEAR_TEETH);
+
+    _state.rotatorGearTeeth = rotatorGearTeeth;
+    _state.motorGearTeeth = motorGearTeeth;
+    return true;
+}
+
+unsigned long CustomEEPROM::getSerialBaud()
+{
+    return _state.serialBaud;
+}
+
+void CustomEEPROM::setSerialBaud(unsigned long value)
+{
+    if (_state.serialBaud != value)
+        _markDirty(EEPROM_FIELD_SERIAL_BAUD);
+
+    _state.serialBaud = value;
+}
@@ -1,3 +1,5 @@
+#include "EepromWriter.h"
+
 #if defined(ARDUINO_AVR_NANO_EVERY)
 #define EEPROM_SIZE 256
 #else
@@ -5,53 +7,203 @@
 #endif
 #define EEPROM_CHECK_PERIOD_MS 5000
 
+/**
+ * Default gear between motor shaft and rotator ring (teeth), stored in EEPROM
+ */
+#define ROTATOR_GEAR_TEETH 100
+#define MOTOR_GEAR_TEETH 20
+
+/**
+ * Serial baud rate after boot, stored in EEPROM once confirmed (see BaudRate.h)
+ */
+#define SERIAL_BAUD_DEFAULT 9600UL
+
 #pragma once
 
+/**
+ * EEPROM layout:
+ * - two configuration copies of EEPROM_CONFIGURATION_COPY_SIZE bytes: layout
+ *   version, size of the stored fields, CRC16 over generation and stored
+ *   fields, generation and the fields at the fixed offsets below (from the
+ *   start of the copy). A save goes to the older copy with the next
+ *   generation and its CRC written last, a torn save leaves the other copy
+ *   intact and mount takes the valid copy with the newer generation. New
+ *   fields are only ever appended, a firmware reading an older (smaller)
+ *   layout keeps the stored fields and defaults the missing ones.
+ * - journal ring of position records up to EEPROM_SIZE, every record carries
+ *   a sequence number incremented per write and a CRC16. Records are appended
+ *   round robin, so the newest record is the last slot i for which
+ *   sequence(i) == sequence(0) + i and mount can binary search for it.
+ *   EEPROM_RECORD_AT_REST marks a position saved while the rotator stood still
+ *   after homing, a record without it is appended as soon as a move starts.
+ *
+ * Layout versions: 1 initial, 2 journal records carry flags, 3 two
+ * configuration copies and the journal behind them. Older layouts, down to
+ * the one of the original firmware, are migrated on mount: the configuration
+ * is kept, the position as well but no longer trusted.
+ */
+#define EEPROM_LAYOUT_VERSION 3
+#define EEPROM_CONFIGURATION_ADDRESS_A 0
+#define EEPROM_CONFIGURATION_ADDRESS_B 48
+#define EEPROM_CONFIGURATION_COPY_SIZE 48
+#define EEPROM_OFFSET_LAYOUT_VERSION 0           // unsigned char
+#define EEPROM_OFFSET_CONFIGURATION_SIZE 1       // unsigned char, bytes from EEPROM_OFFSET_FIELDS
+#define EEPROM_OFFSET_CONFIGURATION_CRC 2        // unsigned short, from EEPROM_OFFSET_GENERATION
+#define EEPROM_OFFSET_GENERATION 4               // unsigned char
+#define EEPROM_OFFSET_FIELDS 5
+#define EEPROM_OFFSET_MAX_POSITION 5             // uint32_t
+#define EEPROM_OFFSET_MAX_MOVEMENT 9             // uint32_t
+#define EEPROM_OFFSET_STEP_MODE 13               // unsigned short
+#define EEPROM_OFFSET_STEP_MODE_MANUAL 15        // unsigned short
+#define EEPROM_OFFSET_SPEED_MODE 17              // unsigned char
+#define EEPROM_OFFSET_SETTLE_BUFFER_MS 18        // uint32_t
+#define EEPROM_OFFSET_IDLE_EEPROM_WRITE_MS 22    // uint32_t
+#define EEPROM_OFFSET_REVERSE_DIRECTION 26       // bool
+#define EEPROM_OFFSET_MOTOR_I_MOVE_MULTIPLIER 27 // unsigned char
+#define EEPROM_OFFSET_MOTOR_I_HOLD_MULTIPLIER 28 // unsigned char
+#define EEPROM_OFFSET_ROTATOR_GEAR_TEETH 29      // unsigned char
+#define EEPROM_OFFSET_MOTOR_GEAR_TEETH 30        // unsigned char
+#define EEPROM_OFFSET_SERIAL_BAUD 31             // uint32_t
+#define EEPROM_OFFSET_FIELDS_END 35
+#define EEPROM_JOURNAL_ADDRESS 96
+
+/**
+ * Layouts 1 and 2: one configuration at address 0, fields in the same order
+ * from EEPROM_V2_ADDRESS_FIELDS, the journal from EEPROM_V2_JOURNAL_ADDRESS
+ */
+#define EEPROM_V2_ADDRESS_FIELDS 4
+#define EEPROM_V2_JOURNAL_ADDRESS 64
+
+/**
+ * Original firmware: the fields up to motorIHoldMultiplier packed from address
+ * 0 in the same order, then slots of position, target position and a sum of
+ * position and configuration as checksum, the first matching slot is current
+ */
+#define EEPROM_V0_CONFIGURATION_SIZE 24
+#define EEPROM_V0_SLOT_SIZE 12
+
+/**
+ * Configuration fields in layout order, the index is the dirty bit of the field
+ */
+enum EEPROMField
+{
+  EEPROM_FIELD_MAX_POSITION,
+  EEPROM_FIELD_MAX_MOVEMENT,
+  EEPROM_FIELD_STEP_MODE,
+  EEPROM_FIELD_STEP_MODE_MANUAL,
+  EEPROM_FIELD_SPEED_MODE,
+  EEPROM_FIELD_SETTLE_BUFFER_MS,
+  EEPROM_FIELD_IDLE_EEPROM_WRITE_MS,
+  EEPROM_FIELD_REVERSE_DIRECTION,
+  EEPROM_FIELD_MOTOR_I_MOVE_MULTIPLIER,
+  EEPROM_FIELD_MOTOR_I_HOLD_MULTIPLIER,
+  EEPROM_FIELD_ROTATOR_GEAR_TEETH,
+  EEPROM_FIELD_MOTOR_GEAR_TEETH,
+  EEPROM_FIELD_SERIAL_BAUD,
+  EEPROM_FIELD_COUNT
+};
+
+#define EEPROM_DIRTY_CONFIGURATION ((1UL << EEPROM_FIELD_COUNT) - 1)
+#define EEPROM_DIRTY_POSITION (1UL << EEPROM_FIELD_COUNT)
+static_assert(EEPROM_FIELD_COUNT < 32, "dirty bits of all fields and the position have to fit into uint32_t");
+static_assert(EEPROM_CONFIGURATION_ADDRESS_B + EEPROM_CONFIGURATION_COPY_SIZE <= EEPROM_JOURNAL_ADDRESS, "configuration copies overlap the journal");
+
+#define EEPROM_RECORD_AT_REST 0x01
+
+class EEPROMFieldLayout
+{
+public:
+  unsigned char address;
+  unsigned char stateOffset;
+  unsigned char size;
+};
+/**
+ * Stored types have fixed sizes and records are packed, the layout is the
+ * same on the AVR and in the host simulation (64 bit unsigned long).
+ */
+class __attribute__((packed)) EEPROMRecord
+{
+public:
+  uint32_t sequence;
+  uint32_t position;
+  uint32_t targetPosition;
+  unsigned char flags;
+  unsigned short crc;
+};
+
 class EEPROMState
 {
 public:
-  unsigned long maxPosition;
-  unsigned long maxMovement;
+  uint32_t maxPosition;
+  uint32_t maxMovement;
   unsigned short stepMode;
   unsigned short stepModeManual;
   unsigned char speedMode;
-  unsigned long settleBufferMs;
-  unsigned long idleEepromWriteMs;
+  uint32_t settleBufferMs;
+  uint32_t idleEepromWriteMs;
   bool reverseDirection;
   unsigned char motorIMoveMultiplier;
   unsigned char motorIHoldMultiplier;
-  unsigned long position;
-  unsigned long targetPosition;
-  unsigned long checksum;
+  unsigned char rotatorGearTeeth;
+  unsigned char motorGearTeeth;
+  uint32_t serialBaud;
+  uint32_t position;
+  uint32_t targetPosition;
+  uint32_t sequence;
 };
 
 class CustomEEPROM
 {
 private:
-  EEPROMState _state = {0, 0, 16, 1, 4, 0, 0, 0, 0, 0, 0, 0, 9999};
-  EEPROMState _stateDefaults = {1000000, 5000000, 16, 2, 4, 0, 180000, 0, 90, 40, 0, 0, 0};
-  int _slidingSize = sizeof(_state.position) + sizeof(_state.targetPosition) + sizeof(_state.checksum);
-  int _configurationSize = sizeof(EEPROMState) - _slidingSize;
-  int _slidingAddressCount = EEPROM_SIZE / _slidingSize;
-  int _slidingCurrentAddress = _configurationSize;
-  bool _isConfigDirty;
+  EEPROMState _state = {0, 0, 16, 1, 4, 0, 0, 0, 0, 0, ROTATOR_GEAR_TEETH, MOTOR_GEAR_TEETH, SERIAL_BAUD_DEFAULT, 0, 0, 0};
+  EEPROMState _stateDefaults = {1000000, 5000000, 16, 2, 4, 0, 180000, 0, 90, 40, ROTATOR_GEAR_TEETH, MOTOR_GEAR_TEETH, SERIAL_BAUD_DEFAULT, 0, 0, 0};
+  int _journalSlotCount = (EEPROM_SIZE - EEPROM_JOURNAL_ADDRESS) / sizeof(EEPROMRecord);
+  int _journalCurrentSlot = 0;
+  unsigned long _journalPosition;
+  unsigned long _journalTargetPosition;
+  unsigned char _journalFlags;
+  bool _isJournalValid = false;
+  bool _isPositionTrusted = false;
+  bool _wasPositionTrusted = false;
+  EepromWriter _writer;
+  uint32_t _dirtyFields;
+  uint32_t _staleFields;                // fields the older configuration copy misses
+  unsigned int _configurationAddress;   // newer copy, a save goes to the other one
+  unsigned char _configurationGeneration;
   bool _isHoming;
+  bool _isHomingAborted = false;
   unsigned long _lastEepromCheckMs;
   unsigned long _lastPositionChangeMs = 0L;
 
-  unsigned long _calculateChecksum(EEPROMState state);
+  unsigned short _crcUpdate(unsigned short crc, const void *data, int size);
+  unsigned short _calculateConfigurationCrc(unsigned char generation);
+  void _getFieldLayout(unsigned char field, EEPROMFieldLayout &layout);
+  void _markDirty(unsigned char field);
+  bool _isStoredCrcValid(unsigned int address, unsigned int size, unsigned short crc);
+  bool _readConfigurationCopy(unsigned int address, unsigned char &generation);
+  bool _readV0Position();
+  void _readFields(unsigned int address, unsigned char size);
+  bool _readRecord(unsigned int journalAddress, int slot, EEPROMRecord &record);
+  int _findNewestRecord(unsigned int journalAddress, int slotCount);
+  void _formatJournal();
+  void _migrateEeprom();
   void _readEeprom();
-  void _writeEeprom(bool isReset);
+  bool _writeEeprom();
   void _resetEeprom();
 
 public:
   void init();
   void handleEeprom();
+  bool isWriting();
+  void flush();
   void resetToDefaults();
   void debug();
 
   bool isHoming();
   void setHoming(bool value);
+  void abortHoming();
+  bool wasPositionTrusted();
+  void setPositionTrusted(bool value);
   unsigned long getPosition();
   void setPosition(unsigned long value);
   void syncPosition(unsigned long value);
@@ -77,6 +229,9 @@ public:
   void setMotorIMoveMultiplier(unsigned char value);
   unsigned char getMotorIHoldMultiplier();
   void setMotorIHoldMultiplier(unsigned char value);
-  unsigned long getChecksum();
-  void setChecksum(unsigned long value);
+  unsigned char getRotatorGearTeeth();
+  unsigned char getMotorGearTeeth();
+  bool setGearTeeth(unsigned char rotatorGearTeeth, unsigned char motorGearTeeth);
+  unsigned long getSerialBaud();
+  void setSerialBaud(unsigned long value);
 };
\ No newline at end of file
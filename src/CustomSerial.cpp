@@ -1,48 +1,151 @@
 #include "CustomSerial.h"
+#include "Telemetry.h"
 
-void CustomSerial::init(StringProxy &stringProxy)
+void CustomSerial::init(StringProxy &stringProxy, Motor &motor, BaudRate &baudRate, BinaryProtocol &binaryProtocol)
 {
     _stringProxy = &stringProxy;
+    _motor = &motor;
+    _baudRate = &baudRate;
+    _binaryProtocol = &binaryProtocol;
+}
+
+char const *CustomSerial::_processCommand(char *command, int length)
+{
+    // tokenize in place: "CC:param" -> command at 0, parameter at 3
+    command[length] = 0;
+
+    char *commandParam = length > 3 ? command + 3 : command + length;
+    int commandParamLength = length > 3 ? length - 3 : 0;
+
+    // replies share one buffer in StringProxy, send each before running the next command
+    char const *output = _stringProxy->processFalconCommand(command, commandParam, commandParamLength);
+    if (output[0] != 0)
+    {
+        Serial.print(output);
+        Serial.print(TERMINATION_CHAR);
+    }
+
+    return output;
+}
+
+void CustomSerial::_processLine(int length)
+{
+    bool hasReply = false;
+    int start = 0;
+
+    while (start < length)
+    {
+        int end = start;
+        while (end < length && _serialCommandRaw[end] != COMMAND_SEPARATOR_CHAR)
+            end++;
+
+        // empty commands, e.g. a trailing separator, are skipped
+        if (end > start)
+        {
+            char const *output = _processCommand(_serialCommandRaw + start, end - start);
+            bool isOk = output[0] != 0 && strcmp(output, RESPONSE_KO) != 0;
+            hasReply = hasReply || output[0] != 0;
+
+            if (!isOk && SERIAL_BATCH_STOP_ON_ERROR)
+                break;
+        }
+
+        start = end + 1;
+    }
+
+    if (hasReply)
+    {
+        Serial.println();
+
+        // the host talks at this rate, boot recovery stays on it
+        _baudRate->keepRecoveryRate();
+    }
+}
+
+void CustomSerial::_scanHalt(char c)
+{
+    // c was just stored, a command starts at the beginning of the line or behind a separator
+    if (c == COMMAND_SEPARATOR_CHAR)
+    {
+        _commandStartIdx = _serialCommandRawIdx;
+    }
+    else if (
+        _serialCommandRawIdx == _commandStartIdx + 2 &&
+        _serialCommandRaw[_commandStartIdx] == SERIAL_HALT_OPCODE_0 &&
+        c == SERIAL_HALT_OPCODE_1)
+    {
+        _isHaltPending = _motor->halt() || _isHaltPending;
+    }
 }
 
 void CustomSerial::serialEvent(SoftwareSerial &loopbackSerial)
 {
-    while (Serial.available())
+    if (_baudRate->handle())
+    {
+        // a partial line was received at the old rate
+        _serialCommandRawIdx = 0;
+        _commandStartIdx = 0;
+    }
+
+    if (_pendingLineLength >= 0)
+    {
+        if (_motor->isMoving())
+            return;
+
+        int length = _pendingLineLength;
+        _pendingLineLength = -1;
+        _isHaltPending = false;
+        _processLine(length);
+    }
+
+    if (_binaryProtocol->isActive())
+    {
+        _binaryProtocol->handle();
+        return;
+    }
+
+    // bytes behind a BR line belong to the new rate, behind a BM line to the binary protocol
+    while (!_baudRate->isSwitchPending() && !_binaryProtocol->isActive() && Serial.available())
     {
         char c = Serial.read();
 
         if (c == '\n')
         {
-            _serialCommandRawLength = _serialCommandRawIdx;
+            int length = _serialCommandRawIdx;
             _serialCommandRawIdx = 0;
-            _commandParamLength = 0;
+            _commandStartIdx = 0;
 
-            memset(_command, 0, 5);
-            memset(_commandParam, 0, 65);
-
-            if (_serialCommandRawLength >= 2)
-            {
-                strncpy(_command, _serialCommandRaw, 2);
-                _command[3] = 0;
-            }
-
-            if (_serialCommandRawLength > 3)
+            if (_isHaltPending && _motor->isMoving())
             {
-                _commandParamLength = _serialCommandRawLength - 3;
-                strncpy(_commandParam, _serialCommandRaw + 3, _commandParamLength);
-                _commandParam[_commandParamLength] = 0;
+                // the line stays in the buffer until the motor stands still
+                _pendingLineLength = length;
+                return;
             }
 
-            String output = _stringProxy->processFalconCommand(_command, _commandParam, _commandParamLength);
-            if (output.length() > 0)
-            {
-                Serial.println(output + TERMINATION_CHAR);
-            }
+            _isHaltPending = false;
+            _processLine(length);
         }
-        else if (_serialCommandRawIdx < 70)
+        else if (_serialCommandRawIdx < SERIAL_COMMAND_MAX_LENGTH)
         {
             _serialCommandRaw[_serialCommandRawIdx] = c;
             _serialCommandRawIdx++;
+            _scanHalt(c);
+        }
+        else
+        {
+            Telemetry::count(TELEMETRY_COUNTER_SERIAL_DROPPED);
+        }
+    }
+
+    // events go out between replies and never block, a full transmit buffer delays them
+    if (!_baudRate->isSwitchPending() && Serial.availableForWrite() >= STRING_PROXY_EVENT_MAX_LENGTH)
+    {
+        char const *event = _stringProxy->pollEvent();
+        if (event[0] != 0)
+        {
+            Serial.print(event);
+            Serial.print(TERMINATION_CHAR);
+            Serial.println();
         }
     }
 }
@@ -1,9 +1,44 @@
+#include <SoftwareSerial.h>
+#include "BaudRate.h"
+#include "BinaryProtocol.h"
+#include "Motor.h"
 #include "StringProxy.h"
 
 #pragma once
 
 #define TERMINATION_CHAR ';'
 
+/**
+ * Longest accepted command line (without '\n'), longer lines are truncated.
+ * Bytes are buffered by the UART receive interrupt of HardwareSerial
+ * (SERIAL_RX_BUFFER_SIZE, see platformio.ini) until serialEvent runs.
+ */
+#define SERIAL_COMMAND_MAX_LENGTH 70
+
+/**
+ * A line may hold several commands separated by COMMAND_SEPARATOR_CHAR,
+ * e.g. "SS:16;MS:3200;FA". They run in order and their replies are sent as
+ * one line, each reply followed by TERMINATION_CHAR: "(OK);MS:3200;FR_OK:...;".
+ * A command fails when it is unknown (no reply) or answers RESPONSE_KO.
+ * With SERIAL_BATCH_STOP_ON_ERROR the rest of the line is skipped after a
+ * failure, otherwise every command runs. A line with a single command is
+ * answered exactly as before.
+ */
+#define COMMAND_SEPARATOR_CHAR ';'
+
+#ifndef SERIAL_BATCH_STOP_ON_ERROR
+#define SERIAL_BATCH_STOP_ON_ERROR 1
+#endif
+
+/**
+ * Halt does not wait for the end of the line: the motor starts to decelerate
+ * (and homing is aborted) as soon as a command begins with the two bytes "FH".
+ * The line is run once the motor stands still, so the FH reply confirms the
+ * stop. Bytes behind it wait in the receive buffer meanwhile.
+ */
+#define SERIAL_HALT_OPCODE_0 'F'
+#define SERIAL_HALT_OPCODE_1 'H'
+
 enum CmdType
 {
     INVALID,
@@ -15,15 +50,20 @@ class CustomSerial
 {
 private:
     StringProxy *_stringProxy;
-    char _serialCommandRaw[70];
+    Motor *_motor;
+    BaudRate *_baudRate;
+    BinaryProtocol *_binaryProtocol;
+    char _serialCommandRaw[SERIAL_COMMAND_MAX_LENGTH + 1];
     CmdType _cmdType;
     int _serialCommandRawIdx;
-    int _serialCommandRawLength;
-    char _command[5];
-    char _commandParam[65];
-    int _commandParamLength;
+    int _commandStartIdx = 0;
+    bool _isHaltPending = false;
+    int _pendingLineLength = -1;
+    char const *_processCommand(char *command, int length);
+    void _processLine(int length);
+    void _scanHalt(char c);
 
 public:
-    void init(StringProxy &stringProxy);
+    void init(StringProxy &stringProxy, Motor &motor, BaudRate &baudRate, BinaryProtocol &binaryProtocol);
     void serialEvent(SoftwareSerial &loopbackSerial);
 };
\ No newline at end of file
@@ -0,0 +1,79 @@
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include "EepromWriter.h"
+#include "Telemetry.h"
+
+static EepromWriter *_eepromWriterInstance = NULL;
+
+ISR(EE_READY_vect)
+{
+    _eepromWriterInstance->handleInterrupt();
+}
+
+void EepromWriter::init()
+{
+    _eepromWriterInstance = this;
+}
+
+unsigned int EepromWriter::available()
+{
+    return (_tail - _head - 1) & (EEPROM_WRITER_QUEUE_SIZE - 1);
+}
+
+bool EepromWriter::write(unsigned int address, const void *data, unsigned int size)
+{
+    // all or nothing, a record must never be queued partially
+    if (size > this->available())
+        return false;
+
+    const unsigned char *bytes = (const unsigned char *)data;
+    unsigned char head = _head;
+    for (unsigned int i = 0; i < size; i++)
+    {
+        _queue[head].address = address + i;
+        _queue[head].value = bytes[i];
+        head = (head + 1) & (EEPROM_WRITER_QUEUE_SIZE - 1);
+    }
+
+    _head = head;
+
+    // EE_READY fires as long as it is enabled and no write is in progress
+    EECR |= _BV(EERIE);
+
+    return true;
+}
+
+bool EepromWriter::isBusy()
+{
+    // EECR first, so a flush() loop polls the register on every pass (and simulated time passes)
+    return (EECR & _BV(EEPE)) || _head != _tail;
+}
+
+void EepromWriter::flush()
+{
+    while (this->isBusy())
+        ;
+}
+
+void EepromWriter::handleInterrupt()
+{
+    while (_tail != _head)
+    {
+        EepromWriteEntry &entry = _queue[_tail];
+        _tail = (_tail + 1) & (EEPROM_WRITER_QUEUE_SIZE - 1);
+
+        EEAR = entry.address;
+        EECR |= _BV(EERE);
+        if (EEDR == entry.value)
+            continue;
+
+        // EEPE has to follow EEMPE within four cycles, interrupts are already disabled here
+        EEDR = entry.value;
+        EECR |= _BV(EEMPE);
+        EECR |= _BV(EEPE);
+        Telemetry::count(TELEMETRY_COUNTER_EEPROM_WRITES);
+        return;
+    }
+
+    EECR &= ~_BV(EERIE);
+}
@@ -0,0 +1,34 @@
+#include <Arduino.h>
+
+#pragma once
+
+/**
+ * Queue of pending EEPROM byte writes, drained by the EEPROM ready interrupt.
+ * One byte takes ~3.4ms to program, the CPU only spends a few cycles per byte
+ * in the interrupt. Bytes that already hold the queued value are skipped
+ * (same as eeprom_update_block). Must be a power of two.
+ */
+#define EEPROM_WRITER_QUEUE_SIZE 64
+
+class EepromWriteEntry
+{
+public:
+    unsigned int address;
+    unsigned char value;
+};
+
+class EepromWriter
+{
+private:
+    EepromWriteEntry _queue[EEPROM_WRITER_QUEUE_SIZE];
+    volatile unsigned char _head = 0;
+    volatile unsigned char _tail = 0;
+
+public:
+    void init();
+    unsigned int available();
+    bool write(unsigned int address, const void *data, unsigned int size);
+    bool isBusy();
+    void flush();
+    void handleInterrupt();
+};
@@ -0,0 +1,69 @@
+#include <Arduino.h>
+
+#pragma once
+
+/**
+ * Direct port access for pins known at compile time.
+ * On the ATmega328P (Uno/Nano pinout) every call compiles down to a single
+ * sbi/cbi instruction: digital pins 0-7 are PORTD, 8-13 PORTB and 14-19
+ * (A0-A5) PORTC. Other MCUs fall back to digitalWrite.
+ */
+#if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega168__)
+#define FAST_GPIO_DIRECT 1
+#else
+#define FAST_GPIO_DIRECT 0
+#endif
+
+template <uint8_t PIN>
+class FastPin
+{
+private:
+    static_assert(PIN < 20, "FastPin only maps digital pins 0-19");
+
+    static constexpr uint8_t _bit()
+    {
+        return PIN < 8 ? PIN : (PIN < 14 ? PIN - 8 : PIN - 14);
+    }
+
+public:
+    static void output()
+    {
+        pinMode(PIN, OUTPUT);
+    }
+
+    static void high()
+    {
+#if FAST_GPIO_DIRECT
+        if (PIN < 8)
+            PORTD |= (1 << _bit());
+        else if (PIN < 14)
+            PORTB |= (1 << _bit());
+        else
+            PORTC |= (1 << _bit());
+#else
+        digitalWrite(PIN, HIGH);
+#endif
+    }
+
+    static void low()
+    {
+#if FAST_GPIO_DIRECT
+        if (PIN < 8)
+            PORTD &= ~(1 << _bit());
+        else if (PIN < 14)
+            PORTB &= ~(1 << _bit());
+        else
+            PORTC &= ~(1 << _bit());
+#else
+        digitalWrite(PIN, LOW);
+#endif
+    }
+
+    static void write(bool value)
+    {
+        if (value)
+            high();
+        else
+            low();
+    }
+};
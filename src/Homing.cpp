@@ -3,59 +3,219 @@
 
 uint16_t Homing::_getSensorReading()
 {
-    int hallReadings = 0;
-    for (int i = 0; i < HOME_SENSOR_READINGS; i++)
+    // filtered by the ADC interrupt, never waits for a conversion
+    return _sensor->read(SENSOR_CHANNEL_HOME);
+}
+
+void Homing::_moveTo(unsigned long position, unsigned char speedMode)
+{
+    _eeprom->setTargetPosition(position);
+    _motor->applyStepMode();
+    _motor->startMotor(speedMode);
+}
+
+void Homing::_startSweep(unsigned long position, unsigned char speedMode, unsigned long minSensorPosition)
+{
+    _minSensorValue = 0xFFFF;
+    _minSensorPosition = minSensorPosition;
+    _isMinimumPassed = false;
+
+    this->_moveTo(position, speedMode);
+}
+
+void Homing::_sampleSweep(bool stopAfterMinimum)
+{
+    // steps come from the timer interrupt, the sensor is sampled while the motor turns
+    if (_isMinimumPassed)
+        return;
+
+    uint16_t sensorValue = this->_getSensorReading();
+    unsigned long sensorPosition = _eeprom->getPosition();
+
+    if (sensorValue < _minSensorValue)
+    {
+        _minSensorValue = sensorValue;
+        _minSensorPosition = sensorPosition;
+    }
+    else if (
+        stopAfterMinimum &&
+        _minSensorValue < HOME_SENSOR_THRESHOLD &&
+        sensorValue > _minSensorValue + HOME_SENSOR_HYSTERESIS)
     {
-        hallReadings += analogRead(HOME_SENSOR_PIN);
-        delayMicroseconds(HOME_SENSOR_READING_DELAY);
+        // passed the minimum, the rest of the segment runs without sampling
+        _isMinimumPassed = true;
     }
+}
+
+void Homing::_startConfirmation()
+{
+    // shift by one window, home is expected at window and the probe never goes below 0
+    _eeprom->setPosition(_eeprom->getPosition() + _window);
+    _eeprom->setTargetPosition(_eeprom->getPosition());
 
-    return hallReadings / HOME_SENSOR_READINGS;
+    this->_moveTo(0, HOME_SWEEP_SPEED_MODE);
+    _state = HOMING_CONFIRM_APPROACH;
 }
 
-void Homing::_handleMovement()
+void Homing::_startSearch()
 {
-    do
-    {
-        _motor->handleMotor();
-    } while (_motor->isMoving());
+    // start one window in, the fine pass may have to go back behind the start
+    _eeprom->setPosition(_window);
+    _eeprom->setTargetPosition(_window);
+    _eeprom->handleEeprom();
+
+    _minSensorValue = 0xFFFF;
+    _minSensorPosition = _window;
+    _isMinimumPassed = false;
+    _swept = 0;
+
+    this->_startCoarseSegment();
 }
 
-void Homing::_moveOneDegree()
+void Homing::_startCoarseSegment()
 {
-    unsigned long steps = _stringProxy->getStepsPerDeg();
-    _eeprom->setTargetPosition(_eeprom->getPosition() + steps);
-    _motor->applyStepMode();
-    _motor->startMotor();
+    // coarse: fast sweep over one revolution at most, brackets the minimum
+    unsigned long steps = _stepsPerRevolution - _swept < _segment ? _stepsPerRevolution - _swept : _segment;
+    _swept += steps;
+
+    this->_moveTo(_eeprom->getPosition() + steps, HOME_SWEEP_SPEED_MODE);
+    _state = HOMING_COARSE_SWEEP;
 }
 
-void Homing::_moveToHome()
+void Homing::_finishCoarseSweep()
 {
-    _eeprom->setTargetPosition(_homePosition);
-    _motor->applyStepMode();
-    _motor->startMotor();
+    // fine: slow pass across the bracket, always in the same direction
+    _coarsePosition = _minSensorPosition;
+    unsigned long fineStart = _coarsePosition >= _window ? _coarsePosition - _window : _coarsePosition + _stepsPerRevolution - _window; // only a modular axis wraps below the window
+
+    this->_moveTo(fineStart, HOME_SWEEP_SPEED_MODE);
+    _state = HOMING_FINE_APPROACH;
+}
+
+void Homing::_startMoveHome()
+{
+    _homePosition = _minSensorPosition;
 
-    this->_handleMovement();
+    this->_moveTo(_homePosition, _eeprom->getSpeedMode());
+    _state = HOMING_MOVE_HOME;
+}
 
+void Homing::_finishHoming()
+{
     _homePosition = 0;
     _isHomed = true;
     _isHoming = false;
+    _readingHomeValuesFinished = true;
+    _state = HOMING_DONE;
 
     _eeprom->setHoming(false);
+    _motor->resetCableWrap();
     _eeprom->setPosition(0);
     _eeprom->setTargetPosition(0);
+    _eeprom->setPositionTrusted(true);
     _eeprom->handleEeprom();
 }
 
-bool Homing::init(CustomEEPROM &eeprom, Motor &motor, StringProxy &stringProxy)
+void Homing::begin()
+{
+    if (_isHoming)
+        return;
+
+    _window = _stringProxy->hundredthsToSteps(HOME_FINE_WINDOW_HUNDREDTHS);
+    _segment = _stringProxy->hundredthsToSteps(HOME_SWEEP_SEGMENT_HUNDREDTHS);
+    _stepsPerRevolution = _motor->getStepsPerRevolution();
+
+    _isHomed = false;
+    _isHoming = true;
+    _eeprom->setHoming(true);
+
+    // the full search starts from wherever a failed confirmation left the rotator
+    if (HOME_WARM_BOOT && ROTATOR_CABLE_WRAP_DEG == 0 && _eeprom->wasPositionTrusted())
+        this->_startConfirmation();
+    else
+        this->_startSearch();
+}
+
+bool Homing::handle()
+{
+    if (_isHoming && !_eeprom->isHoming())
+    {
+        // aborted by a halt, the motor decelerates by itself
+        _isHoming = false;
+        _state = HOMING_IDLE;
+        return false;
+    }
+
+    switch (_state)
+    {
+    case HOMING_CONFIRM_APPROACH:
+        if (_motor->isMoving())
+            return true;
+
+        this->_startSweep(2 * _window, HOME_FINE_SPEED_MODE, _window);
+        _state = HOMING_CONFIRM_SWEEP;
+        return true;
+
+    case HOMING_CONFIRM_SWEEP:
+        this->_sampleSweep(false);
+        if (_motor->isMoving())
+            return true;
+
+        if (isHomeConfirmed(_minSensorValue, _minSensorPosition, _window, _stringProxy->hundredthsToSteps(HOME_CONFIRM_TOLERANCE_HUNDREDTHS)))
+            this->_startMoveHome();
+        else
+            this->_startSearch();
+        return true;
+
+    case HOMING_COARSE_SWEEP:
+        this->_sampleSweep(true);
+        if (_motor->isMoving())
+            return true;
+
+        if (_isMinimumPassed || _swept >= _stepsPerRevolution)
+            this->_finishCoarseSweep();
+        else
+            this->_startCoarseSegment();
+        return true;
+
+    case HOMING_FINE_APPROACH:
+        if (_motor->isMoving())
+            return true;
+
+        this->_startSweep(_coarsePosition + _window, HOME_FINE_SPEED_MODE, _coarsePosition);
+        _state = HOMING_FINE_SWEEP;
+        return true;
+
+    case HOMING_FINE_SWEEP:
+        this->_sampleSweep(false);
+        if (_motor->isMoving())
+            return true;
+
+        this->_startMoveHome();
+        return true;
+
+    case HOMING_MOVE_HOME:
+        if (_motor->isMoving())
+            return true;
+
+        this->_finishHoming();
+        return false;
+
+    default:
+        return false;
+    }
+}
+
+bool Homing::init(CustomEEPROM &eeprom, Motor &motor, StringProxy &stringProxy, SensorSampler &sensor)
 {
     _eeprom = &eeprom;
     _motor = &motor;
     _stringProxy = &stringProxy;
+    _sensor = &sensor;
 
     if (!_pinsInitialized)
     {
-        pinMode(HOME_SENSOR_PIN, INPUT);
+        pinMode(SENSOR_HOME_PIN, INPUT);
         _pinsInitialized = true;
     }
 
@@ -72,39 +232,10 @@ bool Homing::isHoming()
     return _isHoming;
 }
 
-void Homing::findHomePosition()
+bool Homing::isHomeConfirmed(uint16_t sensorValue, unsigned long sensorPosition, unsigned long expectedPosition, unsigned long tolerance)
 {
-    _isHoming = true;
-    _eeprom->setHoming(true);
-    _eeprom->setPosition(0);
-    _eeprom->handleEeprom();
-
-    for (int i = 0; i <= 360; i++)
-    {
-        if (i > 0)
-        {
-            this->_moveOneDegree();
-            this->_handleMovement();
-        }
-
-        _currentSensorValue = this->_getSensorReading();
-        _currentPosition = _eeprom->getPosition();
-        _previousPosition = _currentPosition - _stringProxy->getStepsPerDeg();
-
-        if (_currentSensorValue <= _previousSensorValue)
-        {
-            _previousSensorValue = _currentSensorValue;
-        }
-        else if (
-            _currentSensorValue < HOME_SENSOR_THRESHOLD &&
-            _currentSensorValue > _previousSensorValue)
-        {
-            break;
-        }
-    }
+    unsigned long offset = sensorPosition > expectedPosition ? sensorPosition - expectedPosition : expectedPosition - sensorPosition;
 
-    _homePosition = _previousPosition;
-    this->_moveToHome();
-
-    _readingHomeValuesFinished = true;
+    return sensorValue < HOME_SENSOR_THRESHOLD && offset <= tolerance;
 }
+
@@ -1,5 +1,6 @@
 #include "CustomEEPROM.h"
 #include "Motor.h"
+#include "SensorSampler.h"
 #include "StringProxy.h"
 
 #pragma once
@@ -7,33 +8,92 @@
 #define ADC_MAX 1024
 #define NUM_BITS 10
 #define HOME_SENSOR_THRESHOLD 500
-#define HOME_SENSOR_PIN A0
-#define HOME_SENSOR_READINGS 12
-#define HOME_SENSOR_READING_DELAY 50
+
+/**
+ * Homing sweeps instead of stepping degree by degree. The motor turns while
+ * the Hall sensor is sampled on every run of the homing task, every sample is
+ * tagged with the step position reached at that time.
+ * - coarse: up to one revolution in HOME_SWEEP_SEGMENT_HUNDREDTHS segments at
+ *   HOME_SWEEP_SPEED_MODE, ends once the reading rose HOME_SENSOR_HYSTERESIS
+ *   above a minimum below HOME_SENSOR_THRESHOLD
+ * - fine: back to the coarse minimum - HOME_FINE_WINDOW_HUNDREDTHS, then one
+ *   slow pass at HOME_FINE_SPEED_MODE across the window
+ * Segments stay below half a revolution, so a modular axis moves the same way.
+ */
+#define HOME_SWEEP_SEGMENT_HUNDREDTHS 9000
+#define HOME_SWEEP_SPEED_MODE 5
+#define HOME_FINE_WINDOW_HUNDREDTHS 300
+#define HOME_FINE_SPEED_MODE 1
+#define HOME_SENSOR_HYSTERESIS 10
+
+/**
+ * Warm boot: when the journal says the rotator stood still after homing
+ * (see EEPROM_RECORD_AT_REST), it drives straight to home and confirms it
+ * with one fine pass across +-HOME_FINE_WINDOW_HUNDREDTHS. Home is accepted
+ * when the minimum lies below HOME_SENSOR_THRESHOLD and within
+ * HOME_CONFIRM_TOLERANCE_HUNDREDTHS of the expected position, otherwise
+ * the full search runs. 0 always runs the full search. The cable wrap count
+ * (see ROTATOR_CABLE_WRAP_DEG) is not stored, so with a wrap limit every boot
+ * runs the full search and the count starts over at home.
+ */
+#ifndef HOME_WARM_BOOT
+#define HOME_WARM_BOOT 1
+#endif
+#define HOME_CONFIRM_TOLERANCE_HUNDREDTHS 100
+
+/**
+ * Homing runs as a state machine, handle() does one step per call and never
+ * waits for the motor. The motor task keeps the position up to date in between.
+ */
+enum HomingState
+{
+    HOMING_IDLE,
+    HOMING_CONFIRM_APPROACH, // warm boot: to one window before the expected home
+    HOMING_CONFIRM_SWEEP,    // warm boot: slow pass across home
+    HOMING_COARSE_SWEEP,     // fast segments over one revolution at most
+    HOMING_FINE_APPROACH,    // back to one window before the coarse minimum
+    HOMING_FINE_SWEEP,       // slow pass across the coarse minimum
+    HOMING_MOVE_HOME,        // to the minimum found
+    HOMING_DONE
+};
 
 class Homing
 {
 private:
     CustomEEPROM *_eeprom;
-    unsigned long _currentPosition = 0L;
+    unsigned char _state = HOMING_IDLE;
     unsigned long _homePosition = 0L;
-    unsigned long _previousPosition = 0L;
-    int _currentSensorValue = 9999;
-    int _previousSensorValue = 9999;
+    uint16_t _minSensorValue = 0xFFFF;
+    unsigned long _minSensorPosition = 0L;
+    bool _isMinimumPassed = false;
+    unsigned long _window = 0L;
+    unsigned long _segment = 0L;
+    unsigned long _stepsPerRevolution = 0L;
+    unsigned long _swept = 0L;
+    unsigned long _coarsePosition = 0L;
     bool _isHomed = false;
     bool _isHoming = false;
     Motor *_motor;
     bool _pinsInitialized = false;
     bool _readingHomeValuesFinished = false;
     StringProxy *_stringProxy;
+    SensorSampler *_sensor;
     uint16_t _getSensorReading();
-    void _handleMovement();
-    void _moveOneDegree();
-    void _moveToHome();
+    void _moveTo(unsigned long position, unsigned char speedMode);
+    void _startSweep(unsigned long position, unsigned char speedMode, unsigned long minSensorPosition);
+    void _sampleSweep(bool stopAfterMinimum);
+    void _startConfirmation();
+    void _startSearch();
+    void _startCoarseSegment();
+    void _finishCoarseSweep();
+    void _startMoveHome();
+    void _finishHoming();
 
 public:
-    void findHomePosition();
-    bool init(CustomEEPROM &eeprom, Motor &motor, StringProxy &stringProxy);
+    void begin();
+    bool handle();
+    static bool isHomeConfirmed(uint16_t sensorValue, unsigned long sensorPosition, unsigned long expectedPosition, unsigned long tolerance);
+    bool init(CustomEEPROM &eeprom, Motor &motor, StringProxy &stringProxy, SensorSampler &sensor);
     bool isHomed();
     bool isHoming();
 };
@@ -0,0 +1,119 @@
+#include <Arduino.h>
+#include "MotionPlanner.h"
+#include "StepGenerator.h"
+
+class RampProfile
+{
+public:
+    unsigned long cruiseTicks; // full step interval at cruise speed
+    unsigned long firstTicks;  // full step interval of the first ramp step
+    unsigned long accelStepsQ8; // full steps needed to reach cruise speed, 8.8 fixed point
+};
+
+constexpr double _constSqrt(double x, double guess, int iterations)
+{
+    return iterations == 0 ? guess : _constSqrt(x, 0.5 * (guess + x / guess), iterations - 1);
+}
+
+constexpr double _constSqrt(double x)
+{
+    return _constSqrt(x, x > 1.0 ? x : 1.0, 30);
+}
+
+/**
+ * Ramp with constant acceleration a (D. Austin, "Generate stepper-motor speed profiles in real time"):
+ * - first interval c0 = 0.676 * sqrt(2 / a) (0.676 corrects the error of the first recurrence step)
+ * - steps until the cruise speed v is reached n = v^2 / (2 * a)
+ */
+constexpr RampProfile _rampProfile(unsigned long stepDelayUs)
+{
+    return RampProfile{
+        stepDelayUs * STEP_TIMER_TICKS_PER_US,
+        (unsigned long)(0.676 * _constSqrt(2.0 / MOTOR_ACCELERATION) * 1000000.0 * STEP_TIMER_TICKS_PER_US),
+        (unsigned long)((1000000.0 / stepDelayUs) * (1000000.0 / stepDelayUs) / (2.0 * MOTOR_ACCELERATION) * 256.0)};
+}
+
+constexpr unsigned int _sqrtQ8(unsigned int value)
+{
+    return (unsigned int)(_constSqrt(value) * 256.0 + 0.5);
+}
+
+// speed modes 1-5, cruise step interval at full step
+static const RampProfile RAMP_PROFILES[MOTOR_SPEED_MODES] PROGMEM = {
+    _rampProfile(96000),
+    _rampProfile(48000),
+    _rampProfile(24000),
+    _rampProfile(8000),
+    _rampProfile(4000)};
+
+// sqrt(step mode) in 8.8 fixed point for step modes 1, 2, 4, ..., 256
+static const unsigned int STEP_MODE_SQRT_Q8[9] PROGMEM = {
+    _sqrtQ8(1),
+    _sqrtQ8(2),
+    _sqrtQ8(4),
+    _sqrtQ8(8),
+    _sqrtQ8(16),
+    _sqrtQ8(32),
+    _sqrtQ8(64),
+    _sqrtQ8(128),
+    _sqrtQ8(256)};
+
+void MotionPlanner::plan(unsigned long steps, unsigned char speedMode, unsigned short stepMode, MotionPlan &plan)
+{
+    if (speedMode < 1)
+        speedMode = 1;
+    else if (speedMode > MOTOR_SPEED_MODES)
+        speedMode = MOTOR_SPEED_MODES;
+
+    if (stepMode < 1)
+        stepMode = 1;
+
+    RampProfile profile;
+    memcpy_P(&profile, &RAMP_PROFILES[speedMode - 1], sizeof(profile));
+
+    unsigned char stepModeIdx = 0;
+    while ((1U << stepModeIdx) < stepMode && stepModeIdx < 8)
+        stepModeIdx++;
+
+    // microstepping: interval shrinks with the step mode, c0 with its square root, ramp length grows linearly
+    // and is rounded up, the recurrence reaches cruise speed on the step after n = v^2 / (2 * a)
+    unsigned long cruiseTicks = profile.cruiseTicks / stepMode;
+    unsigned long firstTicks = (profile.firstTicks * 256UL) / pgm_read_word(&STEP_MODE_SQRT_Q8[stepModeIdx]);
+    unsigned long accelSteps = (profile.accelStepsQ8 * stepMode + 255UL) >> 8;
+
+    plan.totalSteps = steps;
+    plan.cruiseTicks = cruiseTicks;
+    plan.cruiseRest = 0;
+    plan.cruiseDivisor = 1;
+
+    if (firstTicks <= cruiseTicks || accelSteps == 0)
+    {
+        // cruise speed is slow enough to start and stop without a ramp
+        plan.accelSteps = 0;
+        plan.decelStart = steps;
+        plan.firstTicks = cruiseTicks;
+        return;
+    }
+
+    // short moves never reach cruise speed: accelerate for one half, decelerate for the other
+    if (accelSteps > steps / 2)
+        accelSteps = steps / 2;
+
+    plan.accelSteps = accelSteps;
+    plan.decelStart = steps - accelSteps;
+    plan.firstTicks = accelSteps > 0 ? firstTicks : cruiseTicks;
+}
+
+void MotionPlanner::planConstant(unsigned long steps, unsigned long intervalHundredthsMs, MotionPlan &plan)
+{
+    // no ramp, the motor is slow enough to start and stop at once (derotation: several ms per step)
+    unsigned long long ticks = (unsigned long long)intervalHundredthsMs * STEP_TIMER_TICKS_PER_MS;
+
+    plan.totalSteps = steps;
+    plan.accelSteps = 0;
+    plan.decelStart = steps;
+    plan.cruiseTicks = ticks / 100;
+    plan.cruiseRest = ticks % 100;
+    plan.cruiseDivisor = 100;
+    plan.firstTicks = plan.cruiseTicks;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+/**
+ * Acceleration (and deceleration) of moves in full steps per s^2.
+ * The effective rate scales with the step mode, so the ramp covers
+ * the same angle for every step mode.
+ */
+#define MOTOR_ACCELERATION 500
+
+/**
+ * Number of speed modes, see RAMP_PROFILES in MotionPlanner.cpp
+ */
+#define MOTOR_SPEED_MODES 5
+
+class MotionPlan
+{
+public:
+    unsigned long totalSteps;
+    unsigned long accelSteps;    // length of the acceleration and of the mirrored deceleration ramp
+    unsigned long decelStart;    // step index at which deceleration starts
+    unsigned long firstTicks;    // interval before the first step (timer ticks)
+    unsigned long cruiseTicks;   // interval at cruise speed (timer ticks)
+    unsigned long cruiseRest;    // fraction of a tick added to every cruise interval: cruiseRest / cruiseDivisor
+    unsigned long cruiseDivisor;
+};
+
+class MotionPlanner
+{
+public:
+    static void plan(unsigned long steps, unsigned char speedMode, unsigned short stepMode, MotionPlan &plan);
+    static void planConstant(unsigned long steps, unsigned long intervalHundredthsMs, MotionPlan &plan);
+};
@@ -1,62 +1,177 @@
 #include <Arduino.h>
 #include "Motor.h"
+#include "Telemetry.h"
 
-void Motor::_startMotor()
+void Motor::_startMotor(unsigned char speedMode)
 {
+    if (_motorIsMoving)
+    {
+        // retarget: take over the position reached so far
+        _stepGenerator.stop();
+        _syncPosition();
+    }
+
     _motorIsMoving = true;
-    _debouncingLastRunMs = millis();
+    _isDerotating = false;
+    _eeprom->setPositionTrusted(false);
 
-    switch (_eeprom->getSpeedMode())
+    unsigned long position = _eeprom->getPosition();
+    unsigned long targetPosition = _eeprom->getTargetPosition();
+    unsigned long steps;
+
+    _moveStartPosition = position;
+    _moveCableWrapStart = _cableWrapSteps;
+
+    if (ROTATOR_MODULAR_AXIS)
     {
-    case 1:
-        _motorMoveDelay = 96000;
-        break;
-    case 2:
-        _motorMoveDelay = 48000;
-        break;
-    case 3:
-        _motorMoveDelay = 24000;
-        break;
-    case 4:
-        _motorMoveDelay = 8000;
-        break;
-    case 5:
-        _motorMoveDelay = 4000;
-        break;
+        long move = _shortestMove(position, targetPosition);
+        _moveForward = move > 0;
+        steps = _moveForward ? move : -move;
     }
+    else
+    {
+        _moveForward = targetPosition > position;
+        steps = _moveForward ? targetPosition - position : position - targetPosition;
+    }
+
+    MotorDriver::setDirection(_moveForward, _eeprom->getReverseDirection());
+
+    MotionPlan plan;
+    MotionPlanner::plan(
+        steps,
+        speedMode,
+        _eeprom->getStepMode(),
+        plan);
 
-    _motorMoveDelay /= _eeprom->getStepMode();
+    // steps are emitted by the timer interrupt, handleMotor only follows the progress
+    _stepGenerator.start(plan, _moveForward);
 }
 
 void Motor::_stopMotor()
 {
+    if (_motorIsMoving)
+    {
+        _stepGenerator.stop();
+        _syncPosition();
+    }
+
     _lastMoveFinishedMs = millis();
     _motorIsMoving = false;
+    _isDerotating = false;
     _eeprom->setTargetPosition(_eeprom->getPosition());
+
+    // homing marks the position trusted once home is found
+    if (!_eeprom->isHoming())
+        _eeprom->setPositionTrusted(true);
+}
+
+void Motor::_startDerotation(unsigned long intervalHundredthsMs, bool forward)
+{
+    if (_motorIsMoving)
+    {
+        _stepGenerator.stop();
+        _syncPosition();
+    }
+
+    unsigned long position = _eeprom->getPosition();
+    unsigned long steps;
+
+    // runs until halted, a new move or the end of the axis
+    if (ROTATOR_MODULAR_AXIS && ROTATOR_CABLE_WRAP_DEG > 0)
+    {
+        long limit = (long)((unsigned long)ROTATOR_CABLE_WRAP_DEG * this->getStepsPerRevolution() / 360UL);
+        long left = forward ? limit - _cableWrapSteps : limit + _cableWrapSteps;
+        steps = left > 0 ? left : 0;
+    }
+    else if (ROTATOR_MODULAR_AXIS)
+    {
+        steps = 0xFFFFFFFFUL;
+    }
+    else
+    {
+        unsigned long maxPosition = _eeprom->getMaxPosition();
+        steps = forward ? (maxPosition > position ? maxPosition - position : 0) : position;
+    }
+
+    _motorIsMoving = true;
+    _isDerotating = true;
+    _eeprom->setPositionTrusted(false);
+    _moveStartPosition = position;
+    _moveCableWrapStart = _cableWrapSteps;
+    _moveForward = forward;
+
+    MotorDriver::setDirection(_moveForward, _eeprom->getReverseDirection());
+
+    MotionPlan plan;
+    MotionPlanner::planConstant(steps, intervalHundredthsMs, plan);
+
+    _stepGenerator.start(plan, _moveForward);
+}
+
+void Motor::_syncPosition()
+{
+    unsigned long stepsDone = _stepGenerator.getStepsDone();
+    unsigned long position = _moveForward ? _moveStartPosition + stepsDone : _moveStartPosition - stepsDone;
+
+    _cableWrapSteps = _moveForward ? _moveCableWrapStart + (long)stepsDone : _moveCableWrapStart - (long)stepsDone;
+
+    if (ROTATOR_MODULAR_AXIS)
+    {
+        long stepsPerRevolution = this->getStepsPerRevolution();
+        long wrapped = ((long)position) % stepsPerRevolution;
+        if (wrapped < 0)
+            wrapped += stepsPerRevolution;
+
+        position = wrapped;
+    }
+
+    if (position != _eeprom->getPosition())
+    {
+        _eeprom->setPosition(position);
+    }
+}
+
+long Motor::_shortestMove(unsigned long position, unsigned long targetPosition)
+{
+    long stepsPerRevolution = this->getStepsPerRevolution();
+    long move = (long)(targetPosition % stepsPerRevolution) - (long)(position % stepsPerRevolution);
+
+    if (move > stepsPerRevolution / 2)
+        move -= stepsPerRevolution;
+    else if (move < -stepsPerRevolution / 2)
+        move += stepsPerRevolution;
+
+    if (ROTATOR_CABLE_WRAP_DEG > 0 && !_eeprom->isHoming())
+    {
+        long limit = (long)((unsigned long)ROTATOR_CABLE_WRAP_DEG * stepsPerRevolution / 360UL);
+        long wrap = _cableWrapSteps + move;
+
+        if (wrap > limit || wrap < -limit)
+        {
+            // the other way around unwinds the cable, the target is out of reach if that exceeds it too
+            long alternative = move > 0 ? move - stepsPerRevolution : move + stepsPerRevolution;
+            long alternativeWrap = _cableWrapSteps + alternative;
+
+            move = alternativeWrap <= limit && alternativeWrap >= -limit ? alternative : 0;
+        }
+    }
+
+    return move;
 }
 
 void Motor::_applyStepMode()
 {
-    unsigned short sm = _eeprom->getStepMode();
-    // select microsteps (0,2,4,8,16,32,64,128,256)
-    _tmcDriver.microsteps(sm == 1 ? 0 : sm);
+    MotorDriver::applyStepMode(_eeprom->getStepMode());
 }
 
 void Motor::_applyStepModeManual()
 {
-    unsigned short sm = _eeprom->getStepModeManual();
-    // select microsteps (0,2,4,8,16,32,64,128,256)
-    _tmcDriver.microsteps(sm == 1 ? 0 : sm);
+    MotorDriver::applyStepMode(_eeprom->getStepModeManual());
 }
 
 void Motor::_applyMotorCurrent()
 {
-    _motorI = MOTOR_I;
-
-    int mA = _motorI * (((float)_eeprom->getMotorIMoveMultiplier()) / 100.0);
-    float multiplier = ((float)_eeprom->getMotorIHoldMultiplier()) / 100.0;
-
-    _tmcDriver.rms_current(mA, multiplier * 0.8);
+    MotorDriver::applyMotorCurrent(_eeprom->getMotorIMoveMultiplier(), _eeprom->getMotorIHoldMultiplier());
 }
 
 bool Motor::init(CustomEEPROM &eeprom)
@@ -65,53 +180,18 @@ bool Motor::init(CustomEEPROM &eeprom)
 
     if (!_pinsInitialized)
     {
-        pinMode(TMC220X_PIN_DIR, OUTPUT);
-        pinMode(TMC220X_PIN_STEP, OUTPUT);
-        pinMode(TMC220X_PIN_MS1, OUTPUT);
-        pinMode(TMC220X_PIN_MS2, OUTPUT);
-        pinMode(TMC220X_PIN_ENABLE, OUTPUT);
-
-        digitalWrite(TMC220X_PIN_DIR, LOW);
-        digitalWrite(TMC220X_PIN_STEP, LOW);
-        digitalWrite(TMC220X_PIN_ENABLE, HIGH);
+        MotorDriver::initPins();
         _pinsInitialized = true;
     }
 
-    if (MOTOR_DRIVER == "TMC220X")
-    {
-        _tmcDriver.begin();
-
-        int testConnection;
-        for (int i = 0; i < 5; i++)
-        {
-            testConnection = _tmcDriver.test_connection();
-            if (testConnection == 0)
-                break;
-        }
+    if (!MotorDriver::begin())
+        return false;
 
-        if (testConnection != 0)
-            return false;
-
-        _tmcDriver.pdn_disable(true); // enable UART
-        _applyMotorCurrent();
-        _tmcDriver.mstep_reg_select(true); // enable microstep selection over UART
-        _tmcDriver.I_scale_analog(false);  // disable Vref scaling
-        _applyStepMode();
-        _tmcDriver.blank_time(24);             // Comparator blank time. This time needs to safely cover the switching event and the duration of the ringing on the sense resistor. Choose a setting of 24 or 32 for typical applications. For higher capacitive loads, 3 may be required. Lower settings allow stealthChop to regulate down to lower coil current values.
-        _tmcDriver.toff(5);                    // enable stepper driver (For operation with stealthChop, this parameter is not used, but >0 is required to enable the motor)
-        _tmcDriver.intpol(true);               // use interpolation
-        _tmcDriver.TPOWERDOWN(255);            // time until current reduction after the motor stops. Use maximum (5.6s)
-        digitalWrite(TMC220X_PIN_ENABLE, LOW); // enable coils
-
-        _uartInitialized = true;
-    }
-    else if (MOTOR_DRIVER == "ULN2003")
-    {
-        _ulnDriver.setRpm(ULN2003_MOTOR_RPM);
-        _ulnDriver.setTotalSteps(ULN2003_STEPS_PER_REVOLUTION);
+    MotorDriver::configure(_eeprom->getStepMode(), _eeprom->getMotorIMoveMultiplier(), _eeprom->getMotorIHoldMultiplier());
+    MotorDriver::enable();
 
-        _uartInitialized = true;
-    }
+    _stepGenerator.init();
+    _uartInitialized = true;
 
     return true;
 }
@@ -123,52 +203,16 @@ bool Motor::isUartInitialized()
 
 bool Motor::handleMotor()
 {
+    TelemetryScope telemetry(TELEMETRY_TIMER_MOTOR);
+
     if (_motorIsMoving)
     {
-        // give priority to motor with dedicated 50ms loops (effectivly pausing main loop, including serial event processing)
-        while (millis() - _debouncingLastRunMs < 50)
+        _syncPosition();
+
+        if (!_stepGenerator.isRunning())
         {
-            if (_eeprom->getTargetPosition() < _eeprom->getPosition())
-            {
-                if (MOTOR_DRIVER == "TMC220X")
-                {
-                    digitalWrite(TMC220X_PIN_DIR, _eeprom->getReverseDirection() ? HIGH : LOW);
-                    digitalWrite(TMC220X_PIN_STEP, HIGH);
-                    delayMicroseconds(1);
-                    digitalWrite(TMC220X_PIN_STEP, LOW);
-                }
-                else if (MOTOR_DRIVER == "ULN2003")
-                {
-                    _ulnDriver.stepCCW();
-                }
-
-                _eeprom->setPosition(_eeprom->getPosition() - 1);
-                delayMicroseconds(_motorMoveDelay);
-            }
-            else if (_eeprom->getTargetPosition() > _eeprom->getPosition())
-            {
-                if (MOTOR_DRIVER == "TMC220X")
-                {
-                    digitalWrite(TMC220X_PIN_DIR, _eeprom->getReverseDirection() ? LOW : HIGH);
-                    digitalWrite(TMC220X_PIN_STEP, HIGH);
-                    delayMicroseconds(1);
-                    digitalWrite(TMC220X_PIN_STEP, LOW);
-                }
-                else if (MOTOR_DRIVER == "ULN2003")
-                {
-                    _ulnDriver.stepCW();
-                }
-
-                _eeprom->setPosition(_eeprom->getPosition() + 1);
-                delayMicroseconds(_motorMoveDelay);
-            }
-            else
-            {
-                _stopMotor();
-            }
+            _stopMotor();
         }
-
-        _debouncingLastRunMs = millis();
     }
 
     return _motorIsMoving;
@@ -176,7 +220,12 @@ bool Motor::handleMotor()
 
 void Motor::startMotor()
 {
-    _startMotor();
+    _startMotor(_eeprom->getSpeedMode());
+}
+
+void Motor::startMotor(unsigned char speedMode)
+{
+    _startMotor(speedMode);
 }
 
 void Motor::stopMotor()
@@ -184,6 +233,26 @@ void Motor::stopMotor()
     _stopMotor();
 }
 
+bool Motor::halt()
+{
+    // aborts homing, the position stays untrusted until homing runs again
+    if (_eeprom->isHoming())
+        _eeprom->abortHoming();
+
+    if (!_motorIsMoving)
+        return false;
+
+    // handleMotor stops the motor once the deceleration ran out
+    _stepGenerator.decelerate();
+
+    return true;
+}
+
+void Motor::startDerotation(unsigned long intervalHundredthsMs, bool forward)
+{
+    _startDerotation(intervalHundredthsMs, forward);
+}
+
 void Motor::applyStepMode()
 {
     _applyStepMode();
@@ -207,7 +276,52 @@ long Motor::getLastMoveFinishedMs()
     return ms;
 }
 
+unsigned long Motor::getStepsPerRevolution()
+{
+    // steps per 360 deg of the rotator
+    return this->getStepConverter().getStepsPerRevolution();
+}
+
+StepConverter &Motor::getStepConverter()
+{
+    // no-op unless the step mode or the gearing changed since the last call
+    _stepConverter.configure(
+        MotorDriver::getStepsPerRevolution(_eeprom->getStepMode()),
+        _eeprom->getRotatorGearTeeth(),
+        _eeprom->getMotorGearTeeth());
+
+    return _stepConverter;
+}
+
+void Motor::resetCableWrap()
+{
+    _cableWrapSteps = 0L;
+}
+
+bool Motor::isReachable(unsigned long targetPosition)
+{
+    // only a cable wrap limit rules targets out, checked from the position reached so far
+    if (!ROTATOR_MODULAR_AXIS || ROTATOR_CABLE_WRAP_DEG == 0)
+        return true;
+
+    if (_motorIsMoving)
+        _syncPosition();
+
+    if (targetPosition > _eeprom->getMaxPosition())
+        targetPosition = _eeprom->getMaxPosition();
+
+    unsigned long position = _eeprom->getPosition();
+    unsigned long stepsPerRevolution = this->getStepsPerRevolution();
+
+    return targetPosition % stepsPerRevolution == position % stepsPerRevolution || _shortestMove(position, targetPosition) != 0;
+}
+
 bool Motor::isMoving()
 {
     return _motorIsMoving;
 }
+
+bool Motor::isDerotating()
+{
+    return _isDerotating;
+}
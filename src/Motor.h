@@ -1,45 +1,26 @@
-#include <CheapStepper.h>
-#include <TMCStepper.h>
 #include "CustomEEPROM.h"
+#include "MotionPlanner.h"
+#include "MotorDriver.h"
+#include "StepConverter.h"
+#include "StepGenerator.h"
 
 #pragma once
-#define TMC220X_PIN_ENABLE 9
-#define TMC220X_PIN_DIR 2
-#define TMC220X_PIN_STEP 3
-#define TMC220X_PIN_MS2 7
-#define TMC220X_PIN_MS1 8
-#define TMC220X_PIN_UART_RX 11
-#define TMC220X_PIN_UART_TX 12
-
-#define ULN2003_PIN_IN1 8
-#define ULN2003_PIN_IN2 9
-#define ULN2003_PIN_IN3 10
-#define ULN2003_PIN_IN4 11
-
-/**
- * accepted RPM range: 6RPM (may overheat) - 24RPM (may skip)
- * ideal range: 10RPM (safe, high torque) - 22RPM (fast, low torque)
- */
-#define ULN2003_MOTOR_RPM 10
-
-/**
- * You can change ULN2003_STEPS_PER_REVOLUTION if you think your motor
- * is geared 63.68395:1 (measured) rather than 64:1 (default)
- * which would make the total steps 4076 (rather than default 4096)
- * for more info see: http://forum.arduino.cc/index.php?topic=71964.15
- */
-#define ULN2003_STEPS_PER_REVOLUTION_DEFAULT 4096
-#define ULN2003_STEPS_PER_REVOLUTION_MEASURED 4076
-#define ULN2003_STEPS_PER_REVOLUTION ULN2003_STEPS_PER_REVOLUTION_DEFAULT
 
 /**
- * Motor driver types:
- * - TMC220X
- * - ULN2003
+ * Modular rotator axis: positions are kept modulo one revolution of the rotator
+ * and every move takes the shorter way around (359 deg -> 1 deg turns 2 deg).
+ * ROTATOR_CABLE_WRAP_DEG limits how far the axis may wind up from home in either
+ * direction, the longer way around is taken when the shorter one would exceed it
+ * and a move exceeding it both ways is refused (0 = no limit). Both can be set
+ * in build_flags, e.g. -D ROTATOR_MODULAR_AXIS=1 -D ROTATOR_CABLE_WRAP_DEG=270.
  */
-const String MOTOR_DRIVER = "ULN2003";
+#ifndef ROTATOR_MODULAR_AXIS
+#define ROTATOR_MODULAR_AXIS 0
+#endif
 
-#define MOTOR_I 500
+#ifndef ROTATOR_CABLE_WRAP_DEG
+#define ROTATOR_CABLE_WRAP_DEG 0
+#endif
 
 class Motor
 {
@@ -47,28 +28,41 @@ private:
     CustomEEPROM *_eeprom;
     bool _pinsInitialized = false;
     bool _uartInitialized = false;
-    long _motorI;
     bool _motorIsMoving;
-    unsigned long _debouncingLastRunMs = 0L;
+    bool _isDerotating = false;
     unsigned long _lastMoveFinishedMs = 0L;
-    long _motorMoveDelay;
-    TMC2208Stepper _tmcDriver = TMC2208Stepper(TMC220X_PIN_UART_RX, TMC220X_PIN_UART_TX, 0.11);
-    CheapStepper _ulnDriver = CheapStepper(ULN2003_PIN_IN1, ULN2003_PIN_IN2, ULN2003_PIN_IN3, ULN2003_PIN_IN4);
-    void _startMotor();
+    unsigned long _moveStartPosition = 0L;
+    bool _moveForward = true;
+    long _cableWrapSteps = 0L;
+    long _moveCableWrapStart = 0L;
+    StepGenerator _stepGenerator;
+    StepConverter _stepConverter;
+    void _startMotor(unsigned char speedMode);
     void _stopMotor();
+    void _startDerotation(unsigned long intervalHundredthsMs, bool forward);
     void _applyStepMode();
     void _applyStepModeManual();
     void _applyMotorCurrent();
+    void _syncPosition();
+    long _shortestMove(unsigned long position, unsigned long targetPosition);
 
 public:
     bool init(CustomEEPROM &eeprom);
     bool isUartInitialized();
     bool handleMotor();
     void startMotor();
+    void startMotor(unsigned char speedMode);
     void stopMotor();
+    bool halt();
+    void startDerotation(unsigned long intervalHundredthsMs, bool forward);
     void applyStepMode();
     void applyStepModeManual();
     void applyMotorCurrent();
     long getLastMoveFinishedMs();
+    unsigned long getStepsPerRevolution();
+    StepConverter &getStepConverter();
+    void resetCableWrap();
+    bool isReachable(unsigned long targetPosition);
     bool isMoving();
+    bool isDerotating();
 };
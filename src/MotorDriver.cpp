@@ -0,0 +1,172 @@
+#include <Arduino.h>
+#include "MotorDriver.h"
+
+#if MOTOR_DRIVER == MOTOR_DRIVER_TMC220X
+
+TMC2208Stepper Tmc220xDriver::_driver = TMC2208Stepper(TMC220X_PIN_UART_RX, TMC220X_PIN_UART_TX, TMC220X_R_SENSE);
+int8_t Tmc220xDriver::_direction = LOW;
+uint32_t Tmc220xDriver::_gconf = TMC220X_GCONF;
+uint32_t Tmc220xDriver::_chopconf = TMC220X_CHOPCONF_DEFAULT;
+uint32_t Tmc220xDriver::_iholdIrun = TMC220X_IHOLD_IRUN_DEFAULT;
+uint8_t Tmc220xDriver::_shadowValid = 0;
+
+void Tmc220xDriver::initPins()
+{
+    FastPin<TMC220X_PIN_DIR>::output();
+    FastPin<TMC220X_PIN_STEP>::output();
+    FastPin<TMC220X_PIN_MS1>::output();
+    FastPin<TMC220X_PIN_MS2>::output();
+    FastPin<TMC220X_PIN_ENABLE>::output();
+
+    FastPin<TMC220X_PIN_DIR>::low();
+    FastPin<TMC220X_PIN_STEP>::low();
+    FastPin<TMC220X_PIN_ENABLE>::high();
+    _direction = LOW;
+}
+
+bool Tmc220xDriver::_updateShadow(uint8_t shadow, uint32_t &value, uint32_t newValue)
+{
+    // true when the register has to be written
+    if ((_shadowValid & shadow) && value == newValue)
+        return false;
+
+    value = newValue;
+    _shadowValid |= shadow;
+
+    return true;
+}
+
+void Tmc220xDriver::_writeChopconf(uint32_t value)
+{
+    if (_updateShadow(TMC220X_SHADOW_CHOPCONF, _chopconf, value))
+        _driver.CHOPCONF(value);
+}
+
+void Tmc220xDriver::_writeIholdIrun(uint32_t value)
+{
+    if (_updateShadow(TMC220X_SHADOW_IHOLD_IRUN, _iholdIrun, value))
+        _driver.IHOLD_IRUN(value);
+}
+
+void Tmc220xDriver::_composeStepMode(uint32_t &chopconf, unsigned short stepMode)
+{
+    // microsteps 256 -> MRES 0 ... 2 -> 7, 1 (full step) -> 8
+    uint32_t mres = 8;
+    for (unsigned short microsteps = 1; microsteps < stepMode && mres > 0; microsteps <<= 1)
+        mres--;
+
+    chopconf = (chopconf & ~TMC220X_CHOPCONF_MRES_MASK) | (mres << TMC220X_CHOPCONF_MRES_SHIFT);
+}
+
+void Tmc220xDriver::_composeMotorCurrent(uint32_t &chopconf, uint32_t &iholdIrun, unsigned char moveMultiplier, unsigned char holdMultiplier)
+{
+    // same scaling as rms_current() of TMCStepper, the low sense voltage range below CS 16
+    float mA = MOTOR_I * (((float)moveMultiplier) / 100.0);
+    float multiplier = ((float)holdMultiplier) / 100.0 * 0.8;
+
+    uint8_t cs = 32.0 * 1.41421 * mA / 1000.0 * (TMC220X_R_SENSE + 0.02) / 0.325 - 1;
+    bool vsense = cs < 16;
+    if (vsense)
+        cs = 32.0 * 1.41421 * mA / 1000.0 * (TMC220X_R_SENSE + 0.02) / 0.180 - 1;
+
+    if (cs > 31)
+        cs = 31;
+
+    uint8_t ihold = cs * multiplier;
+
+    chopconf = vsense ? chopconf | TMC220X_CHOPCONF_VSENSE : chopconf & ~TMC220X_CHOPCONF_VSENSE;
+    iholdIrun = (iholdIrun & ~0x1F1FUL) | ((uint32_t)cs << TMC220X_IRUN_SHIFT) | ihold;
+}
+
+bool Tmc220xDriver::begin()
+{
+    _driver.begin();
+
+    int testConnection;
+    for (int i = 0; i < 5; i++)
+    {
+        testConnection = _driver.test_connection();
+        if (testConnection == 0)
+            break;
+    }
+
+    if (testConnection != 0)
+        return false;
+
+    // the driver may have been reset, every register is written once more
+    _shadowValid = 0;
+
+    // UART enabled, microsteps selected over UART, no Vref scaling
+    if (_updateShadow(TMC220X_SHADOW_GCONF, _gconf, TMC220X_GCONF))
+        _driver.GCONF(_gconf);
+
+    // blank time has to cover the switching event and the ringing on the sense resistor, 24 or 32 for typical applications.
+    // Only kept in the shadow: the shadow is invalid, the next CHOPCONF write sends it along with MRES and vsense
+    _chopconf = (_chopconf & ~TMC220X_CHOPCONF_TOFF_MASK & ~(3UL << TMC220X_CHOPCONF_TBL_SHIFT)) |
+                TMC220X_CHOPCONF_TOFF | (TMC220X_CHOPCONF_TBL << TMC220X_CHOPCONF_TBL_SHIFT);
+
+    _driver.TPOWERDOWN(TMC220X_TPOWERDOWN);
+
+    return true;
+}
+
+void Tmc220xDriver::enable()
+{
+    FastPin<TMC220X_PIN_ENABLE>::low(); // enable coils
+}
+
+void Tmc220xDriver::configure(unsigned short stepMode, unsigned char moveMultiplier, unsigned char holdMultiplier)
+{
+    // every field at once: one CHOPCONF and one IHOLD_IRUN datagram at most
+    uint32_t chopconf = _chopconf;
+    uint32_t iholdIrun = _iholdIrun;
+    _composeStepMode(chopconf, stepMode);
+    _composeMotorCurrent(chopconf, iholdIrun, moveMultiplier, holdMultiplier);
+
+    _writeChopconf(chopconf);
+    _writeIholdIrun(iholdIrun);
+}
+
+void Tmc220xDriver::applyStepMode(unsigned short stepMode)
+{
+    uint32_t chopconf = _chopconf;
+    _composeStepMode(chopconf, stepMode);
+
+    _writeChopconf(chopconf);
+}
+
+void Tmc220xDriver::applyMotorCurrent(unsigned char moveMultiplier, unsigned char holdMultiplier)
+{
+    uint32_t chopconf = _chopconf;
+    uint32_t iholdIrun = _iholdIrun;
+    _composeMotorCurrent(chopconf, iholdIrun, moveMultiplier, holdMultiplier);
+
+    _writeChopconf(chopconf);
+    _writeIholdIrun(iholdIrun);
+}
+
+#elif MOTOR_DRIVER == MOTOR_DRIVER_ULN2003
+
+// IN1-IN4 as bits 0-3, same half step sequence as CheapStepper
+const uint8_t Uln2003Driver::_sequence[8] = {0x01, 0x03, 0x02, 0x06, 0x04, 0x0C, 0x08, 0x09};
+uint8_t Uln2003Driver::_phase = 0;
+
+void Uln2003Driver::initPins()
+{
+    FastPin<ULN2003_PIN_IN1>::output();
+    FastPin<ULN2003_PIN_IN2>::output();
+    FastPin<ULN2003_PIN_IN3>::output();
+    FastPin<ULN2003_PIN_IN4>::output();
+
+    FastPin<ULN2003_PIN_IN1>::low();
+    FastPin<ULN2003_PIN_IN2>::low();
+    FastPin<ULN2003_PIN_IN3>::low();
+    FastPin<ULN2003_PIN_IN4>::low();
+}
+
+bool Uln2003Driver::begin()
+{
+    return true;
+}
+
+#endif
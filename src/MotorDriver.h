@@ -0,0 +1,168 @@
+#include <Arduino.h>
+#include "FastGpio.h"
+
+#pragma once
+
+/**
+ * Motor driver types, select one with MOTOR_DRIVER
+ * (or -D MOTOR_DRIVER=MOTOR_DRIVER_TMC220X in build_flags):
+ * - MOTOR_DRIVER_TMC220X
+ * - MOTOR_DRIVER_ULN2003
+ *
+ * The driver is resolved at compile time, the step path of the
+ * selected backend is inlined into the step interrupt and the
+ * library of the other backend is not linked.
+ */
+#define MOTOR_DRIVER_TMC220X 1
+#define MOTOR_DRIVER_ULN2003 2
+
+#ifndef MOTOR_DRIVER
+#define MOTOR_DRIVER MOTOR_DRIVER_ULN2003
+#endif
+
+#define TMC220X_PIN_ENABLE 9
+#define TMC220X_PIN_DIR 2
+#define TMC220X_PIN_STEP 3
+#define TMC220X_PIN_MS2 7
+#define TMC220X_PIN_MS1 8
+#define TMC220X_PIN_UART_RX 11
+#define TMC220X_PIN_UART_TX 12
+#define TMC220X_STEPS_PER_REVOLUTION 400
+
+#define ULN2003_PIN_IN1 8
+#define ULN2003_PIN_IN2 9
+#define ULN2003_PIN_IN3 10
+#define ULN2003_PIN_IN4 11
+
+/**
+ * You can change ULN2003_STEPS_PER_REVOLUTION if you think your motor
+ * is geared 63.68395:1 (measured) rather than 64:1 (default)
+ * which would make the total steps 4076 (rather than default 4096)
+ * for more info see: http://forum.arduino.cc/index.php?topic=71964.15
+ */
+#define ULN2003_STEPS_PER_REVOLUTION_DEFAULT 4096
+#define ULN2003_STEPS_PER_REVOLUTION_MEASURED 4076
+#define ULN2003_STEPS_PER_REVOLUTION ULN2003_STEPS_PER_REVOLUTION_DEFAULT
+
+#define MOTOR_I 500
+
+/**
+ * TMC2208 registers are composed here and written whole. The last value
+ * written to GCONF, CHOPCONF and IHOLD_IRUN is kept, a register is only
+ * sent over the slow single wire UART when it changes, so a move with an
+ * unchanged step mode costs no transaction and fields changing together
+ * cost one. begin() forgets the shadow, the driver may have lost power,
+ * and configure() composes toff, tbl, MRES and vsense into one CHOPCONF.
+ * CHOPCONF and IHOLD_IRUN start from the reset values of the TMC2208.
+ */
+#define TMC220X_R_SENSE 0.11
+#define TMC220X_GCONF 0x000001C0UL              // pdn_disable, mstep_reg_select, multistep_filt, no I_scale_analog
+#define TMC220X_CHOPCONF_DEFAULT 0x10000053UL   // intpol, hstrt 5, toff 3
+#define TMC220X_CHOPCONF_TOFF_MASK 0x0000000FUL
+#define TMC220X_CHOPCONF_TOFF 5UL               // > 0 enables the driver
+#define TMC220X_CHOPCONF_TBL_SHIFT 15
+#define TMC220X_CHOPCONF_TBL 1UL                // comparator blank time of 24 clocks
+#define TMC220X_CHOPCONF_VSENSE (1UL << 17)
+#define TMC220X_CHOPCONF_MRES_SHIFT 24
+#define TMC220X_CHOPCONF_MRES_MASK (0x0FUL << TMC220X_CHOPCONF_MRES_SHIFT)
+#define TMC220X_IHOLD_IRUN_DEFAULT 0x00011F10UL // iholddelay 1, irun 31, ihold 16
+#define TMC220X_IRUN_SHIFT 8
+#define TMC220X_TPOWERDOWN 255                  // time until current reduction after the motor stops, maximum (5.6s)
+
+#define TMC220X_SHADOW_GCONF 0x01
+#define TMC220X_SHADOW_CHOPCONF 0x02
+#define TMC220X_SHADOW_IHOLD_IRUN 0x04
+
+#if MOTOR_DRIVER == MOTOR_DRIVER_TMC220X
+#include <TMCStepper.h>
+
+class Tmc220xDriver
+{
+private:
+    static TMC2208Stepper _driver;
+    static int8_t _direction;
+    static uint32_t _gconf;
+    static uint32_t _chopconf;
+    static uint32_t _iholdIrun;
+    static uint8_t _shadowValid;
+    static bool _updateShadow(uint8_t shadow, uint32_t &value, uint32_t newValue);
+    static void _writeChopconf(uint32_t value);
+    static void _writeIholdIrun(uint32_t value);
+    static void _composeStepMode(uint32_t &chopconf, unsigned short stepMode);
+    static void _composeMotorCurrent(uint32_t &chopconf, uint32_t &iholdIrun, unsigned char moveMultiplier, unsigned char holdMultiplier);
+
+public:
+    static void initPins();
+    static bool begin();
+    static void enable();
+    static void configure(unsigned short stepMode, unsigned char moveMultiplier, unsigned char holdMultiplier);
+    static void applyStepMode(unsigned short stepMode);
+    static void applyMotorCurrent(unsigned char moveMultiplier, unsigned char holdMultiplier);
+
+    static unsigned long getStepsPerRevolution(unsigned short stepMode)
+    {
+        return TMC220X_STEPS_PER_REVOLUTION * (unsigned long)stepMode;
+    }
+
+    static void setDirection(bool forward, bool reverseDirection)
+    {
+        int8_t direction = forward != reverseDirection ? HIGH : LOW;
+        if (direction == _direction)
+            return;
+
+        FastPin<TMC220X_PIN_DIR>::write(direction);
+        _direction = direction;
+    }
+
+    static void step(bool)
+    {
+        // STEP high time has to be at least 100ns
+        FastPin<TMC220X_PIN_STEP>::high();
+        __asm__ __volatile__("nop\n\tnop");
+        FastPin<TMC220X_PIN_STEP>::low();
+    }
+};
+
+typedef Tmc220xDriver MotorDriver;
+
+#elif MOTOR_DRIVER == MOTOR_DRIVER_ULN2003
+
+class Uln2003Driver
+{
+private:
+    static const uint8_t _sequence[8];
+    static uint8_t _phase;
+
+public:
+    static void initPins();
+    static bool begin();
+    static void enable() {}
+    static void configure(unsigned short, unsigned char, unsigned char) {}
+    static void applyStepMode(unsigned short) {}
+    static void applyMotorCurrent(unsigned char, unsigned char) {}
+
+    static unsigned long getStepsPerRevolution(unsigned short)
+    {
+        return ULN2003_STEPS_PER_REVOLUTION;
+    }
+
+    static void setDirection(bool, bool) {}
+
+    static void step(bool forward)
+    {
+        // half step sequence, one coil pattern per step
+        _phase = (forward ? _phase + 1 : _phase - 1) & 7;
+        uint8_t coils = _sequence[_phase];
+
+        FastPin<ULN2003_PIN_IN1>::write(coils & 0x01);
+        FastPin<ULN2003_PIN_IN2>::write(coils & 0x02);
+        FastPin<ULN2003_PIN_IN3>::write(coils & 0x04);
+        FastPin<ULN2003_PIN_IN4>::write(coils & 0x08);
+    }
+};
+
+typedef Uln2003Driver MotorDriver;
+
+#else
+#error "Unsupported MOTOR_DRIVER"
+#endif
@@ -0,0 +1,81 @@
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include "ResponseFormatter.h"
+
+#define RESPONSE_FORMATTER_MAX_POSITION 9 // 10^9 is the largest power of ten in an unsigned long
+
+// digits are produced by repeated subtraction, the AVR has no divide instruction
+static const unsigned long POWERS_OF_TEN[RESPONSE_FORMATTER_MAX_POSITION] PROGMEM = {
+    1000000000UL, 100000000UL, 10000000UL, 1000000UL, 100000UL, 10000UL, 1000UL, 100UL, 10UL};
+
+char *ResponseFormatter::_writeDigits(char *out, unsigned long value, unsigned char decimals)
+{
+    bool isLeading = true;
+
+    for (unsigned char i = 0; i < RESPONSE_FORMATTER_MAX_POSITION; i++)
+    {
+        unsigned char position = RESPONSE_FORMATTER_MAX_POSITION - i;
+        unsigned long power = pgm_read_dword(&POWERS_OF_TEN[i]);
+        char digit = '0';
+
+        while (value >= power)
+        {
+            value -= power;
+            digit++;
+        }
+
+        // the integer part keeps at least one digit, like "0.05"
+        if (isLeading && digit == '0' && position > decimals)
+            continue;
+
+        isLeading = false;
+        *out++ = digit;
+
+        if (position == decimals)
+            *out++ = '.';
+    }
+
+    *out++ = '0' + value;
+    *out = '\0';
+
+    return out;
+}
+
+char *ResponseFormatter::writeText(char *out, const char *text)
+{
+    while (*text)
+        *out++ = *text++;
+
+    *out = '\0';
+
+    return out;
+}
+
+char *ResponseFormatter::writeChar(char *out, char c)
+{
+    *out++ = c;
+    *out = '\0';
+
+    return out;
+}
+
+char *ResponseFormatter::writeFlag(char *out, bool value)
+{
+    return writeChar(out, value ? '1' : '0');
+}
+
+char *ResponseFormatter::writeUnsigned(char *out, unsigned long value)
+{
+    return _writeDigits(out, value, 0);
+}
+
+char *ResponseFormatter::writeFixed2(char *out, long hundredths)
+{
+    if (hundredths < 0)
+    {
+        *out++ = '-';
+        hundredths = -hundredths;
+    }
+
+    return _writeDigits(out, hundredths, 2);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+/**
+ * Integer only formatting of command replies, written straight into the
+ * reply buffer. Replaces sprintf and dtostrf, which pull vfprintf and the
+ * soft float formatter into every poll. Every method writes at the given
+ * position, terminates the string and returns the position of the
+ * terminator, so calls can be chained.
+ */
+class ResponseFormatter
+{
+private:
+    static char *_writeDigits(char *out, unsigned long value, unsigned char decimals);
+
+public:
+    static char *writeText(char *out, const char *text);
+    static char *writeChar(char *out, char c);
+    static char *writeFlag(char *out, bool value);
+    static char *writeUnsigned(char *out, unsigned long value);
+    static char *writeFixed2(char *out, long hundredths);
+};
@@ -0,0 +1,166 @@
+#include <Arduino.h>
+#include <util/atomic.h>
+#include "Scheduler.h"
+
+unsigned char Scheduler::add(SchedulerCallback callback, unsigned char priority, unsigned int periodMs, unsigned long deadlineUs)
+{
+    if (_taskCount >= SCHEDULER_MAX_TASKS)
+        return SCHEDULER_INVALID_TASK;
+
+    unsigned char id = _taskCount;
+    SchedulerTask &task = _tasks[id];
+
+    task.callback = callback;
+    task.priority = priority;
+    task.periodMs = periodMs;
+    task.deadlineUs = deadlineUs;
+    task.releaseUs = micros();
+    task.isSignaled = false;
+    task.isSuspended = false;
+    _taskCount++;
+
+    // keep the run order sorted by priority, equal priorities run in the order they were added
+    unsigned char i = id;
+    while (i > 0 && _tasks[_order[i - 1]].priority > priority)
+    {
+        _order[i] = _order[i - 1];
+        i--;
+    }
+    _order[i] = id;
+
+    this->resetStatistics();
+
+    return id;
+}
+
+bool Scheduler::_isReady(SchedulerTask &task, unsigned long now)
+{
+    if (task.isSuspended)
+        return false;
+
+    switch (task.periodMs)
+    {
+    case SCHEDULER_CONTINUOUS:
+        return true;
+
+    case SCHEDULER_EVENT:
+        return task.isSignaled;
+
+    default:
+        return now - task.releaseUs >= (unsigned long)task.periodMs * 1000UL;
+    }
+}
+
+void Scheduler::_runTask(SchedulerTask &task, unsigned long now)
+{
+    unsigned long releaseUs;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        releaseUs = task.releaseUs;
+        task.isSignaled = false;
+    }
+
+    bool isBehind = false;
+    if (task.periodMs != SCHEDULER_CONTINUOUS && task.periodMs != SCHEDULER_EVENT)
+    {
+        // the period elapsed at release + period, later passes do not shift the grid
+        releaseUs += (unsigned long)task.periodMs * 1000UL;
+        task.releaseUs = releaseUs;
+
+        // more than one period behind: the missed runs are dropped, not made up
+        isBehind = now - releaseUs >= (unsigned long)task.periodMs * 1000UL;
+        if (isBehind)
+            task.releaseUs = now;
+    }
+
+    // one overrun per late run, however late it is
+    unsigned long latency = now - releaseUs;
+    if (latency > task.maxLatencyUs)
+        task.maxLatencyUs = latency;
+    if (isBehind || latency > task.deadlineUs)
+        task.overruns++;
+
+    task.callback();
+
+    unsigned long end = micros();
+    unsigned long runTime = end - now;
+    if (runTime > task.maxRunUs)
+        task.maxRunUs = runTime;
+    task.runs++;
+
+    if (task.periodMs == SCHEDULER_CONTINUOUS)
+        task.releaseUs = end;
+}
+
+void Scheduler::run()
+{
+    for (unsigned char i = 0; i < _taskCount; i++)
+    {
+        SchedulerTask &task = _tasks[_order[i]];
+        unsigned long now = micros();
+
+        if (this->_isReady(task, now))
+            this->_runTask(task, now);
+    }
+}
+
+void Scheduler::signal(unsigned char id)
+{
+    if (id >= _taskCount)
+        return;
+
+    SchedulerTask &task = _tasks[id];
+
+    // a pending signal keeps its release time, the latency counts from the first one
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (!task.isSignaled)
+        {
+            task.releaseUs = micros();
+            task.isSignaled = true;
+        }
+    }
+}
+
+void Scheduler::suspend(unsigned char id)
+{
+    if (id >= _taskCount)
+        return;
+
+    _tasks[id].isSuspended = true;
+}
+
+void Scheduler::resume(unsigned char id)
+{
+    if (id >= _taskCount)
+        return;
+
+    SchedulerTask &task = _tasks[id];
+    if (!task.isSuspended)
+        return;
+
+    task.isSuspended = false;
+    if (task.periodMs != SCHEDULER_EVENT)
+        task.releaseUs = micros();
+}
+
+unsigned char Scheduler::getTaskCount()
+{
+    return _taskCount;
+}
+
+const SchedulerTask &Scheduler::getTask(unsigned char id)
+{
+    return _tasks[id];
+}
+
+void Scheduler::resetStatistics()
+{
+    for (unsigned char id = 0; id < _taskCount; id++)
+    {
+        _tasks[id].runs = 0;
+        _tasks[id].overruns = 0;
+        _tasks[id].maxLatencyUs = 0;
+        _tasks[id].maxRunUs = 0;
+    }
+}
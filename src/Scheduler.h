@@ -0,0 +1,59 @@
+#include <Arduino.h>
+
+#pragma once
+
+/**
+ * Cooperative scheduler, called from loop(). Every pass runs each ready
+ * task once, in the order of their priority (0 first). A task is ready
+ * - on every pass with SCHEDULER_CONTINUOUS,
+ * - once its period elapsed for a period in ms,
+ * - after signal() with SCHEDULER_EVENT, signal() may be called from interrupts.
+ * Tasks must return quickly, long operations are state machines that do one
+ * step per run. Latency is the time from release (period elapsed, signal, or
+ * the end of the previous run of a continuous task) to the start of the run.
+ * A run that starts later than the deadline of its task counts as overrun.
+ */
+#define SCHEDULER_MAX_TASKS 8
+#define SCHEDULER_INVALID_TASK 0xFF // returned by add() when all SCHEDULER_MAX_TASKS are taken, ignored by signal() etc.
+#define SCHEDULER_CONTINUOUS 0
+#define SCHEDULER_EVENT 0xFFFF
+
+static_assert(SCHEDULER_MAX_TASKS < SCHEDULER_INVALID_TASK, "task ids are unsigned char, SCHEDULER_INVALID_TASK must not be one");
+
+typedef void (*SchedulerCallback)();
+
+class SchedulerTask
+{
+public:
+    SchedulerCallback callback;
+    unsigned char priority;
+    unsigned int periodMs;
+    unsigned long deadlineUs;
+    unsigned long releaseUs;
+    volatile bool isSignaled;
+    bool isSuspended;
+    unsigned long runs;
+    unsigned long overruns;
+    unsigned long maxLatencyUs;
+    unsigned long maxRunUs;
+};
+
+class Scheduler
+{
+private:
+    SchedulerTask _tasks[SCHEDULER_MAX_TASKS];
+    unsigned char _order[SCHEDULER_MAX_TASKS];
+    unsigned char _taskCount = 0;
+    bool _isReady(SchedulerTask &task, unsigned long now);
+    void _runTask(SchedulerTask &task, unsigned long now);
+
+public:
+    unsigned char add(SchedulerCallback callback, unsigned char priority, unsigned int periodMs, unsigned long deadlineUs);
+    void run();
+    void signal(unsigned char id);
+    void suspend(unsigned char id);
+    void resume(unsigned char id);
+    unsigned char getTaskCount();
+    const SchedulerTask &getTask(unsigned char id);
+    void resetStatistics();
+};
@@ -0,0 +1,166 @@
+#include <Arduino.h>
+#include <util/atomic.h>
+#include "SensorSampler.h"
+
+static SensorSampler *_sensorSamplerInstance = NULL;
+
+ISR(ADC_vect)
+{
+    _sensorSamplerInstance->handleInterrupt();
+}
+
+static const uint8_t SENSOR_PINS[SENSOR_CHANNEL_COUNT] PROGMEM = {
+#if SENSOR_VOLTAGE_ENABLED
+    SENSOR_HOME_PIN,
+    SENSOR_VOLTAGE_PIN};
+#else
+    SENSOR_HOME_PIN};
+#endif
+
+void SensorSampler::_selectChannel(unsigned char channel)
+{
+    // AVcc reference, MUX3:0 select the analog input
+    ADMUX = _BV(REFS0) | ((pgm_read_byte(&SENSOR_PINS[channel]) - A0) & 0x0F);
+}
+
+void SensorSampler::_prime(SensorChannel &channel, uint16_t sample)
+{
+    // the first sample fills the whole window, no ramp up from 0
+#if SENSOR_FILTER == SENSOR_FILTER_EXPONENTIAL
+    channel.state = sample << SENSOR_FILTER_EMA_SHIFT;
+#else
+    for (unsigned char i = 0; i < SENSOR_FILTER_SAMPLES; i++)
+    {
+        channel.samples[i] = sample;
+#if SENSOR_FILTER == SENSOR_FILTER_MEDIAN
+        channel.sorted[i] = sample;
+#endif
+    }
+
+    channel.index = 0;
+#endif
+#if SENSOR_FILTER == SENSOR_FILTER_MOVING_AVERAGE
+    channel.sum = sample * SENSOR_FILTER_SAMPLES;
+#endif
+
+    channel.value = sample;
+}
+
+void SensorSampler::_filter(SensorChannel &channel, uint16_t sample)
+{
+#if SENSOR_FILTER == SENSOR_FILTER_EXPONENTIAL
+    // state is kept scaled by 2^SENSOR_FILTER_EMA_SHIFT, the fraction is not lost
+    channel.state += sample - (channel.state >> SENSOR_FILTER_EMA_SHIFT);
+    channel.value = channel.state >> SENSOR_FILTER_EMA_SHIFT;
+
+#else
+    uint16_t oldest = channel.samples[channel.index];
+    channel.samples[channel.index] = sample;
+    channel.index = (channel.index + 1) & (SENSOR_FILTER_SAMPLES - 1);
+
+#if SENSOR_FILTER == SENSOR_FILTER_MOVING_AVERAGE
+    // 8 samples of 10 bits fit the sum
+    channel.sum += sample - oldest;
+    channel.value = channel.sum / SENSOR_FILTER_SAMPLES;
+
+#elif SENSOR_FILTER == SENSOR_FILTER_MEDIAN
+    // the new sample takes the place of the oldest one and moves to its rank, one pass of shifts
+    uint16_t *sorted = channel.sorted;
+    unsigned char i = 0;
+    while (sorted[i] != oldest)
+        i++;
+
+    while (i + 1 < SENSOR_FILTER_SAMPLES && sorted[i + 1] < sample)
+    {
+        sorted[i] = sorted[i + 1];
+        i++;
+    }
+
+    while (i > 0 && sorted[i - 1] > sample)
+    {
+        sorted[i] = sorted[i - 1];
+        i--;
+    }
+
+    sorted[i] = sample;
+    channel.value = sorted[SENSOR_FILTER_SAMPLES / 2];
+
+#else
+#error "Unsupported SENSOR_FILTER"
+#endif
+#endif
+}
+
+void SensorSampler::init()
+{
+    _sensorSamplerInstance = this;
+
+    for (unsigned char channel = 0; channel < SENSOR_CHANNEL_COUNT; channel++)
+        DIDR0 |= _BV((pgm_read_byte(&SENSOR_PINS[channel]) - A0) & 0x07); // no digital input buffer on analog pins
+
+    // one polled conversion per channel first, a reading before the first
+    // interrupt would be 0 and look like a perfect home match
+    for (unsigned char channel = 0; channel < SENSOR_CHANNEL_COUNT; channel++)
+    {
+        _selectChannel(channel);
+        ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+        while (ADCSRA & _BV(ADSC))
+            ;
+
+        _prime(_channels[channel], ADC);
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+#if SENSOR_VOLTAGE_ENABLED
+        _convertingChannel = 0;
+        _muxChannel = 0;
+#endif
+        _selectChannel(0);
+
+        // free running, interrupt on every conversion, prescaler 128 (125kHz ADC clock),
+        // writing ADIF clears the flag left by the polled conversions
+        ADCSRB = 0;
+        ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIE) | _BV(ADIF) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+        ADCSRA |= _BV(ADSC);
+    }
+}
+
+uint16_t SensorSampler::read(unsigned char channel)
+{
+    // 16 bits the interrupt may change between the two byte loads
+    uint16_t value;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        value = _channels[channel].value;
+    }
+
+    return value;
+}
+
+unsigned long SensorSampler::readVoltageHundredths()
+{
+#if SENSOR_VOLTAGE_ENABLED
+    return (this->read(SENSOR_CHANNEL_VOLTAGE) * SENSOR_VOLTAGE_FULL_SCALE_HUNDREDTHS) / SENSOR_ADC_MAX;
+#else
+    return SENSOR_VOLTAGE_FIXED_HUNDREDTHS;
+#endif
+}
+
+void SensorSampler::handleInterrupt()
+{
+    uint16_t sample = ADC;
+
+#if SENSOR_VOLTAGE_ENABLED
+    // the conversion that just started still uses the previous mux setting,
+    // a new channel only applies from the conversion after it
+    unsigned char channel = _convertingChannel;
+    _convertingChannel = _muxChannel;
+    _muxChannel = _muxChannel + 1 < SENSOR_CHANNEL_COUNT ? _muxChannel + 1 : 0;
+    _selectChannel(_muxChannel);
+#else
+    unsigned char channel = SENSOR_CHANNEL_HOME;
+#endif
+
+    _filter(_channels[channel], sample);
+}
@@ -0,0 +1,95 @@
+#include <Arduino.h>
+
+#pragma once
+
+/**
+ * The ADC runs in free running mode. One conversion takes 13 ADC clocks at
+ * 125kHz (prescaler 128), a new sample about every 104us. The conversion
+ * complete interrupt updates the filtered value of its channel over the
+ * latest SENSOR_FILTER_SAMPLES samples incrementally, read() only loads it.
+ * The interrupt reads ADC once and touches no other register, a Timer1 step
+ * waits for no more than its entry and a few dozen cycles of filtering.
+ *
+ * Filters, select one with SENSOR_FILTER
+ * (or -D SENSOR_FILTER=SENSOR_FILTER_MOVING_AVERAGE in build_flags):
+ * - SENSOR_FILTER_MOVING_AVERAGE: mean of the window, a running sum
+ * - SENSOR_FILTER_MEDIAN: median of the window, ignores spikes. A sorted copy
+ *   of the window is kept, the oldest sample is swapped for the new one
+ * - SENSOR_FILTER_EXPONENTIAL: y += (x - y) / 2^SENSOR_FILTER_EMA_SHIFT, one add
+ */
+#define SENSOR_FILTER_MOVING_AVERAGE 1
+#define SENSOR_FILTER_MEDIAN 2
+#define SENSOR_FILTER_EXPONENTIAL 3
+
+#ifndef SENSOR_FILTER
+#define SENSOR_FILTER SENSOR_FILTER_MEDIAN
+#endif
+
+#define SENSOR_FILTER_SAMPLES 8 // must be a power of two
+#define SENSOR_FILTER_EMA_SHIFT 3
+#define SENSOR_ADC_MAX 1024
+
+#define SENSOR_HOME_PIN A0
+#define SENSOR_VOLTAGE_PIN A1
+
+/**
+ * VS reports the input voltage measured at SENSOR_VOLTAGE_PIN, which needs a
+ * divider fitted (-D SENSOR_VOLTAGE_ENABLED=1). Off by default, VS answers
+ * the fixed 12.00 and the ADC samples the home sensor only.
+ */
+#ifndef SENSOR_VOLTAGE_ENABLED
+#define SENSOR_VOLTAGE_ENABLED 0
+#endif
+
+#define SENSOR_VOLTAGE_FIXED_HUNDREDTHS 1200UL
+
+/**
+ * Input voltage divider: volts at SENSOR_VOLTAGE_PIN for a full scale
+ * ADC reading (5V reference times the divider ratio), in hundredths
+ */
+#define SENSOR_VOLTAGE_FULL_SCALE_HUNDREDTHS 1500UL
+
+enum SensorChannelId
+{
+    SENSOR_CHANNEL_HOME,
+#if SENSOR_VOLTAGE_ENABLED
+    SENSOR_CHANNEL_VOLTAGE,
+#endif
+    SENSOR_CHANNEL_COUNT
+};
+
+class SensorChannel
+{
+public:
+    volatile uint16_t value; // filtered, the rest is only touched by the interrupt once init() returned
+#if SENSOR_FILTER == SENSOR_FILTER_EXPONENTIAL
+    uint16_t state; // EMA scaled by 2^SENSOR_FILTER_EMA_SHIFT
+#else
+    uint16_t samples[SENSOR_FILTER_SAMPLES]; // ring, oldest at index
+    unsigned char index;
+#endif
+#if SENSOR_FILTER == SENSOR_FILTER_MOVING_AVERAGE
+    uint16_t sum;
+#elif SENSOR_FILTER == SENSOR_FILTER_MEDIAN
+    uint16_t sorted[SENSOR_FILTER_SAMPLES]; // the samples of the ring in ascending order
+#endif
+};
+
+class SensorSampler
+{
+private:
+    SensorChannel _channels[SENSOR_CHANNEL_COUNT];
+#if SENSOR_VOLTAGE_ENABLED
+    unsigned char _convertingChannel = 0;
+    unsigned char _muxChannel = 0;
+#endif
+    void _selectChannel(unsigned char channel);
+    void _prime(SensorChannel &channel, uint16_t sample);
+    static void _filter(SensorChannel &channel, uint16_t sample);
+
+public:
+    void init();
+    uint16_t read(unsigned char channel);
+    unsigned long readVoltageHundredths();
+    void handleInterrupt();
+};
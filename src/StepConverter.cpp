@@ -0,0 +1,72 @@
+#include "StepConverter.h"
+
+unsigned long StepConverter::_gcd(unsigned long a, unsigned long b)
+{
+    while (b != 0)
+    {
+        unsigned long rest = a % b;
+        a = b;
+        b = rest;
+    }
+
+    return a;
+}
+
+unsigned long StepConverter::_mulDivRound(unsigned long value, unsigned long multiplier, unsigned long divisor)
+{
+    // 32 bit whenever the product fits, which covers every position of the default gearing
+    if (value <= (0xFFFFFFFFUL - divisor / 2) / multiplier)
+        return (value * multiplier + divisor / 2) / divisor;
+
+    return (unsigned long)(((unsigned long long)value * multiplier + divisor / 2) / divisor);
+}
+
+void StepConverter::configure(unsigned long motorStepsPerRevolution, unsigned char rotatorGearTeeth, unsigned char motorGearTeeth)
+{
+    if (motorStepsPerRevolution == _motorStepsPerRevolution &&
+        rotatorGearTeeth == _rotatorGearTeeth &&
+        motorGearTeeth == _motorGearTeeth)
+        return;
+
+    _motorStepsPerRevolution = motorStepsPerRevolution;
+    _rotatorGearTeeth = rotatorGearTeeth;
+    _motorGearTeeth = motorGearTeeth;
+
+    if (motorStepsPerRevolution == 0 || rotatorGearTeeth == 0 || motorGearTeeth == 0)
+    {
+        // invalid gearing, keep conversions defined
+        _numerator = 1L;
+        _denominator = 1L;
+        return;
+    }
+
+    // at most 256 microsteps * 400 steps * 255 teeth, both products fit into 32 bit
+    unsigned long stepsTeethGcd = _gcd(motorStepsPerRevolution, motorGearTeeth);
+    unsigned long numerator = (motorStepsPerRevolution / stepsTeethGcd) * rotatorGearTeeth;
+    unsigned long denominator = (motorGearTeeth / stepsTeethGcd) * STEP_CONVERTER_HUNDREDTHS_PER_REVOLUTION;
+    unsigned long divisor = _gcd(numerator, denominator);
+
+    _numerator = numerator / divisor;
+    _denominator = denominator / divisor;
+}
+
+unsigned long StepConverter::getStepsPerRevolution()
+{
+    return _mulDivRound(STEP_CONVERTER_HUNDREDTHS_PER_REVOLUTION, _numerator, _denominator);
+}
+
+unsigned long StepConverter::getStepsPerDegHundredths()
+{
+    // steps per degree (100 hundredths) with two decimals
+    return _mulDivRound(10000UL, _numerator, _denominator);
+}
+
+unsigned long StepConverter::hundredthsToSteps(unsigned long hundredths)
+{
+    return _mulDivRound(hundredths, _numerator, _denominator);
+}
+
+unsigned long StepConverter::stepsToHundredths(unsigned long steps)
+{
+    return _mulDivRound(steps, _denominator, _numerator);
+}
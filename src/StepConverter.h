@@ -0,0 +1,33 @@
+#pragma once
+
+/**
+ * Exact conversion between motor steps and rotator angle.
+ * Steps per hundredth of a degree are kept as a reduced fraction
+ * (motor steps per revolution * rotator teeth) / (motor teeth * 36000),
+ * conversions round to the nearest step or hundredth with integer
+ * arithmetic only. Angles are in hundredths of a degree, the resolution
+ * of the Falcon protocol.
+ *
+ * The fraction is recomputed only when the step mode or the gearing
+ * change, configure is cheap to call before every conversion.
+ */
+#define STEP_CONVERTER_HUNDREDTHS_PER_REVOLUTION 36000UL
+
+class StepConverter
+{
+private:
+    unsigned long _motorStepsPerRevolution = 0L;
+    unsigned char _rotatorGearTeeth = 0;
+    unsigned char _motorGearTeeth = 0;
+    unsigned long _numerator = 1L;
+    unsigned long _denominator = 1L;
+    static unsigned long _gcd(unsigned long a, unsigned long b);
+    static unsigned long _mulDivRound(unsigned long value, unsigned long multiplier, unsigned long divisor);
+
+public:
+    void configure(unsigned long motorStepsPerRevolution, unsigned char rotatorGearTeeth, unsigned char motorGearTeeth);
+    unsigned long getStepsPerRevolution();
+    unsigned long getStepsPerDegHundredths();
+    unsigned long hundredthsToSteps(unsigned long hundredths);
+    unsigned long stepsToHundredths(unsigned long steps);
+};
@@ -0,0 +1,243 @@
+#include <Arduino.h>
+#include <util/atomic.h>
+#include "MotorDriver.h"
+#include "StepGenerator.h"
+
+static StepGenerator *_stepGeneratorInstance = NULL;
+
+ISR(TIMER1_COMPA_vect)
+{
+    _stepGeneratorInstance->handleInterrupt();
+}
+
+void StepGenerator::_startTimer()
+{
+    TCCR1B |= _BV(CS11); // prescaler 8
+}
+
+void StepGenerator::_stopTimer()
+{
+    TCCR1B &= ~(_BV(CS12) | _BV(CS11) | _BV(CS10));
+}
+
+void StepGenerator::_scheduleTicks(unsigned long ticks)
+{
+    if (ticks < STEP_TIMER_MIN_TICKS)
+    {
+        ticks = STEP_TIMER_MIN_TICKS;
+    }
+
+    unsigned long chunk = ticks > STEP_TIMER_MAX_TICKS ? STEP_TIMER_MAX_TICKS : ticks;
+    _pendingTicks = ticks - chunk;
+
+    // the counter keeps running since the last compare match, never set TOP below it
+    unsigned int elapsed = TCNT1;
+    if (chunk <= (unsigned long)elapsed + 4)
+        chunk = (unsigned long)elapsed + 5;
+
+    // CTC period is OCR1A + 1 ticks
+    OCR1A = chunk - 1;
+}
+
+void StepGenerator::_rampStep()
+{
+    // c(n) = c(n-1) - 2 * c(n-1) / (4n + 1), the remainder is carried to avoid drift (AVR446)
+    _rampCount++;
+    long denominator = 4 * _rampCount + 1;
+    long numerator = 2 * (long)_stepTicks + _rampRest;
+    _stepTicks = (long)_stepTicks - numerator / denominator;
+    _rampRest = numerator % denominator;
+}
+
+unsigned long StepGenerator::_nextStepTicks()
+{
+    switch (_rampState)
+    {
+    case RAMP_ACCEL:
+        if (_stepsDone >= _decelStart)
+        {
+            // short move, cruise speed not reached: the steps left replay the ramp
+            // intervals backwards, a(n-1) .. a(0) for n steps
+            _rampCount = -(_rampCount + 1);
+            _rampRest = 0;
+            while (-_rampCount > (long)_stepsRemaining)
+                _rampStep();
+            _rampState = RAMP_DECEL;
+            break;
+        }
+
+        _lastAccelTicks = _stepTicks;
+        _rampStep();
+        if (_stepTicks <= _cruiseTicks)
+        {
+            // cruise speed reached before the planned length, the deceleration mirrors the ramp actually run
+            _decelSteps = _rampCount;
+            _decelStart = _stepsDone + _stepsRemaining - _decelSteps;
+        }
+        else if (_rampCount < (long)_decelSteps || _stepsRemaining <= _decelSteps + 1)
+        {
+            // still accelerating, or the middle step of a short move with an odd step count
+            break;
+        }
+
+        // the recurrence lags the planned length by a fraction of a tick on long ramps, cruise starts as planned
+        _stepTicks = _cruiseTicks;
+        _rampRest = 0;
+        _rampState = RAMP_CRUISE;
+        break;
+
+    case RAMP_CRUISE:
+        if (_stepsDone >= _decelStart)
+        {
+            _rampCount = -(long)_decelSteps;
+            _stepTicks = _lastAccelTicks;
+            _rampRest = 0;
+            _rampState = RAMP_DECEL;
+        }
+        else if (_cruiseRest > 0)
+        {
+            // carry the fraction of a tick, long runs (derotation) must not drift
+            _cruiseAccumulator += _cruiseRest;
+            if (_cruiseAccumulator >= _cruiseDivisor)
+            {
+                _cruiseAccumulator -= _cruiseDivisor;
+                return _stepTicks + 1;
+            }
+        }
+        break;
+
+    case RAMP_DECEL:
+        // negative ramp count runs the recurrence backwards
+        _rampStep();
+        break;
+    }
+
+    return _stepTicks;
+}
+
+void StepGenerator::init()
+{
+    _isInitialized = true;
+    _stepGeneratorInstance = this;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        _stopTimer();
+        TCCR1A = 0;
+        TCCR1B = _BV(WGM12); // CTC, TOP = OCR1A
+        TIMSK1 |= _BV(OCIE1A);
+    }
+}
+
+void StepGenerator::start(const MotionPlan &plan, bool forward)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        _stopTimer();
+
+        _forward = forward;
+        _stepsRemaining = plan.totalSteps;
+        _stepsDone = 0L;
+        _decelStart = plan.decelStart;
+        _decelSteps = plan.accelSteps;
+        _cruiseTicks = plan.cruiseTicks;
+        _cruiseRest = plan.cruiseRest;
+        _cruiseDivisor = plan.cruiseDivisor;
+        _cruiseAccumulator = 0;
+        _lastAccelTicks = plan.firstTicks;
+        _stepTicks = plan.firstTicks;
+        _rampCount = 0;
+        _rampRest = 0;
+        _rampState = plan.accelSteps > 0 ? RAMP_ACCEL : RAMP_CRUISE;
+        _isRunning = plan.totalSteps > 0 && _isInitialized;
+
+        if (_isRunning)
+        {
+            // first step is emitted one interval after start
+            TCNT1 = 0;
+            TIFR1 = _BV(OCF1A);
+            _scheduleTicks(_stepTicks);
+            _startTimer();
+        }
+    }
+}
+
+void StepGenerator::stop()
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        _stopTimer();
+        _stepsRemaining = 0L;
+        _pendingTicks = 0L;
+        _isRunning = false;
+    }
+}
+
+void StepGenerator::decelerate()
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        // the ramp runs backwards from the current speed, without a ramp the next interrupt stops
+        unsigned long steps = _stepsRemaining;
+        if (_rampState == RAMP_ACCEL)
+            steps = _rampCount;
+        else if (_rampState == RAMP_CRUISE)
+            steps = _decelSteps;
+
+        if (steps < _stepsRemaining)
+        {
+            if (_rampState == RAMP_CRUISE)
+                _stepTicks = _lastAccelTicks;
+
+            _stepsRemaining = steps;
+            _rampCount = -(long)steps;
+            _rampState = RAMP_DECEL;
+        }
+    }
+}
+
+bool StepGenerator::isRunning()
+{
+    return _isRunning;
+}
+
+unsigned long StepGenerator::getStepsDone()
+{
+    unsigned long stepsDone;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        stepsDone = _stepsDone;
+    }
+
+    return stepsDone;
+}
+
+void StepGenerator::handleInterrupt()
+{
+    if (_pendingTicks > 0)
+    {
+        // continue a long interval that did not fit into OCR1A
+        _scheduleTicks(_pendingTicks);
+        return;
+    }
+
+    if (_stepsRemaining == 0)
+    {
+        _stopTimer();
+        _isRunning = false;
+        return;
+    }
+
+    MotorDriver::step(_forward);
+    _stepsRemaining--;
+    _stepsDone++;
+
+    if (_stepsRemaining == 0)
+    {
+        _stopTimer();
+        _isRunning = false;
+        return;
+    }
+
+    _scheduleTicks(_nextStepTicks());
+}
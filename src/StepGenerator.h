@@ -0,0 +1,58 @@
+#include <Arduino.h>
+#include "MotionPlanner.h"
+
+#pragma once
+
+/**
+ * Timer1 (16 bit) in CTC mode with prescaler 8, one tick is 0.5us at 16MHz.
+ * Intervals longer than the 16 bit compare range are split into chunks,
+ * so step intervals are only bounded by unsigned long.
+ */
+#define STEP_TIMER_PRESCALER 8
+#define STEP_TIMER_TICKS_PER_US (F_CPU / STEP_TIMER_PRESCALER / 1000000UL)
+#define STEP_TIMER_TICKS_PER_MS (F_CPU / STEP_TIMER_PRESCALER / 1000UL)
+#define STEP_TIMER_MAX_TICKS 0xFFFFUL
+#define STEP_TIMER_MIN_TICKS 32UL
+
+enum RampState
+{
+    RAMP_ACCEL,
+    RAMP_CRUISE,
+    RAMP_DECEL
+};
+
+class StepGenerator
+{
+private:
+    bool _isInitialized = false;
+    volatile bool _isRunning = false;
+    volatile bool _forward = true;
+    volatile unsigned long _stepsRemaining = 0L;
+    volatile unsigned long _stepsDone = 0L;
+    volatile unsigned long _pendingTicks = 0L;
+    volatile RampState _rampState = RAMP_CRUISE;
+    unsigned long _decelStart;
+    unsigned long _decelSteps;
+    unsigned long _cruiseTicks;
+    unsigned long _cruiseRest;
+    unsigned long _cruiseDivisor;
+    unsigned long _cruiseAccumulator;
+    unsigned long _lastAccelTicks;
+    unsigned long _stepTicks;
+    long _rampCount;
+    long _rampRest;
+    void _startTimer();
+    void _stopTimer();
+    void _scheduleTicks(unsigned long ticks);
+    void _rampStep();
+    unsigned long _nextStepTicks();
+
+public:
+    void init();
+    void start(const MotionPlan &plan, bool forward);
+    void stop();
+    void decelerate();
+    bool isRunning();
+    unsigned long getStepsDone();
+    void handleInterrupt();
+};
@@ -1,218 +1,533 @@
+#include <avr/pgmspace.h>
+#include "BinaryProtocol.h"
 #include "Motor.h"
+#include "ResponseFormatter.h"
 #include "StringProxy.h"
 
-void StringProxy::init(CustomEEPROM &eeprom, Motor &motor)
+/**
+ * Command table, order does not matter. Every entry declares the type of its
+ * parameter so parsing happens once in _parseArgument, flags are 0 or FALCON_FLAG_*.
+ */
+static constexpr FalconCommand FALCON_COMMANDS[] PROGMEM = {
+    {{'F', '#'}, FALCON_COMMAND_STATUS, FALCON_ARGUMENT_NONE, 0},
+    {{'F', 'S'}, FALCON_COMMAND_STEPS_PER_DEG, FALCON_ARGUMENT_NONE, 0},
+    {{'F', 'A'}, FALCON_COMMAND_FULL_STATUS, FALCON_ARGUMENT_NONE, 0},
+    {{'F', 'V'}, FALCON_COMMAND_VERSION, FALCON_ARGUMENT_NONE, 0},
+    {{'F', 'D'}, FALCON_COMMAND_POSITION_DEG, FALCON_ARGUMENT_NONE, 0},
+    {{'F', 'P'}, FALCON_COMMAND_POSITION, FALCON_ARGUMENT_NONE, 0},
+    {{'F', 'H'}, FALCON_COMMAND_HALT, FALCON_ARGUMENT_NONE, 0},
+    {{'F', 'R'}, FALCON_COMMAND_IS_RUNNING, FALCON_ARGUMENT_NONE, 0},
+    {{'F', 'N'}, FALCON_COMMAND_REVERSE, FALCON_ARGUMENT_FLAG, FALCON_FLAG_LOCKED_WHILE_HOMING},
+    {{'F', 'F'}, FALCON_COMMAND_RELOAD, FALCON_ARGUMENT_NONE, 0},
+    {{'V', 'S'}, FALCON_COMMAND_VOLTAGE, FALCON_ARGUMENT_NONE, 0},
+    {{'D', 'R'}, FALCON_COMMAND_DEROTATION, FALCON_ARGUMENT_SIGNED_DECIMAL, FALCON_FLAG_LOCKED_WHILE_HOMING},
+    {{'S', 'D'}, FALCON_COMMAND_SYNC_DEG, FALCON_ARGUMENT_DECIMAL, FALCON_FLAG_LOCKED_WHILE_HOMING},
+    {{'M', 'D'}, FALCON_COMMAND_MOVE_DEG, FALCON_ARGUMENT_DECIMAL, FALCON_FLAG_LOCKED_WHILE_HOMING},
+    {{'M', 'S'}, FALCON_COMMAND_MOVE, FALCON_ARGUMENT_UNSIGNED, FALCON_FLAG_LOCKED_WHILE_HOMING},
+    {{'G', 'S'}, FALCON_COMMAND_GET_STEP_MODE, FALCON_ARGUMENT_NONE, 0},
+    {{'S', 'S'}, FALCON_COMMAND_SET_STEP_MODE, FALCON_ARGUMENT_UNSIGNED, FALCON_FLAG_LOCKED_WHILE_HOMING},
+    {{'G', 'G'}, FALCON_COMMAND_GET_SPEED_MODE, FALCON_ARGUMENT_NONE, 0},
+    {{'S', 'G'}, FALCON_COMMAND_SET_SPEED_MODE, FALCON_ARGUMENT_UNSIGNED, 0},
+    {{'R', 'S'}, FALCON_COMMAND_RESET, FALCON_ARGUMENT_NONE, FALCON_FLAG_LOCKED_WHILE_HOMING},
+    {{'G', 'R'}, FALCON_COMMAND_GET_GEAR_RATIO, FALCON_ARGUMENT_NONE, 0},
+    {{'S', 'R'}, FALCON_COMMAND_SET_GEAR_RATIO, FALCON_ARGUMENT_PAIR, FALCON_FLAG_LOCKED_WHILE_HOMING},
+    {{'B', 'R'}, FALCON_COMMAND_SET_BAUD, FALCON_ARGUMENT_UNSIGNED, 0},
+    {{'B', 'C'}, FALCON_COMMAND_CONFIRM_BAUD, FALCON_ARGUMENT_NONE, 0},
+    {{'B', 'M'}, FALCON_COMMAND_BINARY_MODE, FALCON_ARGUMENT_NONE, 0},
+    {{'P', 'S'}, FALCON_COMMAND_SUBSCRIBE, FALCON_ARGUMENT_PAIR, 0},
+    {{'T', 'S'}, FALCON_COMMAND_TASK_STATUS, FALCON_ARGUMENT_UNSIGNED, 0},
+#if TELEMETRY_ENABLED
+    {{'T', 'M'}, FALCON_COMMAND_TELEMETRY, FALCON_ARGUMENT_FLAG, 0},
+#endif
+};
+
+#define FALCON_COMMAND_TABLE_SIZE (sizeof(FALCON_COMMANDS) / sizeof(FALCON_COMMANDS[0]))
+
+static constexpr unsigned char _falconHash(char c0, char c1)
+{
+    return ((unsigned char)c0 * FALCON_HASH_MULTIPLIER + (unsigned char)c1) & (FALCON_HASH_SLOTS - 1);
+}
+
+// table index + 1 of the first command hashing to slot, 0 if the slot is empty
+static constexpr unsigned char _falconSlot(unsigned char slot, unsigned char index = 0)
+{
+    return index == FALCON_COMMAND_TABLE_SIZE                                                  ? 0
+           : _falconHash(FALCON_COMMANDS[index].opcode[0], FALCON_COMMANDS[index].opcode[1]) == slot ? index + 1
+                                                                                                      : _falconSlot(slot, index + 1);
+}
+
+// every command has to own its slot, otherwise two opcodes collide
+static constexpr bool _falconHashIsPerfect(unsigned char index = 0)
+{
+    return index == FALCON_COMMAND_TABLE_SIZE ||
+           (_falconSlot(_falconHash(FALCON_COMMANDS[index].opcode[0], FALCON_COMMANDS[index].opcode[1])) == index + 1 &&
+            _falconHashIsPerfect(index + 1));
+}
+
+static_assert(FALCON_COMMAND_TABLE_SIZE == FALCON_COMMAND_COUNT, "every command id needs exactly one table entry");
+static_assert(_falconHashIsPerfect(), "opcode hash collision, pick another FALCON_HASH_MULTIPLIER");
+
+#define FALCON_SLOT_ROW(n)                                                     \
+    _falconSlot(n), _falconSlot(n + 1), _falconSlot(n + 2), _falconSlot(n + 3), \
+        _falconSlot(n + 4), _falconSlot(n + 5), _falconSlot(n + 6), _falconSlot(n + 7)
+
+static_assert(FALCON_HASH_SLOTS == 128, "FALCON_SLOTS is spelled out for 128 slots");
+static const unsigned char FALCON_SLOTS[FALCON_HASH_SLOTS] PROGMEM = {
+    FALCON_SLOT_ROW(0), FALCON_SLOT_ROW(8), FALCON_SLOT_ROW(16), FALCON_SLOT_ROW(24),
+    FALCON_SLOT_ROW(32), FALCON_SLOT_ROW(40), FALCON_SLOT_ROW(48), FALCON_SLOT_ROW(56),
+    FALCON_SLOT_ROW(64), FALCON_SLOT_ROW(72), FALCON_SLOT_ROW(80), FALCON_SLOT_ROW(88),
+    FALCON_SLOT_ROW(96), FALCON_SLOT_ROW(104), FALCON_SLOT_ROW(112), FALCON_SLOT_ROW(120)};
+
+void StringProxy::init(CustomEEPROM &eeprom, Motor &motor, SensorSampler &sensor, Scheduler &scheduler, BaudRate &baudRate, BinaryProtocol &binaryProtocol)
 {
     _eeprom = &eeprom;
     _motor = &motor;
+    _sensor = &sensor;
+    _scheduler = &scheduler;
+    _baudRate = &baudRate;
+    _binaryProtocol = &binaryProtocol;
+}
+
+unsigned long StringProxy::getStepsPerDegHundredths()
+{
+    return _motor->getStepConverter().getStepsPerDegHundredths();
+}
+
+unsigned long StringProxy::stepsToHundredths(unsigned long steps)
+{
+    return _motor->getStepConverter().stepsToHundredths(steps);
+}
+
+unsigned long StringProxy::hundredthsToSteps(unsigned long hundredths)
+{
+    return _motor->getStepConverter().hundredthsToSteps(hundredths);
+}
+
+bool StringProxy::_findCommand(const char *command, FalconCommand &falconCommand)
+{
+    unsigned char slot = pgm_read_byte(&FALCON_SLOTS[_falconHash(command[0], command[1])]);
+    if (slot == 0)
+        return false;
+
+    memcpy_P(&falconCommand, &FALCON_COMMANDS[slot - 1], sizeof(FalconCommand));
+
+    // the slot only tells which command could match, unknown opcodes hash somewhere too
+    return falconCommand.opcode[0] == command[0] && falconCommand.opcode[1] == command[1];
 }
 
-float StringProxy::getStepsPerDeg()
+unsigned long StringProxy::_parseHundredths(const char *commandParam, bool &isNegative)
 {
-    double stepsPerDeg = 0.0f;
-    if (MOTOR_DRIVER == "TMC220X")
+    // "-33.555" -> 3356 and isNegative, rounded on the third decimal
+    unsigned long hundredths = 0;
+    unsigned char decimals = 0;
+    bool isFraction = false;
+
+    while (*commandParam == ' ')
+        commandParam++;
+
+    isNegative = *commandParam == '-';
+    if (*commandParam == '-' || *commandParam == '+')
+        commandParam++;
+
+    for (; *commandParam; commandParam++)
     {
-        stepsPerDeg = 400.0f * _eeprom->getStepMode(); // steps per 360 of motor shaft
+        char c = *commandParam;
+        if (c == '.' && !isFraction)
+        {
+            isFraction = true;
+            continue;
+        }
+
+        if (c < '0' || c > '9')
+            break;
+
+        if (decimals == 2)
+        {
+            if (c >= '5')
+                hundredths++;
+            break;
+        }
+
+        hundredths = hundredths * 10 + (c - '0');
+        if (isFraction)
+            decimals++;
     }
-    else if (MOTOR_DRIVER == "ULN2003")
+
+    for (; decimals < 2; decimals++)
+        hundredths *= 10;
+
+    return hundredths;
+}
+
+void StringProxy::_parseArgument(unsigned char argumentType, const char *commandParam, FalconArgument &argument)
+{
+    char *end;
+
+    argument.value = 0;
+    argument.value2 = 0;
+    argument.hundredths = 0;
+    argument.flag = false;
+
+    switch (argumentType)
     {
-        stepsPerDeg = ULN2003_STEPS_PER_REVOLUTION; // steps per 360 of motor shaft
+    case FALCON_ARGUMENT_UNSIGNED:
+        argument.value = strtoul(commandParam, NULL, 10);
+        break;
+
+    case FALCON_ARGUMENT_DECIMAL:
+        // negative angles clamp to 0
+        argument.hundredths = this->_parseHundredths(commandParam, argument.flag);
+        if (argument.flag)
+            argument.hundredths = 0;
+        break;
+
+    case FALCON_ARGUMENT_SIGNED_DECIMAL:
+        argument.hundredths = this->_parseHundredths(commandParam, argument.flag);
+        break;
+
+    case FALCON_ARGUMENT_FLAG:
+        argument.flag = atoi(commandParam) != 0;
+        break;
+
+    case FALCON_ARGUMENT_PAIR:
+        argument.value = strtoul(commandParam, &end, 10);
+        if (*end == ':')
+            argument.value2 = strtoul(end + 1, NULL, 10);
+        break;
     }
+}
+
+char const *StringProxy::processFalconCommand(char *command, char *commandParam, int commandParamLength)
+{
+    FalconCommand falconCommand;
+    FalconArgument argument;
 
-    stepsPerDeg *= (100.0f / 20.0f); // steps per 360 deg of rotator
-    stepsPerDeg /= 360.0f;           // steps per deg
+    if (!this->_findCommand(command, falconCommand))
+        return "";
 
-    return stepsPerDeg;
+    if ((falconCommand.flags & FALCON_FLAG_LOCKED_WHILE_HOMING) && _eeprom->isHoming())
+        return RESPONSE_KO;
+
+    this->_parseArgument(falconCommand.argumentType, commandParam, argument);
+
+    return this->_executeCommand(falconCommand.id, argument);
 }
 
-float StringProxy::stepsToDeg(unsigned long steps)
+char const *StringProxy::executeFalconCommand(const char *opcode, const FalconArgument &argument)
 {
-    float stepsPerDeg = this->getStepsPerDeg();
-    float deg = steps / stepsPerDeg;
+    // the argument comes parsed already, e.g. from a binary frame
+    FalconCommand falconCommand;
+
+    if (!this->_findCommand(opcode, falconCommand))
+        return "";
+
+    if ((falconCommand.flags & FALCON_FLAG_LOCKED_WHILE_HOMING) && _eeprom->isHoming())
+        return RESPONSE_KO;
 
-    return deg;
+    return this->_executeCommand(falconCommand.id, argument);
 }
 
-unsigned long StringProxy::degToSteps(float deg)
+char const *StringProxy::_formatPosition(const char *prefix)
 {
-    float stepsPerDeg = this->getStepsPerDeg();
-    unsigned long steps = deg * stepsPerDeg;
+    char *out = ResponseFormatter::writeText(_resultBuffer, prefix);
+    out = ResponseFormatter::writeUnsigned(out, _eeprom->getPosition());
+    out = ResponseFormatter::writeChar(out, ':');
+    ResponseFormatter::writeFixed2(out, this->stepsToHundredths(_eeprom->getPosition()));
 
-    return steps;
+    return _resultBuffer;
 }
 
-char const *StringProxy::processFalconCommand(char *command, char *commandParam, int commandParamLength)
+char const *StringProxy::pollEvent()
 {
-    float deg;
-    unsigned long maxSteps;
-    unsigned long steps;
+    // "" when no event is due, the caller sends it only when the transmit buffer has room
+    if ((_eventIntervalMs == 0 && _eventDeltaSteps == 0) || _eeprom->isHoming())
+        return "";
+
+    unsigned long position = _eeprom->getPosition();
 
-    if (command[0] == 'F')
+    if (_motor->isMoving())
     {
-        switch (command[1])
-        {
-        case '#': // status
-            return "FR_OK";
+        unsigned long moved = position > _lastEventPosition ? position - _lastEventPosition : _lastEventPosition - position;
+        bool isDue =
+            !_isEventMoveOpen ||
+            (_eventIntervalMs > 0 && millis() - _lastEventMs >= _eventIntervalMs) ||
+            (_eventDeltaSteps > 0 && moved >= _eventDeltaSteps);
+
+        if (!isDue)
+            return "";
 
-        case 'S':
-            dtostrf(this->getStepsPerDeg(), 1, 2, _resultBuffer2);
-            sprintf(_resultBuffer1, "FS:%s", _resultBuffer2);
+        _isEventMoveOpen = true;
+        _lastEventMs = millis();
+        _lastEventPosition = position;
 
-            return _resultBuffer1;
+        return this->_formatPosition("PP:");
+    }
 
-        case 'A': // full status
-            /*
-            Receive: FR_OK:43:32:50.00:0:0:0:0
-            status FR_OK means that focuser is up and running
-            position_in_deg Position in degrees (double number, 2 decimals)
-            is_running Boolean value: Prints 1 if falcon motor is running, 0 if not
-            limit_detect Boolean value: Prints 1 if limit is detected, Print 0 if limit is not detected
-            do_derotation Boolean value: Print 1 if derotation is active, Print 0 if is deactivated
-            motor_reverse Boolean value: Print 1 if reverse is enabled, 0 if is disabled
-            */
+    // a move too short to be seen moving still changed the position
+    if (!_isEventMoveOpen && position == _lastEventPosition)
+        return "";
 
-            dtostrf(this->stepsToDeg(_eeprom->getPosition()), 1, 2, _resultBuffer2);
-            sprintf(
-                _resultBuffer1,
-                "FR_OK:%lu:%s:%c:0:0:%c",
-                _eeprom->getPosition(),
-                _resultBuffer2,
-                _motor->isMoving() ? '1' : '0',
-                _eeprom->getReverseDirection() ? '1' : '0');
+    _isEventMoveOpen = false;
+    _lastEventPosition = position;
 
-            return _resultBuffer1;
+    return this->_formatPosition("PC:");
+}
 
-        case 'V': // Report firmware version - FV:n.n
-            return "FV:1.3";
+char const *StringProxy::_executeCommand(unsigned char id, const FalconArgument &argument)
+{
+    unsigned long maxSteps;
+    unsigned long steps;
+    char *out;
 
-        case 'D': // Report position in degrees - FD:nn.nn
-            dtostrf(this->stepsToDeg(_eeprom->getPosition()), 1, 2, _resultBuffer2);
-            sprintf(_resultBuffer1, "FD:%s", _resultBuffer2);
+    // dense ids, compiles to a jump table
+    switch (id)
+    {
+    case FALCON_COMMAND_STATUS: // status
+        return "FR_OK";
+
+    case FALCON_COMMAND_STEPS_PER_DEG:
+        out = ResponseFormatter::writeText(_resultBuffer, "FS:");
+        ResponseFormatter::writeFixed2(out, this->getStepsPerDegHundredths());
+
+        return _resultBuffer;
+
+    case FALCON_COMMAND_FULL_STATUS: // full status
+        /*
+        Receive: FR_OK:43:32:50.00:0:0:0:0
+        status FR_OK means that focuser is up and running
+        position_in_deg Position in degrees (double number, 2 decimals)
+        is_running Boolean value: Prints 1 if falcon motor is running, 0 if not
+        limit_detect Boolean value: Prints 1 if limit is detected, Print 0 if limit is not detected
+        do_derotation Boolean value: Print 1 if derotation is active, Print 0 if is deactivated
+        motor_reverse Boolean value: Print 1 if reverse is enabled, 0 if is disabled
+        */
+
+        out = ResponseFormatter::writeText(_resultBuffer, "FR_OK:");
+        out = ResponseFormatter::writeUnsigned(out, _eeprom->getPosition());
+        out = ResponseFormatter::writeChar(out, ':');
+        out = ResponseFormatter::writeFixed2(out, this->stepsToHundredths(_eeprom->getPosition()));
+        out = ResponseFormatter::writeChar(out, ':');
+        out = ResponseFormatter::writeFlag(out, _motor->isMoving());
+        out = ResponseFormatter::writeText(out, ":0:");
+        out = ResponseFormatter::writeFlag(out, _motor->isDerotating());
+        out = ResponseFormatter::writeChar(out, ':');
+        ResponseFormatter::writeFlag(out, _eeprom->getReverseDirection());
+
+        return _resultBuffer;
+
+    case FALCON_COMMAND_VERSION: // Report firmware version - FV:n.n
+        return "FV:1.3";
+
+    case FALCON_COMMAND_POSITION_DEG: // Report position in degrees - FD:nn.nn
+        out = ResponseFormatter::writeText(_resultBuffer, "FD:");
+        ResponseFormatter::writeFixed2(out, this->stepsToHundredths(_eeprom->getPosition()));
+
+        return _resultBuffer;
+
+    case FALCON_COMMAND_POSITION: // Report position in steps - FP:n..
+        out = ResponseFormatter::writeText(_resultBuffer, "FP:");
+        ResponseFormatter::writeUnsigned(out, _eeprom->getPosition());
+
+        return _resultBuffer;
+
+    case FALCON_COMMAND_HALT: // Halt Falcon Rotator FH:1
+        // mostly the motor already stands still (halted as soon as FH arrived), behind a move in the same line it decelerates
+        if (!_motor->halt())
+            _motor->stopMotor();
+        return "FH:1";
 
-            return _resultBuffer1;
+    case FALCON_COMMAND_IS_RUNNING: // Print 1 if rotator is running, Print 0 if rotator is idle - FR:1 or FR:0
+        out = ResponseFormatter::writeText(_resultBuffer, "FR:");
+        ResponseFormatter::writeFlag(out, _motor->isMoving());
 
-        case 'P': // Report position in steps - FP:n..
-            sprintf(_resultBuffer1, "FP:%lu", _eeprom->getPosition());
+        return _resultBuffer;
 
-            return _resultBuffer1;
+    case FALCON_COMMAND_REVERSE: // Reverse Motor (1 = reverse, 0 = normal), One off setting – stored in EEPROM - FN:1 or FN:0
+        _eeprom->setReverseDirection(argument.flag);
+        out = ResponseFormatter::writeText(_resultBuffer, "FN:");
+        ResponseFormatter::writeFlag(out, _eeprom->getReverseDirection());
 
-        case 'H': // Halt Falcon Rotator FH:1
-            _motor->stopMotor();
-            return "FH:1";
+        return _resultBuffer;
 
-        case 'R': // Print 1 if rotator is running, Print 0 if rotator is idle - FR:1 or FR:0
-            sprintf(_resultBuffer1, "FR:%c", _motor->isMoving() ? '1' : '0');
+    case FALCON_COMMAND_RELOAD: // Reload Rotator Firmware
+        return "FR_OK";
 
-            return _resultBuffer1;
+    case FALCON_COMMAND_VOLTAGE: // Report input voltage in raw format - VS:n..
+        out = ResponseFormatter::writeText(_resultBuffer, "VS:");
+        ResponseFormatter::writeFixed2(out, _sensor->readVoltageHundredths());
 
-        case 'N': // Reverse Motor (1 = reverse, 0 = normal), One off setting – stored in EEPROM - FN:1 or FN:0
-            _eeprom->setReverseDirection(atoi(commandParam));
-            sprintf(_resultBuffer1, "FN:%c", _eeprom->getReverseDirection() ? '1' : '0');
+        return _resultBuffer;
 
-            return _resultBuffer1;
+    case FALCON_COMMAND_DEROTATION: // Enable Derotation. Provided number is the derotation time (in millisec) interval per step e.g (1 step per 1000 millisec) (DR:0 disables derotation) - DR:nn..
+        // fractions (DR:333.33) are accepted, a negative interval derotates backwards
+        if (argument.hundredths == 0)
+        {
+            if (_motor->isDerotating())
+                _motor->stopMotor();
 
-        case 'F': // Reload Rotator Firmware
-            return "FR_OK";
+            return "DR:0";
         }
-    }
-    else if (command[0] == 'V' && command[1] == 'S')
-    { // Report input voltage in raw format - VS:n..
-        return "VS:12.00";
-    }
-    else if (command[0] == 'D' && command[1] == 'R')
-    { // Enable Derotation. Provided number is the derotation time (in millisec) interval per step e.g (1 step per 1000 millisec) (DR:0 disables derotation) - DR:nn..
-        return "DR:0";
-    }
-    else if (command[0] == 'S' && command[1] == 'D')
-    { // Set Degrees: Set New position in degrees as the actual rotator position (without turning rotator) - SD:nn.nn
-        deg = atof(commandParam);
 
-        steps = this->degToSteps(deg);
-        maxSteps = (this->getStepsPerDeg() * 360.0f);
+        _motor->applyStepMode();
+        _motor->startDerotation(argument.hundredths, !argument.flag);
+
+        out = ResponseFormatter::writeText(_resultBuffer, "DR:");
+        if (argument.flag)
+            out = ResponseFormatter::writeChar(out, '-');
+
+        if (argument.hundredths % 100 == 0)
+            ResponseFormatter::writeUnsigned(out, argument.hundredths / 100);
+        else
+            ResponseFormatter::writeFixed2(out, argument.hundredths);
+
+        return _resultBuffer;
+
+    case FALCON_COMMAND_SYNC_DEG: // Set Degrees: Set New position in degrees as the actual rotator position (without turning rotator) - SD:nn.nn
+        steps = this->hundredthsToSteps(argument.hundredths);
+        maxSteps = _motor->getStepsPerRevolution();
 
         _eeprom->syncPosition(steps);
         _eeprom->setMaxPosition(maxSteps);
         _eeprom->setMaxMovement(maxSteps);
 
-        dtostrf(this->stepsToDeg(steps), 1, 2, _resultBuffer2);
-        sprintf(_resultBuffer1, "SD:%s", _resultBuffer2);
+        out = ResponseFormatter::writeText(_resultBuffer, "SD:");
+        ResponseFormatter::writeFixed2(out, this->stepsToHundredths(steps));
 
-        return _resultBuffer1;
-    }
-    else if (command[0] == 'M' && command[1] == 'D')
-    { // Move to Degrees: Move motor to new degrees. (accepts a decimal number e.g 33.55) - MD:nn.nn
-        deg = atof(commandParam);
+        return _resultBuffer;
 
-        steps = this->degToSteps(deg);
+    case FALCON_COMMAND_MOVE_DEG: // Move to Degrees: Move motor to new degrees. (accepts a decimal number e.g 33.55) - MD:nn.nn
+        steps = this->hundredthsToSteps(argument.hundredths);
+
+        // beyond the cable wrap limit both ways: the target stays as it was
+        if (!_motor->isReachable(steps))
+            return RESPONSE_KO;
 
         _eeprom->setTargetPosition(steps);
         _motor->applyStepMode();
         _motor->startMotor();
 
-        dtostrf(this->stepsToDeg(steps), 1, 2, _resultBuffer2);
-        sprintf(_resultBuffer1, "MD:%s", _resultBuffer2);
+        out = ResponseFormatter::writeText(_resultBuffer, "MD:");
+        ResponseFormatter::writeFixed2(out, this->stepsToHundredths(steps));
 
-        return _resultBuffer1;
-    }
-    else if (command[0] == 'M' && command[1] == 'S')
-    { // Move to Position: Move motor to new position MS:nn..  - MS:nn..
-        steps = strtoul(commandParam, NULL, 10);
-        _eeprom->setTargetPosition(steps);
+        return _resultBuffer;
+
+    case FALCON_COMMAND_MOVE: // Move to Position: Move motor to new position MS:nn..  - MS:nn..
+        if (!_motor->isReachable(argument.value))
+            return RESPONSE_KO;
+
+        _eeprom->setTargetPosition(argument.value);
         _motor->applyStepMode();
         _motor->startMotor();
 
-        sprintf(_resultBuffer1, "MS:%lu", _eeprom->getTargetPosition());
+        out = ResponseFormatter::writeText(_resultBuffer, "MS:");
+        ResponseFormatter::writeUnsigned(out, _eeprom->getTargetPosition());
 
-        return _resultBuffer1;
-    }
-    else if (command[0] == 'G' && command[1] == 'S')
-    {
-        sprintf(_resultBuffer1, "GS:%u", _eeprom->getStepMode());
+        return _resultBuffer;
 
-        return _resultBuffer1;
-    }
-    else if (command[0] == 'S' && command[1] == 'S')
-    {
-        long sm = (unsigned short)strtoul(commandParam, NULL, 10);
-        if (_eeprom->setStepMode(sm))
-        {
-            return RESPONSE_OK;
-        }
-        else
-        {
+    case FALCON_COMMAND_GET_STEP_MODE:
+        out = ResponseFormatter::writeText(_resultBuffer, "GS:");
+        ResponseFormatter::writeUnsigned(out, _eeprom->getStepMode());
+
+        return _resultBuffer;
+
+    case FALCON_COMMAND_SET_STEP_MODE:
+        return _eeprom->setStepMode((unsigned short)argument.value) ? RESPONSE_OK : RESPONSE_KO;
+
+    case FALCON_COMMAND_GET_SPEED_MODE:
+        out = ResponseFormatter::writeText(_resultBuffer, "SG:");
+        ResponseFormatter::writeUnsigned(out, _eeprom->getSpeedMode());
+
+        return _resultBuffer;
+
+    case FALCON_COMMAND_SET_SPEED_MODE:
+        return _eeprom->setSpeedMode((unsigned char)argument.value) ? RESPONSE_OK : RESPONSE_KO;
+
+    case FALCON_COMMAND_RESET:
+        _eeprom->resetToDefaults();
+
+        return RESPONSE_OK;
+
+    case FALCON_COMMAND_GET_GEAR_RATIO: // Report gear teeth of rotator ring and motor - GR:nn:nn
+        out = ResponseFormatter::writeText(_resultBuffer, "GR:");
+        out = ResponseFormatter::writeUnsigned(out, _eeprom->getRotatorGearTeeth());
+        out = ResponseFormatter::writeChar(out, ':');
+        ResponseFormatter::writeUnsigned(out, _eeprom->getMotorGearTeeth());
+
+        return _resultBuffer;
+
+    case FALCON_COMMAND_SET_GEAR_RATIO: // Set gear teeth of rotator ring and motor, stored in EEPROM - SR:nn:nn
+        if (argument.value > 255 || argument.value2 > 255)
             return RESPONSE_KO;
-        }
-    }
-    else if (command[0] == 'G' && command[1] == 'G')
-    {
-        sprintf(_resultBuffer1, "SG:%u", _eeprom->getSpeedMode());
 
-        return _resultBuffer1;
-    }
-    else if (command[0] == 'S' && command[1] == 'G')
-    {
-        long sm = (unsigned short)commandParam;
-        if (_eeprom->setSpeedMode(sm))
-        {
-            return RESPONSE_OK;
-        }
-        else
-        {
+        return _eeprom->setGearTeeth((unsigned char)argument.value, (unsigned char)argument.value2) ? RESPONSE_OK : RESPONSE_KO;
+
+    case FALCON_COMMAND_SET_BAUD: // Serial rate, answered at the current rate, then switched until confirmed with BC (BR reports the rate) - BR:n
+        if (argument.value != 0 && !_baudRate->request(argument.value))
             return RESPONSE_KO;
-        }
-    }
-    else if (command[0] == 'S' && command[1] == 'D')
+
+        out = ResponseFormatter::writeText(_resultBuffer, "BR:");
+        ResponseFormatter::writeUnsigned(out, argument.value != 0 ? argument.value : _baudRate->getBaud());
+
+        return _resultBuffer;
+
+    case FALCON_COMMAND_CONFIRM_BAUD: // Confirm the rate switched to with BR, stored in EEPROM - BC:n
+        if (!_baudRate->confirm())
+            return RESPONSE_KO;
+
+        out = ResponseFormatter::writeText(_resultBuffer, "BC:");
+        ResponseFormatter::writeUnsigned(out, _baudRate->getBaud());
+
+        return _resultBuffer;
+
+    case FALCON_COMMAND_BINARY_MODE: // Answered in ASCII, binary frames follow until BINARY_OP_EXIT, see BinaryProtocol.h - BM:1
+        _binaryProtocol->begin();
+        return "BM:1";
+
+    case FALCON_COMMAND_SUBSCRIBE: // Position events while moving, every interval ms or delta steps (PS:0:0 ends it) - PS:nn:nn
+        _eventIntervalMs = argument.value;
+        _eventDeltaSteps = argument.value2;
+        _lastEventPosition = _eeprom->getPosition();
+        _isEventMoveOpen = false;
+
+        out = ResponseFormatter::writeText(_resultBuffer, "PS:");
+        out = ResponseFormatter::writeUnsigned(out, _eventIntervalMs);
+        out = ResponseFormatter::writeChar(out, ':');
+        ResponseFormatter::writeUnsigned(out, _eventDeltaSteps);
+
+        return _resultBuffer;
+
+    case FALCON_COMMAND_TASK_STATUS: // Scheduler statistics of task n, see main.cpp - TS:n:runs:overruns:max latency us:max run us
     {
-        dtostrf(this->getStepsPerDeg(), 1, 2, _resultBuffer2);
-        sprintf(_resultBuffer1, "SD:%s", _resultBuffer2);
+        if (argument.value >= _scheduler->getTaskCount())
+            return RESPONSE_KO;
 
-        return _resultBuffer1;
+        const SchedulerTask &task = _scheduler->getTask(argument.value);
+        out = ResponseFormatter::writeText(_resultBuffer, "TS:");
+        out = ResponseFormatter::writeUnsigned(out, argument.value);
+        out = ResponseFormatter::writeChar(out, ':');
+        out = ResponseFormatter::writeUnsigned(out, task.runs);
+        out = ResponseFormatter::writeChar(out, ':');
+        out = ResponseFormatter::writeUnsigned(out, task.overruns);
+        out = ResponseFormatter::writeChar(out, ':');
+        out = ResponseFormatter::writeUnsigned(out, task.maxLatencyUs);
+        out = ResponseFormatter::writeChar(out, ':');
+        ResponseFormatter::writeUnsigned(out, task.maxRunUs);
+
+        return _resultBuffer;
     }
-    else if (command[0] == 'R' && command[1] == 'S')
-    {
-        _eeprom->resetToDefaults();
 
-        return RESPONSE_OK;
+#if TELEMETRY_ENABLED
+    case FALCON_COMMAND_TELEMETRY: // Telemetry counters, see Telemetry.h. TM:1 resets them after reading - TM:n:n:...
+        out = ResponseFormatter::writeText(_resultBuffer, "TM:");
+        Telemetry::write(out);
+        if (argument.flag)
+        {
+            Telemetry::reset();
+            _scheduler->resetStatistics();
+        }
+
+        return _resultBuffer;
+#endif
     }
 
     return "";
@@ -1,25 +1,137 @@
+#include "BaudRate.h"
 #include "CustomEEPROM.h"
 #include "Motor.h"
+#include "Scheduler.h"
+#include "SensorSampler.h"
+#include "Telemetry.h"
 
 #pragma once
 
+class BinaryProtocol;
+
 #define RESPONSE_OK "(OK)"
 #define RESPONSE_KO "(KO)"
 
+// the telemetry reply is the longest, eight numbers of up to ten digits
+#if TELEMETRY_ENABLED
+#define STRING_PROXY_RESULT_SIZE 96
+#else
+#define STRING_PROXY_RESULT_SIZE 50
+#endif
+
+/**
+ * Commands are looked up by hashing the two character opcode into a slot
+ * table, see StringProxy.cpp. The multiplier is chosen so that no two
+ * opcodes share a slot, a collision fails the build.
+ */
+#define FALCON_HASH_SLOTS 128 // must be a power of two
+#define FALCON_HASH_MULTIPLIER 14
+
+enum FalconCommandId
+{
+    FALCON_COMMAND_STATUS,
+    FALCON_COMMAND_STEPS_PER_DEG,
+    FALCON_COMMAND_FULL_STATUS,
+    FALCON_COMMAND_VERSION,
+    FALCON_COMMAND_POSITION_DEG,
+    FALCON_COMMAND_POSITION,
+    FALCON_COMMAND_HALT,
+    FALCON_COMMAND_IS_RUNNING,
+    FALCON_COMMAND_REVERSE,
+    FALCON_COMMAND_RELOAD,
+    FALCON_COMMAND_VOLTAGE,
+    FALCON_COMMAND_DEROTATION,
+    FALCON_COMMAND_SYNC_DEG,
+    FALCON_COMMAND_MOVE_DEG,
+    FALCON_COMMAND_MOVE,
+    FALCON_COMMAND_GET_STEP_MODE,
+    FALCON_COMMAND_SET_STEP_MODE,
+    FALCON_COMMAND_GET_SPEED_MODE,
+    FALCON_COMMAND_SET_SPEED_MODE,
+    FALCON_COMMAND_RESET,
+    FALCON_COMMAND_GET_GEAR_RATIO,
+    FALCON_COMMAND_SET_GEAR_RATIO,
+    FALCON_COMMAND_SET_BAUD,
+    FALCON_COMMAND_CONFIRM_BAUD,
+    FALCON_COMMAND_BINARY_MODE,
+    FALCON_COMMAND_SUBSCRIBE,
+    FALCON_COMMAND_TASK_STATUS,
+#if TELEMETRY_ENABLED
+    FALCON_COMMAND_TELEMETRY,
+#endif
+    FALCON_COMMAND_COUNT
+};
+
+enum FalconArgumentType
+{
+    FALCON_ARGUMENT_NONE,
+    FALCON_ARGUMENT_UNSIGNED,       // decimal integer
+    FALCON_ARGUMENT_DECIMAL,        // number with fraction, e.g. degrees, parsed to hundredths
+    FALCON_ARGUMENT_SIGNED_DECIMAL, // same, flag is set for negative numbers
+    FALCON_ARGUMENT_FLAG,           // 0 or 1
+    FALCON_ARGUMENT_PAIR            // two decimal integers, e.g. 100:20
+};
+
+/**
+ * PS:interval:delta subscribes to position events while the rotator moves
+ * (PS:0:0 ends it). An event is due every interval ms or every delta steps,
+ * whichever comes first, 0 disables either. Events are lines like replies:
+ *   PP:steps:deg  position during a move
+ *   PC:steps:deg  move complete, the settled position (a sync sends it too)
+ * Nothing is sent while homing.
+ */
+#define STRING_PROXY_EVENT_MAX_LENGTH 32
+
+// serial stays responsive while homing, commands that move the rotator or change its setup answer RESPONSE_KO until it is done (FH aborts homing)
+#define FALCON_FLAG_LOCKED_WHILE_HOMING 0x01
+
+class FalconCommand
+{
+public:
+    char opcode[2];
+    unsigned char id;
+    unsigned char argumentType;
+    unsigned char flags;
+};
+
+class FalconArgument
+{
+public:
+    unsigned long value;
+    unsigned long value2;
+    unsigned long hundredths;
+    bool flag;
+};
+
 class StringProxy
 {
 private:
     CustomEEPROM *_eeprom;
     Motor *_motor;
-    char _resultBuffer1[50];
-    char _resultBuffer2[50];
+    SensorSampler *_sensor;
+    Scheduler *_scheduler;
+    BaudRate *_baudRate;
+    BinaryProtocol *_binaryProtocol;
+    char _resultBuffer[STRING_PROXY_RESULT_SIZE];
+    unsigned long _eventIntervalMs = 0L;
+    unsigned long _eventDeltaSteps = 0L;
+    unsigned long _lastEventMs = 0L;
+    unsigned long _lastEventPosition = 0L;
+    bool _isEventMoveOpen = false;
+    char const *_formatPosition(const char *prefix);
     char *_uintToChar(unsigned int value);
     bool _commandEndsWith(char c, char commandParam[], int commandParamLength);
+    bool _findCommand(const char *command, FalconCommand &falconCommand);
+    unsigned long _parseHundredths(const char *commandParam, bool &isNegative);
+    void _parseArgument(unsigned char argumentType, const char *commandParam, FalconArgument &argument);
+    char const *_executeCommand(unsigned char id, const FalconArgument &argument);
 
 public:
-    void init(CustomEEPROM &eeprom, Motor &motor);
-    float getStepsPerDeg();
-    float stepsToDeg(unsigned long steps);
-    unsigned long degToSteps(float deg);
+    void init(CustomEEPROM &eeprom, Motor &motor, SensorSampler &sensor, Scheduler &scheduler, BaudRate &baudRate, BinaryProtocol &binaryProtocol);
+    unsigned long getStepsPerDegHundredths();
+    unsigned long stepsToHundredths(unsigned long steps);
+    unsigned long hundredthsToSteps(unsigned long hundredths);
     char const *processFalconCommand(char *command, char *commandParam, int commandParamLength);
+    char const *executeFalconCommand(const char *opcode, const FalconArgument &argument);
+    char const *pollEvent();
 };
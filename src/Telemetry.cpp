@@ -0,0 +1,94 @@
+#include <Arduino.h>
+#include <util/atomic.h>
+#include "ResponseFormatter.h"
+#include "Telemetry.h"
+
+#if TELEMETRY_ENABLED
+
+bool Telemetry::_hasLoopStart = false;
+unsigned long Telemetry::_loopStartUs = 0;
+unsigned long Telemetry::_loopMaxUs = 0;
+unsigned long Telemetry::_timerMaxUs[TELEMETRY_TIMER_COUNT];
+unsigned long Telemetry::_timerTotalMs[TELEMETRY_TIMER_COUNT];
+unsigned int Telemetry::_timerRestUs[TELEMETRY_TIMER_COUNT];
+volatile unsigned long Telemetry::_counters[TELEMETRY_COUNTER_COUNT];
+
+void Telemetry::markLoop()
+{
+    // one iteration is the time between two calls, the Arduino core's own work included
+    unsigned long now = micros();
+    unsigned long elapsed = now - _loopStartUs;
+
+    if (_hasLoopStart && elapsed > _loopMaxUs)
+        _loopMaxUs = elapsed;
+
+    _loopStartUs = now;
+    _hasLoopStart = true;
+}
+
+void Telemetry::addTime(unsigned char timer, unsigned long startUs)
+{
+    unsigned long elapsed = micros() - startUs;
+
+    if (elapsed > _timerMaxUs[timer])
+        _timerMaxUs[timer] = elapsed;
+
+    // totals in ms do not wrap after 71 minutes, the division only runs once per ms
+    unsigned long rest = _timerRestUs[timer] + elapsed;
+    if (rest >= 1000)
+    {
+        _timerTotalMs[timer] += rest / 1000;
+        rest %= 1000;
+    }
+
+    _timerRestUs[timer] = rest;
+}
+
+char *Telemetry::write(char *out)
+{
+    unsigned long counters[TELEMETRY_COUNTER_COUNT];
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for (unsigned char counter = 0; counter < TELEMETRY_COUNTER_COUNT; counter++)
+            counters[counter] = _counters[counter];
+    }
+
+    out = ResponseFormatter::writeUnsigned(out, _loopMaxUs);
+    for (unsigned char timer = 0; timer < TELEMETRY_TIMER_COUNT; timer++)
+    {
+        out = ResponseFormatter::writeChar(out, ':');
+        out = ResponseFormatter::writeUnsigned(out, _timerMaxUs[timer]);
+        out = ResponseFormatter::writeChar(out, ':');
+        out = ResponseFormatter::writeUnsigned(out, _timerTotalMs[timer]);
+    }
+
+    for (unsigned char counter = 0; counter < TELEMETRY_COUNTER_COUNT; counter++)
+    {
+        out = ResponseFormatter::writeChar(out, ':');
+        out = ResponseFormatter::writeUnsigned(out, counters[counter]);
+    }
+
+    return out;
+}
+
+void Telemetry::reset()
+{
+    // the running iteration is not measured, it contains the reset
+    _hasLoopStart = false;
+    _loopMaxUs = 0;
+
+    for (unsigned char timer = 0; timer < TELEMETRY_TIMER_COUNT; timer++)
+    {
+        _timerMaxUs[timer] = 0;
+        _timerTotalMs[timer] = 0;
+        _timerRestUs[timer] = 0;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for (unsigned char counter = 0; counter < TELEMETRY_COUNTER_COUNT; counter++)
+            _counters[counter] = 0;
+    }
+}
+
+#endif
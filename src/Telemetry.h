@@ -0,0 +1,91 @@
+#include <Arduino.h>
+
+#pragma once
+
+/**
+ * Field diagnostics: longest loop() iteration, time spent in the hot paths
+ * and event counters. Read with TM, TM:1 reads and resets them together
+ * with the task statistics of the scheduler:
+ * TM:<loop max us>:<motor max us>:<motor ms>:<EEPROM max us>:<EEPROM ms>:<EEPROM writes>:<EEPROM deferred>:<serial dropped>
+ * Times come from micros() (4us resolution at 16MHz). With TELEMETRY_ENABLED 0
+ * the counters, the hooks and the command are compiled out.
+ */
+#ifndef TELEMETRY_ENABLED
+#define TELEMETRY_ENABLED 1
+#endif
+
+enum TelemetryTimer
+{
+    TELEMETRY_TIMER_MOTOR,  // Motor::handleMotor
+    TELEMETRY_TIMER_EEPROM, // queueing a write, formatting and flushing the journal
+    TELEMETRY_TIMER_COUNT
+};
+
+enum TelemetryCounter
+{
+    TELEMETRY_COUNTER_EEPROM_WRITES,   // EEPROM cells programmed
+    TELEMETRY_COUNTER_EEPROM_DEFERRED, // writes postponed because the write queue was full
+    TELEMETRY_COUNTER_SERIAL_DROPPED,  // bytes beyond SERIAL_COMMAND_MAX_LENGTH
+    TELEMETRY_COUNTER_COUNT
+};
+
+#if TELEMETRY_ENABLED
+
+class Telemetry
+{
+private:
+    static bool _hasLoopStart;
+    static unsigned long _loopStartUs;
+    static unsigned long _loopMaxUs;
+    static unsigned long _timerMaxUs[TELEMETRY_TIMER_COUNT];
+    static unsigned long _timerTotalMs[TELEMETRY_TIMER_COUNT];
+    static unsigned int _timerRestUs[TELEMETRY_TIMER_COUNT];
+    static volatile unsigned long _counters[TELEMETRY_COUNTER_COUNT];
+
+public:
+    static void markLoop();
+    static void addTime(unsigned char timer, unsigned long startUs);
+    static char *write(char *out);
+    static void reset();
+
+    // also called from interrupts, every counter has a single writer
+    static void count(unsigned char counter)
+    {
+        _counters[counter]++;
+    }
+};
+
+/**
+ * Adds the time until the end of the scope to a timer
+ */
+class TelemetryScope
+{
+private:
+    unsigned char _timer;
+    unsigned long _startUs;
+
+public:
+    TelemetryScope(unsigned char timer) : _timer(timer), _startUs(micros()) {}
+
+    ~TelemetryScope()
+    {
+        Telemetry::addTime(_timer, _startUs);
+    }
+};
+
+#else
+
+class Telemetry
+{
+public:
+    static void markLoop() {}
+    static void count(unsigned char) {}
+};
+
+class TelemetryScope
+{
+public:
+    TelemetryScope(unsigned char) {}
+};
+
+#endif
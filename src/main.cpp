@@ -1,21 +1,94 @@
 #include <Arduino.h>
+#include "BaudRate.h"
+#include "BinaryProtocol.h"
 #include "CustomEEPROM.h"
 #include "Homing.h"
 #include "Motor.h"
+#include "Scheduler.h"
+#include "SensorSampler.h"
 #include "StringProxy.h"
+#include "Telemetry.h"
 #include "CustomSerial.h"
 #include <SoftwareSerial.h>
 #include "EEPROM.h"
 
+/**
+ * Tasks of the scheduler, see Scheduler.h. Priorities run the motor first so
+ * every other task sees the current position. Deadlines are what serial
+ * response time is sized for, a later start counts as overrun. TS:n reports
+ * task n in the order added below: motor, serial, homing, driver, EEPROM.
+ * Sensor sampling is not a task, the ADC interrupt filters every conversion.
+ */
+#define TASK_MOTOR_PRIORITY 0
+#define TASK_MOTOR_DEADLINE_US 2000UL
+#define TASK_SERIAL_PRIORITY 1
+#define TASK_SERIAL_DEADLINE_US 5000UL
+#define TASK_HOMING_PRIORITY 2
+#define TASK_HOMING_DEADLINE_US 5000UL
+#define TASK_DRIVER_PRIORITY 3
+#define TASK_DRIVER_PERIOD_MS 500
+#define TASK_DRIVER_DEADLINE_US 50000UL
+#define TASK_EEPROM_PRIORITY 4
+#define TASK_EEPROM_PERIOD_MS 10
+#define TASK_EEPROM_DEADLINE_US 10000UL
+
+BaudRate _baudRate;
+BinaryProtocol _binaryProtocol;
 CustomEEPROM _eeprom;
 Homing _homing;
 Motor _motor;
+Scheduler _scheduler;
+SensorSampler _sensor;
 StringProxy _stringProxy;
 CustomSerial _serial;
 
 SoftwareSerial loopbackSerial(4, 6); // RX, TX
 
 int pm = 0;
+unsigned char _driverTask;
+unsigned char _homingTask;
+
+static void _runMotor()
+{
+    _motor.handleMotor();
+}
+
+static void _runSerial()
+{
+    _serial.serialEvent(loopbackSerial);
+}
+
+static void _startHoming()
+{
+    _scheduler.suspend(_driverTask);
+    _homing.begin();
+    _scheduler.signal(_homingTask);
+}
+
+static void _runHoming()
+{
+    // one step per run, signaled again until home is found
+    if (_homing.handle())
+        _scheduler.signal(_homingTask);
+}
+
+static void _runDriver()
+{
+    // retries the driver UART until it answers, then homing starts
+    if (!_motor.init(_eeprom))
+    {
+        digitalWrite(LED_BUILTIN, (pm++ % 2) == 0 ? HIGH : LOW);
+        return;
+    }
+
+    digitalWrite(LED_BUILTIN, LOW);
+    _startHoming();
+}
+
+static void _runEeprom()
+{
+    _eeprom.handleEeprom();
+}
 
 void setup()
 {
@@ -25,48 +98,30 @@ void setup()
         digitalWrite(LED_BUILTIN, (pm++ % 2) == 0 ? HIGH : LOW);
         delay(10);
     }
-    Serial.begin(9600, SERIAL_8N1);
     loopbackSerial.begin(9600);
     loopbackSerial.println("Hello, world?");
     _eeprom.init();
+    _baudRate.init(_eeprom);
+    _sensor.init();
     _motor.init(_eeprom);
-    _stringProxy.init(_eeprom, _motor);
-    _serial.init(_stringProxy);
-    _homing.init(_eeprom, _motor, _stringProxy);
+    _stringProxy.init(_eeprom, _motor, _sensor, _scheduler, _baudRate, _binaryProtocol);
+    _binaryProtocol.init(_stringProxy, _motor, _eeprom);
+    _serial.init(_stringProxy, _motor, _baudRate, _binaryProtocol);
+    _homing.init(_eeprom, _motor, _stringProxy, _sensor);
+
+    _scheduler.add(_runMotor, TASK_MOTOR_PRIORITY, SCHEDULER_CONTINUOUS, TASK_MOTOR_DEADLINE_US);
+    _scheduler.add(_runSerial, TASK_SERIAL_PRIORITY, SCHEDULER_CONTINUOUS, TASK_SERIAL_DEADLINE_US);
+    _homingTask = _scheduler.add(_runHoming, TASK_HOMING_PRIORITY, SCHEDULER_EVENT, TASK_HOMING_DEADLINE_US);
+    _driverTask = _scheduler.add(_runDriver, TASK_DRIVER_PRIORITY, TASK_DRIVER_PERIOD_MS, TASK_DRIVER_DEADLINE_US);
+    _scheduler.add(_runEeprom, TASK_EEPROM_PRIORITY, TASK_EEPROM_PERIOD_MS, TASK_EEPROM_DEADLINE_US);
+
+    if (_motor.isUartInitialized())
+        _startHoming();
 }
 
 void loop()
 {
-    if (!_motor.isUartInitialized())
-    {
-        if (!_motor.init(_eeprom))
-        {
-            digitalWrite(LED_BUILTIN, (pm++ % 2) == 0 ? HIGH : LOW);
-            _serial.serialEvent(loopbackSerial);
-            delay(500);
-            return;
-        }
-        else
-        {
-            digitalWrite(LED_BUILTIN, LOW);
-        }
-    }
+    Telemetry::markLoop();
 
-    if (!_homing.isHomed())
-    {
-        if (_homing.isHoming())
-        {
-            return;
-        }
-
-        _homing.findHomePosition();
-    }
-
-    _motor.handleMotor();
-    _serial.serialEvent(loopbackSerial);
-
-    if (_motor.isMoving())
-        return;
-
-    _eeprom.handleEeprom();
+    _scheduler.run();
 }
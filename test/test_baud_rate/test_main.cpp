@@ -0,0 +1,164 @@
+#include <unity.h>
+#include "BaudRate.h"
+
+/**
+ * The BR/BC handshake on the simulated UART: a switch waits for the BR
+ * reply, falls back to the previous rate without BC within
+ * BAUD_RATE_CONFIRM_MS and is stored once confirmed. Boot listens at
+ * SERIAL_BAUD_DEFAULT for BAUD_RATE_RECOVERY_MS before the stored rate,
+ * unless a command was answered meanwhile.
+ */
+#define TEST_MS_CYCLES (F_CPU / 1000)
+#define TEST_BAUD 115200UL
+#define TEST_OTHER_BAUD 250000UL
+
+static CustomEEPROM _eeprom;
+static BaudRate _baudRate;
+
+void setUp(void)
+{
+    Simulator::reset();
+    _eeprom = CustomEEPROM();
+    _eeprom.init();
+    _baudRate = BaudRate();
+}
+
+void tearDown(void) {}
+
+static void _advanceMs(unsigned long ms)
+{
+    Simulator::advance(ms * TEST_MS_CYCLES);
+}
+
+// BR:baud answered and the switch done, like the serial task runs it
+static void _switch(unsigned long baud)
+{
+    TEST_ASSERT_TRUE(_baudRate.request(baud));
+    TEST_ASSERT_TRUE(_baudRate.isSwitchPending());
+    TEST_ASSERT_TRUE(_baudRate.handle());
+    TEST_ASSERT_FALSE(_baudRate.isSwitchPending());
+    TEST_ASSERT_EQUAL_UINT32(baud, _baudRate.getBaud());
+    TEST_ASSERT_EQUAL_UINT32(baud, Simulator::serialBaud());
+}
+
+static void test_reply_before_switch(void)
+{
+    _baudRate.init(_eeprom);
+
+    // the reply is still in the transmit buffer, it goes out at the old rate first
+    TEST_ASSERT_TRUE(_baudRate.request(TEST_BAUD));
+    Serial.print("BR:115200;\r\n");
+    TEST_ASSERT_FALSE(_baudRate.handle());
+    TEST_ASSERT_EQUAL_UINT32(SERIAL_BAUD_DEFAULT, Simulator::serialBaud());
+
+    // a second request waits for the first one
+    TEST_ASSERT_FALSE(_baudRate.request(TEST_OTHER_BAUD));
+
+    _advanceMs(20);
+    TEST_ASSERT_TRUE(_baudRate.handle());
+    TEST_ASSERT_EQUAL_UINT32(TEST_BAUD, Simulator::serialBaud());
+    TEST_ASSERT_EQUAL_STRING("BR:115200;", Simulator::deviceLines().back().text.c_str());
+}
+
+static void test_revert_without_confirm(void)
+{
+    _baudRate.init(_eeprom);
+    _switch(TEST_BAUD);
+
+    _advanceMs(BAUD_RATE_CONFIRM_MS);
+    TEST_ASSERT_FALSE(_baudRate.handle());
+    TEST_ASSERT_EQUAL_UINT32(TEST_BAUD, Simulator::serialBaud());
+
+    _advanceMs(2);
+    TEST_ASSERT_TRUE(_baudRate.handle());
+    TEST_ASSERT_EQUAL_UINT32(SERIAL_BAUD_DEFAULT, _baudRate.getBaud());
+    TEST_ASSERT_EQUAL_UINT32(SERIAL_BAUD_DEFAULT, Simulator::serialBaud());
+    TEST_ASSERT_EQUAL_UINT32(SERIAL_BAUD_DEFAULT, _eeprom.getSerialBaud());
+
+    // nothing left to confirm
+    TEST_ASSERT_FALSE(_baudRate.confirm());
+}
+
+static void test_confirm(void)
+{
+    _baudRate.init(_eeprom);
+
+    // BC without a switch, and unsupported rates, are refused
+    TEST_ASSERT_FALSE(_baudRate.confirm());
+    TEST_ASSERT_FALSE(_baudRate.request(12345));
+
+    _switch(TEST_BAUD);
+    _advanceMs(BAUD_RATE_CONFIRM_MS / 2);
+    TEST_ASSERT_TRUE(_baudRate.confirm());
+    TEST_ASSERT_EQUAL_UINT32(TEST_BAUD, _eeprom.getSerialBaud());
+
+    _advanceMs(BAUD_RATE_CONFIRM_MS);
+    TEST_ASSERT_FALSE(_baudRate.handle());
+    TEST_ASSERT_EQUAL_UINT32(TEST_BAUD, Simulator::serialBaud());
+
+    // a confirmed rate is the one to fall back to
+    _switch(TEST_OTHER_BAUD);
+    _advanceMs(BAUD_RATE_CONFIRM_MS + 2);
+    TEST_ASSERT_TRUE(_baudRate.handle());
+    TEST_ASSERT_EQUAL_UINT32(TEST_BAUD, Simulator::serialBaud());
+    TEST_ASSERT_EQUAL_UINT32(TEST_BAUD, _eeprom.getSerialBaud());
+}
+
+static void test_boot_recovery(void)
+{
+    // the stored rate follows the recovery window at the default rate
+    _eeprom.setSerialBaud(TEST_BAUD);
+    _baudRate.init(_eeprom);
+    TEST_ASSERT_EQUAL_UINT32(SERIAL_BAUD_DEFAULT, Simulator::serialBaud());
+
+    _advanceMs(BAUD_RATE_RECOVERY_MS);
+    TEST_ASSERT_FALSE(_baudRate.handle());
+    TEST_ASSERT_EQUAL_UINT32(SERIAL_BAUD_DEFAULT, Simulator::serialBaud());
+
+    _advanceMs(2);
+    TEST_ASSERT_TRUE(_baudRate.handle());
+    TEST_ASSERT_EQUAL_UINT32(TEST_BAUD, Simulator::serialBaud());
+
+    // once, the stored rate needs no confirmation
+    _advanceMs(BAUD_RATE_CONFIRM_MS + 2);
+    TEST_ASSERT_FALSE(_baudRate.handle());
+    TEST_ASSERT_EQUAL_UINT32(TEST_BAUD, Simulator::serialBaud());
+}
+
+static void test_recovery_kept(void)
+{
+    // a command answered at the default rate within the window keeps it until the next reset
+    _eeprom.setSerialBaud(TEST_BAUD);
+    _baudRate.init(_eeprom);
+    _advanceMs(BAUD_RATE_RECOVERY_MS / 2);
+    _baudRate.keepRecoveryRate();
+
+    _advanceMs(BAUD_RATE_RECOVERY_MS);
+    TEST_ASSERT_FALSE(_baudRate.handle());
+    TEST_ASSERT_EQUAL_UINT32(SERIAL_BAUD_DEFAULT, Simulator::serialBaud());
+    TEST_ASSERT_EQUAL_UINT32(TEST_BAUD, _eeprom.getSerialBaud());
+}
+
+static void test_unsupported_stored_rate(void)
+{
+    // a stored rate the firmware does not support is replaced by the default, no recovery window
+    _eeprom.setSerialBaud(12345);
+    _baudRate.init(_eeprom);
+    TEST_ASSERT_EQUAL_UINT32(SERIAL_BAUD_DEFAULT, _eeprom.getSerialBaud());
+
+    _advanceMs(BAUD_RATE_RECOVERY_MS + 2);
+    TEST_ASSERT_FALSE(_baudRate.handle());
+    TEST_ASSERT_EQUAL_UINT32(SERIAL_BAUD_DEFAULT, Simulator::serialBaud());
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_reply_before_switch);
+    RUN_TEST(test_revert_without_confirm);
+    RUN_TEST(test_confirm);
+    RUN_TEST(test_boot_recovery);
+    RUN_TEST(test_recovery_kept);
+    RUN_TEST(test_unsupported_stored_rate);
+    return UNITY_END();
+}
@@ -0,0 +1,195 @@
+#include <unity.h>
+#include "BinaryProtocol.h"
+#include "CustomEEPROM.h"
+#include "Motor.h"
+#include "ResponseFormatter.h"
+#include "StringProxy.h"
+
+/**
+ * Moves and derotation on the modular axis with a cable wrap limit below half a
+ * revolution (pio test -e native_cable_wrap), so some targets can be reached the
+ * longer way around only and some not at all. 20480 steps per revolution.
+ */
+#if !ROTATOR_MODULAR_AXIS || ROTATOR_CABLE_WRAP_DEG != 120
+#error "test_cable_wrap needs -D ROTATOR_MODULAR_AXIS=1 -D ROTATOR_CABLE_WRAP_DEG=120"
+#endif
+
+#define TEST_POLL_CYCLES (F_CPU / 100)
+#define TEST_LIMIT_STEPS 6826L // 120 deg
+
+static CustomEEPROM _eeprom;
+static Motor _motor;
+static SensorSampler _sensor;
+static Scheduler _scheduler;
+static BaudRate _baudRate;
+static BinaryProtocol _binaryProtocol;
+static StringProxy _stringProxy;
+
+void setUp(void)
+{
+    // at home, cable unwound
+    _motor.resetCableWrap();
+    _eeprom.setPosition(0);
+    _eeprom.setTargetPosition(0);
+}
+
+void tearDown(void) {}
+
+static unsigned long _degToSteps(unsigned long deg)
+{
+    return _motor.getStepConverter().hundredthsToSteps(deg * 100);
+}
+
+static void _runToEnd()
+{
+    while (_motor.handleMotor())
+        Simulator::advance(TEST_POLL_CYCLES);
+}
+
+// moves to the target from wherever the last move ended, returns the signed steps the motor made
+static long _moveToSteps(unsigned long targetPosition)
+{
+    long motorSteps = Simulator::motorSteps();
+
+    TEST_ASSERT_TRUE(_eeprom.setTargetPosition(targetPosition));
+    _motor.startMotor(5);
+    _runToEnd();
+
+    return Simulator::motorSteps() - motorSteps;
+}
+
+static long _moveTo(unsigned long deg)
+{
+    return _moveToSteps(_degToSteps(deg));
+}
+
+static void test_within_limit(void)
+{
+    // the shorter way whenever it stays within 120 deg of home, across 0 as well
+    TEST_ASSERT_EQUAL_INT32(_degToSteps(100), _moveTo(100));
+    TEST_ASSERT_EQUAL_INT32(-(long)(_degToSteps(100) + _motor.getStepsPerRevolution() - _degToSteps(300)), _moveTo(300));
+    TEST_ASSERT_EQUAL_UINT32(_degToSteps(300), _eeprom.getPosition());
+    TEST_ASSERT_EQUAL_INT32(-(long)(_degToSteps(300) - _degToSteps(250)), _moveTo(250));
+    TEST_ASSERT_EQUAL_INT32(_motor.getStepsPerRevolution() - _degToSteps(250), _moveTo(0));
+}
+
+static void test_redirect(void)
+{
+    TEST_ASSERT_EQUAL_INT32(_degToSteps(100), _moveTo(100));
+
+    // 100 -> 250 is 150 deg forward to a wrap of 250 deg, 210 deg back unwinds to -110 deg
+    long move = _moveTo(250);
+    TEST_ASSERT_EQUAL_INT32(-(long)(_motor.getStepsPerRevolution() - _degToSteps(250) + _degToSteps(100)), move);
+    TEST_ASSERT_EQUAL_UINT32(_degToSteps(250), _eeprom.getPosition());
+
+    // and 250 -> 100 forward again, the shorter way would wind past -120 deg
+    TEST_ASSERT_EQUAL_INT32(-move, _moveTo(100));
+    TEST_ASSERT_EQUAL_UINT32(_degToSteps(100), _eeprom.getPosition());
+}
+
+static void test_redirect_tie(void)
+{
+    TEST_ASSERT_EQUAL_INT32(_degToSteps(100), _moveTo(100));
+
+    // the 180 deg tie forward would wind to 280 deg, backwards ends at -80 deg
+    TEST_ASSERT_EQUAL_INT32(-(long)(_motor.getStepsPerRevolution() / 2), _moveTo(280));
+    TEST_ASSERT_EQUAL_UINT32(_degToSteps(280), _eeprom.getPosition());
+}
+
+static void test_refuse(void)
+{
+    TEST_ASSERT_EQUAL_INT32(_degToSteps(100), _moveTo(100));
+
+    // 200 deg is 200 deg forward or 160 deg back from home, beyond 120 deg either way
+    TEST_ASSERT_EQUAL_INT32(0, _moveTo(200));
+    TEST_ASSERT_EQUAL_UINT32(_degToSteps(100), _eeprom.getPosition());
+    TEST_ASSERT_EQUAL_UINT32(_degToSteps(100), _eeprom.getTargetPosition());
+    TEST_ASSERT_FALSE(_motor.isMoving());
+
+    // the refused move left the wrap alone, the limit itself is still reachable, one step more is not
+    TEST_ASSERT_EQUAL_INT32(TEST_LIMIT_STEPS - (long)_degToSteps(100), _moveToSteps(TEST_LIMIT_STEPS));
+    TEST_ASSERT_EQUAL_INT32(0, _moveToSteps(TEST_LIMIT_STEPS + 1));
+    TEST_ASSERT_EQUAL_INT32(-2 * TEST_LIMIT_STEPS, _moveToSteps(_motor.getStepsPerRevolution() - TEST_LIMIT_STEPS));
+    TEST_ASSERT_EQUAL_INT32(0, _moveToSteps(_motor.getStepsPerRevolution() - TEST_LIMIT_STEPS - 1));
+}
+
+// a serial command "CC:param", split like CustomSerial does
+static const char *_command(const char *line)
+{
+    static char command[32];
+    int length = strlen(line);
+    strcpy(command, line);
+
+    return _stringProxy.processFalconCommand(command, command + 3, length - 3);
+}
+
+static void test_refuse_command(void)
+{
+    TEST_ASSERT_EQUAL_INT32(_degToSteps(100), _moveTo(100));
+
+    // 200 deg is out of reach both ways, the host is told and the target stays
+    TEST_ASSERT_EQUAL_STRING(RESPONSE_KO, _command("MD:200.00"));
+    TEST_ASSERT_EQUAL_UINT32(_degToSteps(100), _eeprom.getTargetPosition());
+    TEST_ASSERT_FALSE(_motor.isMoving());
+
+    char line[16] = "MS:";
+    ResponseFormatter::writeUnsigned(line + 3, TEST_LIMIT_STEPS + 1);
+    TEST_ASSERT_EQUAL_STRING(RESPONSE_KO, _command(line));
+    TEST_ASSERT_EQUAL_UINT32(_degToSteps(100), _eeprom.getTargetPosition());
+
+    // the binary MOVE_STEPS runs the same command, RESPONSE_KO becomes BINARY_STATUS_REFUSED
+    FalconArgument argument = {TEST_LIMIT_STEPS + 1, 0, TEST_LIMIT_STEPS + 1, false};
+    TEST_ASSERT_EQUAL_STRING(RESPONSE_KO, _stringProxy.executeFalconCommand("MS", argument));
+    TEST_ASSERT_FALSE(_motor.isMoving());
+
+    // the limit itself is accepted
+    ResponseFormatter::writeUnsigned(line + 3, TEST_LIMIT_STEPS);
+    TEST_ASSERT_EQUAL_STRING(line, _command(line));
+    TEST_ASSERT_TRUE(_motor.isMoving());
+    _runToEnd();
+    TEST_ASSERT_EQUAL_UINT32(TEST_LIMIT_STEPS, _eeprom.getPosition());
+}
+
+static void test_derotation_stops_at_limit(void)
+{
+    TEST_ASSERT_EQUAL_INT32(_degToSteps(100), _moveTo(100));
+
+    // 1ms per step, runs until the wrap reaches the limit
+    long motorSteps = Simulator::motorSteps();
+    _motor.startDerotation(100, true);
+    TEST_ASSERT_TRUE(_motor.isDerotating());
+    _runToEnd();
+
+    TEST_ASSERT_EQUAL_INT32(TEST_LIMIT_STEPS - (long)_degToSteps(100), Simulator::motorSteps() - motorSteps);
+    TEST_ASSERT_EQUAL_UINT32(TEST_LIMIT_STEPS, _eeprom.getPosition());
+
+    // backwards all the way to the other end
+    motorSteps = Simulator::motorSteps();
+    _motor.startDerotation(100, false);
+    _runToEnd();
+
+    TEST_ASSERT_EQUAL_INT32(-2 * TEST_LIMIT_STEPS, Simulator::motorSteps() - motorSteps);
+    TEST_ASSERT_EQUAL_UINT32(_motor.getStepsPerRevolution() - TEST_LIMIT_STEPS, _eeprom.getPosition());
+
+    // at the limit there is nothing left
+    motorSteps = Simulator::motorSteps();
+    _motor.startDerotation(100, false);
+    _runToEnd();
+    TEST_ASSERT_EQUAL_INT32(motorSteps, Simulator::motorSteps());
+}
+
+int main(int argc, char **argv)
+{
+    _eeprom.init();
+    _motor.init(_eeprom);
+    _stringProxy.init(_eeprom, _motor, _sensor, _scheduler, _baudRate, _binaryProtocol);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_within_limit);
+    RUN_TEST(test_redirect);
+    RUN_TEST(test_redirect_tie);
+    RUN_TEST(test_refuse);
+    RUN_TEST(test_refuse_command);
+    RUN_TEST(test_derotation_stops_at_limit);
+    return UNITY_END();
+}
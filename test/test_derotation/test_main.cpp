@@ -0,0 +1,120 @@
+#include <unity.h>
+#include "CustomEEPROM.h"
+#include "Motor.h"
+
+/**
+ * Derotation on the simulated motor and Timer1: step n must come n intervals
+ * after the start, however many steps ran before it, so the rotator follows
+ * the field rotation without drifting. Linear axis, maxPosition 1000000.
+ */
+#define TEST_CYCLES_PER_HUNDREDTH_MS (F_CPU / 100000UL)
+#define TEST_LATENCY_CYCLES 400 // compare match to the step: interrupt entry and the driver pin writes
+#define TEST_START_POSITION 500000UL
+
+static CustomEEPROM _eeprom;
+static Motor _motor;
+
+void setUp(void)
+{
+    _eeprom.syncPosition(TEST_START_POSITION);
+}
+
+void tearDown(void)
+{
+    _motor.stopMotor();
+}
+
+// runs steps intervals, checks the steps done and the time of the last one at every checkpoint
+static void _assertNoDrift(unsigned long intervalHundredthsMs, bool forward, unsigned long steps, unsigned long checkpoints)
+{
+    uint64_t intervalCycles = (uint64_t)intervalHundredthsMs * TEST_CYCLES_PER_HUNDREDTH_MS;
+    long motorSteps = Simulator::motorSteps();
+
+    _eeprom.syncPosition(TEST_START_POSITION);
+    _motor.startDerotation(intervalHundredthsMs, forward);
+    uint64_t startCycle = Simulator::cycles();
+    TEST_ASSERT_TRUE(_motor.isDerotating());
+
+    for (unsigned long checkpoint = 1; checkpoint <= checkpoints; checkpoint++)
+    {
+        unsigned long expected = steps * checkpoint / checkpoints;
+
+        // half an interval past step n there are exactly n steps
+        Simulator::advanceTo(startCycle + expected * intervalCycles + intervalCycles / 2);
+        TEST_ASSERT_TRUE(_motor.handleMotor());
+
+        long done = Simulator::motorSteps() - motorSteps;
+        TEST_ASSERT_EQUAL_INT32(expected, forward ? done : -done);
+        TEST_ASSERT_EQUAL_UINT32(forward ? TEST_START_POSITION + expected : TEST_START_POSITION - expected, _eeprom.getPosition());
+
+        uint64_t stepCycle = startCycle + expected * intervalCycles;
+        TEST_ASSERT_GREATER_OR_EQUAL(stepCycle, Simulator::motorStepCycle());
+        TEST_ASSERT_LESS_THAN(stepCycle + TEST_LATENCY_CYCLES, Simulator::motorStepCycle());
+    }
+
+    _motor.stopMotor();
+}
+
+static void test_whole_milliseconds(void)
+{
+    // 1 ms per step for 100 s
+    _assertNoDrift(100, true, 100000, 10);
+}
+
+static void test_fractional_milliseconds(void)
+{
+    // DR:333.33 and DR:-1234.56 for an hour
+    _assertNoDrift(33333, true, 10800, 6);
+    _assertNoDrift(123456, false, 2916, 6);
+}
+
+static void test_longer_than_timer_range(void)
+{
+    // 40.01 ms is 80020 ticks, beyond one 16 bit compare, every step is chunked
+    _assertNoDrift(4001, true, 9000, 9);
+}
+
+static void test_stop(void)
+{
+    // 10 ms per step, stopped after 55 ms
+    _motor.startDerotation(1000, true);
+    Simulator::advance(5500 * TEST_CYCLES_PER_HUNDREDTH_MS);
+    _motor.stopMotor();
+
+    long motorSteps = Simulator::motorSteps();
+    Simulator::advance(10000 * TEST_CYCLES_PER_HUNDREDTH_MS);
+
+    TEST_ASSERT_FALSE(_motor.isDerotating());
+    TEST_ASSERT_FALSE(_motor.handleMotor());
+    TEST_ASSERT_EQUAL_INT32(motorSteps, Simulator::motorSteps());
+    TEST_ASSERT_EQUAL_UINT32(TEST_START_POSITION + 5, _eeprom.getPosition());
+}
+
+static void test_end_of_axis(void)
+{
+    // backwards from 50 ends at 0 by itself
+    _eeprom.syncPosition(50);
+    long motorSteps = Simulator::motorSteps();
+
+    _motor.startDerotation(100, false);
+    Simulator::advance(200 * 100 * TEST_CYCLES_PER_HUNDREDTH_MS);
+    _motor.handleMotor();
+
+    TEST_ASSERT_FALSE(_motor.isMoving());
+    TEST_ASSERT_EQUAL_INT32(motorSteps - 50, Simulator::motorSteps());
+    TEST_ASSERT_EQUAL_UINT32(0, _eeprom.getPosition());
+}
+
+int main(int argc, char **argv)
+{
+    _eeprom.init();
+    _motor.init(_eeprom);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_whole_milliseconds);
+    RUN_TEST(test_fractional_milliseconds);
+    RUN_TEST(test_longer_than_timer_range);
+    RUN_TEST(test_stop);
+    RUN_TEST(test_end_of_axis);
+    return UNITY_END();
+}
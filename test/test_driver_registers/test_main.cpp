@@ -0,0 +1,116 @@
+#include <unity.h>
+#include "CustomEEPROM.h"
+#include "Motor.h"
+
+/**
+ * TMC2208 register writes on the simulated driver UART (pio test -e
+ * native_tmc220x): boot composes every field of CHOPCONF into one datagram,
+ * moves with an unchanged step mode write nothing, a new step mode writes
+ * CHOPCONF once.
+ */
+#if MOTOR_DRIVER != MOTOR_DRIVER_TMC220X
+#error "test_driver_registers needs -D MOTOR_DRIVER=1"
+#endif
+
+#define TEST_POLL_CYCLES (F_CPU / 100)
+#define TEST_MOVES 10
+#define TEST_MOVE_STEPS 2000UL
+#define TEST_START_POSITION 500000UL
+
+static CustomEEPROM _eeprom;
+static Motor _motor;
+
+void setUp(void)
+{
+    _eeprom.syncPosition(TEST_START_POSITION);
+}
+
+void tearDown(void) {}
+
+// a move the way MS runs it: the step mode is applied first
+static void _move(unsigned long targetPosition)
+{
+    TEST_ASSERT_TRUE(_eeprom.setTargetPosition(targetPosition));
+    _motor.applyStepMode();
+    _motor.startMotor();
+
+    while (_motor.handleMotor())
+        Simulator::advance(TEST_POLL_CYCLES);
+
+    TEST_ASSERT_EQUAL_UINT32(targetPosition, _eeprom.getPosition());
+}
+
+static void test_boot(void)
+{
+    // init() ran in main: GCONF, TPOWERDOWN, one CHOPCONF and one IHOLD_IRUN
+    TEST_ASSERT_EQUAL_UINT32(1, Simulator::tmcWrites(SIM_TMC_GCONF));
+    TEST_ASSERT_EQUAL_UINT32(1, Simulator::tmcWrites(SIM_TMC_TPOWERDOWN));
+    TEST_ASSERT_EQUAL_UINT32(1, Simulator::tmcWrites(SIM_TMC_CHOPCONF));
+    TEST_ASSERT_EQUAL_UINT32(1, Simulator::tmcWrites(SIM_TMC_IHOLD_IRUN));
+
+    // toff, tbl, MRES of the stored step mode and vsense all in that one CHOPCONF
+    uint32_t chopconf = Simulator::tmcRegister(SIM_TMC_CHOPCONF);
+    TEST_ASSERT_EQUAL_HEX32(TMC220X_CHOPCONF_TOFF, chopconf & TMC220X_CHOPCONF_TOFF_MASK);
+    TEST_ASSERT_EQUAL_HEX32(TMC220X_CHOPCONF_TBL, (chopconf >> TMC220X_CHOPCONF_TBL_SHIFT) & 3);
+    TEST_ASSERT_EQUAL_UINT32(256 >> ((chopconf & TMC220X_CHOPCONF_MRES_MASK) >> TMC220X_CHOPCONF_MRES_SHIFT), _eeprom.getStepMode());
+    TEST_ASSERT_TRUE(chopconf & TMC220X_CHOPCONF_VSENSE); // 450mA of 90% MOTOR_I is in the low range
+}
+
+static void test_repeated_moves(void)
+{
+    unsigned long transactions = Simulator::tmcTransactions();
+
+    for (int i = 0; i < TEST_MOVES; i++)
+        _move(i % 2 == 0 ? TEST_START_POSITION + TEST_MOVE_STEPS : TEST_START_POSITION);
+
+    TEST_ASSERT_EQUAL_UINT32(0, Simulator::tmcTransactions() - transactions);
+}
+
+static void test_step_mode_change(void)
+{
+    unsigned short stepMode = _eeprom.getStepMode();
+    unsigned short otherStepMode = stepMode == 16 ? 8 : 16;
+    uint32_t chopconf = Simulator::tmcRegister(SIM_TMC_CHOPCONF);
+
+    // the move after SS writes CHOPCONF once, only MRES differs
+    unsigned long transactions = Simulator::tmcTransactions();
+    TEST_ASSERT_TRUE(_eeprom.setStepMode(otherStepMode));
+    _move(TEST_START_POSITION + TEST_MOVE_STEPS);
+
+    TEST_ASSERT_EQUAL_UINT32(1, Simulator::tmcTransactions() - transactions);
+    TEST_ASSERT_EQUAL_HEX32(chopconf & ~TMC220X_CHOPCONF_MRES_MASK, Simulator::tmcRegister(SIM_TMC_CHOPCONF) & ~TMC220X_CHOPCONF_MRES_MASK);
+
+    // the next moves write nothing, going back writes it once more
+    transactions = Simulator::tmcTransactions();
+    _move(TEST_START_POSITION);
+    TEST_ASSERT_EQUAL_UINT32(0, Simulator::tmcTransactions() - transactions);
+
+    TEST_ASSERT_TRUE(_eeprom.setStepMode(stepMode));
+    _move(TEST_START_POSITION + TEST_MOVE_STEPS);
+    TEST_ASSERT_EQUAL_UINT32(1, Simulator::tmcTransactions() - transactions);
+    TEST_ASSERT_EQUAL_HEX32(chopconf, Simulator::tmcRegister(SIM_TMC_CHOPCONF));
+}
+
+static void test_init_again(void)
+{
+    // the driver may have lost power, init() writes every register once more, each once
+    unsigned long chopconfWrites = Simulator::tmcWrites(SIM_TMC_CHOPCONF);
+    unsigned long iholdIrunWrites = Simulator::tmcWrites(SIM_TMC_IHOLD_IRUN);
+    TEST_ASSERT_TRUE(_motor.init(_eeprom));
+
+    TEST_ASSERT_EQUAL_UINT32(chopconfWrites + 1, Simulator::tmcWrites(SIM_TMC_CHOPCONF));
+    TEST_ASSERT_EQUAL_UINT32(iholdIrunWrites + 1, Simulator::tmcWrites(SIM_TMC_IHOLD_IRUN));
+}
+
+int main(int argc, char **argv)
+{
+    _eeprom.init();
+    _motor.init(_eeprom);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_boot);
+    RUN_TEST(test_repeated_moves);
+    RUN_TEST(test_step_mode_change);
+    RUN_TEST(test_init_again);
+    return UNITY_END();
+}
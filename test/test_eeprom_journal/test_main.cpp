@@ -0,0 +1,460 @@
+#include <unity.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include "CustomEEPROM.h"
+
+/**
+ * CustomEEPROM on the simulated EEPROM with power cut after every byte of a
+ * journal record write or configuration save, the byte being programmed
+ * either lost or left erased, and the migration of older layouts.
+ * Every boot mounts a fresh CustomEEPROM like the firmware after reset.
+ */
+#define TEST_CHECK_PERIOD_CYCLES ((EEPROM_CHECK_PERIOD_MS + 1) * (F_CPU / 1000))
+#define TEST_POLL_CYCLES 1000
+#define TEST_JOURNAL_SLOTS ((EEPROM_SIZE - EEPROM_JOURNAL_ADDRESS) / sizeof(EEPROMRecord))
+#define TEST_AT_REST_POSITION 12345UL
+#define TEST_MOVING_POSITION 67890UL
+#define TEST_DEFAULT_MAX_POSITION 1000000UL
+#define TEST_MAX_POSITION 2000000UL
+#define TEST_MOTOR_I_MOVE_MULTIPLIER 70
+#define TEST_V0_SLOT 3
+
+void setUp(void)
+{
+    Simulator::reset();
+}
+
+void tearDown(void) {}
+
+// flush() spins on EECR, polling in larger steps keeps the simulation fast
+static void _waitForWrites(CustomEEPROM &eeprom)
+{
+    while (eeprom.isWriting())
+        Simulator::advance(TEST_POLL_CYCLES);
+}
+
+// the rotator stopped at position after homing: an at rest record once the check period passed
+static void _saveAtRest(CustomEEPROM &eeprom, unsigned long position)
+{
+    eeprom.setPositionTrusted(false);
+    eeprom.setPosition(position);
+    eeprom.setTargetPosition(position);
+    eeprom.setPositionTrusted(true);
+
+    Simulator::advance(TEST_CHECK_PERIOD_CYCLES);
+    eeprom.handleEeprom();
+    _waitForWrites(eeprom);
+}
+
+// a move starts from position: the untrusted record is queued at once, returns the bytes it takes
+static unsigned long _startMove(CustomEEPROM &eeprom, unsigned long position)
+{
+    unsigned long eepromWrites = Simulator::eepromWrites();
+
+    // trusting alone writes nothing, losing the trust does
+    eeprom.setPositionTrusted(true);
+    eeprom.setPosition(position);
+    eeprom.setTargetPosition(position + 1000);
+    eeprom.setPositionTrusted(false);
+
+    TEST_ASSERT_TRUE(eeprom.isWriting());
+    _waitForWrites(eeprom);
+
+    return Simulator::eepromWrites() - eepromWrites;
+}
+
+// power is cut once bytes more were programmed
+static void _cutPowerAfter(unsigned long bytes, bool isWriteTorn)
+{
+    unsigned long eepromWrites = Simulator::eepromWrites() + bytes;
+    while (Simulator::eepromWrites() < eepromWrites)
+        Simulator::advance(TEST_POLL_CYCLES);
+
+    Simulator::powerCycle(isWriteTorn);
+}
+
+static void _assertRecovered(unsigned long position, bool isTrusted)
+{
+    CustomEEPROM eeprom;
+    eeprom.init();
+
+    TEST_ASSERT_EQUAL_UINT32(position, eeprom.getPosition());
+    TEST_ASSERT_EQUAL(isTrusted, eeprom.wasPositionTrusted());
+
+    // the configuration survives every cut
+    TEST_ASSERT_EQUAL_UINT32(1000000, eeprom.getMaxPosition());
+    TEST_ASSERT_EQUAL_UINT8(90, eeprom.getMotorIMoveMultiplier());
+}
+
+// writes records until the next one goes to slot, at least once around the ring (after format slot 0 holds the defaults)
+static void _fillJournal(CustomEEPROM &eeprom, int slot)
+{
+    int records = TEST_JOURNAL_SLOTS + (slot + TEST_JOURNAL_SLOTS - 1) % TEST_JOURNAL_SLOTS;
+    for (int i = 1; i <= records; i++)
+        _startMove(eeprom, i);
+}
+
+// the record of a move starting in slot is cut after every byte, the at rest record sits in the slot before
+static void _cutEveryByte(int slot, bool isWriteTorn)
+{
+    // one clean run to learn how many bytes the record takes
+    unsigned long recordBytes;
+    {
+        Simulator::reset();
+
+        CustomEEPROM eeprom;
+        eeprom.init();
+        _fillJournal(eeprom, (slot + TEST_JOURNAL_SLOTS - 1) % TEST_JOURNAL_SLOTS);
+        _saveAtRest(eeprom, TEST_AT_REST_POSITION);
+        recordBytes = _startMove(eeprom, TEST_MOVING_POSITION);
+        TEST_ASSERT_GREATER_THAN(0, recordBytes);
+        TEST_ASSERT_LESS_OR_EQUAL(sizeof(EEPROMRecord), recordBytes);
+    }
+
+    for (unsigned long bytes = 0; bytes <= recordBytes; bytes++)
+    {
+        Simulator::reset();
+
+        CustomEEPROM eeprom;
+        eeprom.init();
+        _fillJournal(eeprom, (slot + TEST_JOURNAL_SLOTS - 1) % TEST_JOURNAL_SLOTS);
+        _saveAtRest(eeprom, TEST_AT_REST_POSITION);
+
+        eeprom.setPosition(TEST_MOVING_POSITION);
+        eeprom.setTargetPosition(TEST_MOVING_POSITION + 1000);
+        eeprom.setPositionTrusted(false);
+        _cutPowerAfter(bytes, isWriteTorn);
+
+        // until its last byte the new record does not count, the at rest one before it does
+        if (bytes < recordBytes)
+            _assertRecovered(TEST_AT_REST_POSITION, true);
+        else
+            _assertRecovered(TEST_MOVING_POSITION, false);
+    }
+}
+
+// a changed maximum position saved once the check period passed, returns the bytes it takes
+static unsigned long _saveConfiguration(CustomEEPROM &eeprom, unsigned long maxPosition)
+{
+    unsigned long eepromWrites = Simulator::eepromWrites();
+
+    eeprom.setMaxPosition(maxPosition);
+    Simulator::advance(TEST_CHECK_PERIOD_CYCLES);
+    eeprom.handleEeprom();
+    _waitForWrites(eeprom);
+
+    return Simulator::eepromWrites() - eepromWrites;
+}
+
+static void _assertConfiguration(unsigned long maxPosition, unsigned char motorIMoveMultiplier)
+{
+    CustomEEPROM eeprom;
+    eeprom.init();
+
+    TEST_ASSERT_EQUAL_UINT32(maxPosition, eeprom.getMaxPosition());
+    TEST_ASSERT_EQUAL_UINT8(motorIMoveMultiplier, eeprom.getMotorIMoveMultiplier());
+    TEST_ASSERT_EQUAL_UINT8(ROTATOR_GEAR_TEETH, eeprom.getRotatorGearTeeth());
+    TEST_ASSERT_EQUAL_UINT32(SERIAL_BAUD_DEFAULT, eeprom.getSerialBaud());
+}
+
+// saves before the cut one alternate between the two copies, the copy saved last has to survive every byte
+static void _cutConfigurationSave(int saves, bool isWriteTorn)
+{
+    // one clean run to learn how many bytes the save takes
+    unsigned long saveBytes;
+    {
+        Simulator::reset();
+
+        CustomEEPROM eeprom;
+        eeprom.init();
+        _saveAtRest(eeprom, TEST_AT_REST_POSITION);
+        for (int i = 0; i < saves; i++)
+            _saveConfiguration(eeprom, TEST_MAX_POSITION + i);
+
+        saveBytes = _saveConfiguration(eeprom, TEST_MAX_POSITION + saves);
+        TEST_ASSERT_GREATER_THAN(0, saveBytes);
+    }
+
+    unsigned long savedMaxPosition = saves > 0 ? TEST_MAX_POSITION + saves - 1 : TEST_DEFAULT_MAX_POSITION;
+    for (unsigned long bytes = 0; bytes <= saveBytes; bytes++)
+    {
+        Simulator::reset();
+
+        CustomEEPROM eeprom;
+        eeprom.init();
+        _saveAtRest(eeprom, TEST_AT_REST_POSITION);
+        for (int i = 0; i < saves; i++)
+            _saveConfiguration(eeprom, TEST_MAX_POSITION + i);
+
+        eeprom.setMaxPosition(TEST_MAX_POSITION + saves);
+        Simulator::advance(TEST_CHECK_PERIOD_CYCLES);
+        eeprom.handleEeprom();
+        _cutPowerAfter(bytes, isWriteTorn);
+
+        // until its CRC is complete the save does not count, the copy saved before does, the position is untouched
+        _assertConfiguration(bytes < saveBytes ? savedMaxPosition : TEST_MAX_POSITION + saves, 90);
+
+        CustomEEPROM recovered;
+        recovered.init();
+        TEST_ASSERT_EQUAL_UINT32(TEST_AT_REST_POSITION, recovered.getPosition());
+        TEST_ASSERT_TRUE(recovered.wasPositionTrusted());
+
+        // the next save goes to the torn copy and counts
+        _saveConfiguration(recovered, TEST_MAX_POSITION + 100);
+        Simulator::powerCycle(false);
+        _assertConfiguration(TEST_MAX_POSITION + 100, 90);
+    }
+}
+
+static void _putField(unsigned char *fields, unsigned char offset, uint32_t value, unsigned char size)
+{
+    for (unsigned char i = 0; i < size; i++)
+        fields[offset - EEPROM_OFFSET_FIELDS + i] = (unsigned char)(value >> (8 * i));
+}
+
+// fields up to motorIHoldMultiplier in the order all layouts share, the defaults but maxPosition and motorIMoveMultiplier
+static void _putV0Fields(unsigned char *fields)
+{
+    _putField(fields, EEPROM_OFFSET_MAX_POSITION, TEST_MAX_POSITION, 4);
+    _putField(fields, EEPROM_OFFSET_MAX_MOVEMENT, 5000000, 4);
+    _putField(fields, EEPROM_OFFSET_STEP_MODE, 16, 2);
+    _putField(fields, EEPROM_OFFSET_STEP_MODE_MANUAL, 2, 2);
+    _putField(fields, EEPROM_OFFSET_SPEED_MODE, 4, 1);
+    _putField(fields, EEPROM_OFFSET_SETTLE_BUFFER_MS, 0, 4);
+    _putField(fields, EEPROM_OFFSET_IDLE_EEPROM_WRITE_MS, 180000, 4);
+    _putField(fields, EEPROM_OFFSET_REVERSE_DIRECTION, 0, 1);
+    _putField(fields, EEPROM_OFFSET_MOTOR_I_MOVE_MULTIPLIER, TEST_MOTOR_I_MOVE_MULTIPLIER, 1);
+    _putField(fields, EEPROM_OFFSET_MOTOR_I_HOLD_MULTIPLIER, 40, 1);
+}
+
+// layout version 2 with the at rest record of TEST_AT_REST_POSITION in journal slot 0
+static void _writeLayout2()
+{
+    unsigned char fields[EEPROM_OFFSET_FIELDS_END - EEPROM_OFFSET_FIELDS];
+    _putV0Fields(fields);
+    _putField(fields, EEPROM_OFFSET_ROTATOR_GEAR_TEETH, ROTATOR_GEAR_TEETH, 1);
+    _putField(fields, EEPROM_OFFSET_MOTOR_GEAR_TEETH, MOTOR_GEAR_TEETH, 1);
+    _putField(fields, EEPROM_OFFSET_SERIAL_BAUD, SERIAL_BAUD_DEFAULT, 4);
+
+    unsigned char header[4] = {2, sizeof(fields), 0, 0};
+    unsigned short crc = 0xFFFF;
+    for (unsigned char i = 0; i < sizeof(fields); i++)
+        crc = _crc_ccitt_update(crc, fields[i]);
+    memcpy(header + 2, &crc, sizeof(crc));
+
+    EEPROMRecord record = {1, TEST_AT_REST_POSITION, TEST_AT_REST_POSITION, EEPROM_RECORD_AT_REST, 0xFFFF};
+    for (unsigned char i = 0; i < offsetof(EEPROMRecord, crc); i++)
+        record.crc = _crc_ccitt_update(record.crc, ((unsigned char *)&record)[i]);
+
+    eeprom_update_block(header, (void *)0, sizeof(header));
+    eeprom_update_block(fields, (void *)EEPROM_V2_ADDRESS_FIELDS, sizeof(fields));
+    eeprom_update_block(&record, (void *)EEPROM_V2_JOURNAL_ADDRESS, sizeof(record));
+}
+
+// the original firmware: configuration at 0 and the one slot with a matching checksum
+static void _writeOriginalLayout()
+{
+    unsigned char fields[EEPROM_V0_CONFIGURATION_SIZE];
+    _putV0Fields(fields);
+
+    uint32_t slot[3] = {TEST_AT_REST_POSITION, TEST_AT_REST_POSITION + 1000, 0};
+    slot[2] = TEST_MAX_POSITION + 5000000 + 16 + 2 + 4 + 0 + 180000 + 0 + TEST_MOTOR_I_MOVE_MULTIPLIER + 40 + slot[0];
+
+    eeprom_update_block(fields, (void *)0, sizeof(fields));
+    eeprom_update_block(slot, (void *)(EEPROM_V0_CONFIGURATION_SIZE + TEST_V0_SLOT * EEPROM_V0_SLOT_SIZE), sizeof(slot));
+}
+
+// boots from a migrated layout, the configuration is kept and the position is not trusted
+static void _assertMigrated(unsigned long position, unsigned long targetPosition)
+{
+    CustomEEPROM eeprom;
+    eeprom.init();
+    _waitForWrites(eeprom);
+
+    TEST_ASSERT_EQUAL_UINT32(position, eeprom.getPosition());
+    TEST_ASSERT_EQUAL_UINT32(targetPosition, eeprom.getTargetPosition());
+    TEST_ASSERT_FALSE(eeprom.wasPositionTrusted());
+    _assertConfiguration(TEST_MAX_POSITION, TEST_MOTOR_I_MOVE_MULTIPLIER);
+}
+
+static void test_blank_eeprom(void)
+{
+    CustomEEPROM eeprom;
+    eeprom.init();
+    eeprom.flush();
+
+    TEST_ASSERT_EQUAL_UINT32(0, eeprom.getPosition());
+    TEST_ASSERT_FALSE(eeprom.wasPositionTrusted());
+
+    Simulator::powerCycle(false);
+    _assertRecovered(0, false);
+}
+
+static void test_warm_boot(void)
+{
+    {
+        CustomEEPROM eeprom;
+        eeprom.init();
+        _saveAtRest(eeprom, TEST_AT_REST_POSITION);
+    }
+
+    Simulator::powerCycle(false);
+    _assertRecovered(TEST_AT_REST_POSITION, true);
+
+    // booting again without any write keeps it
+    Simulator::powerCycle(false);
+    _assertRecovered(TEST_AT_REST_POSITION, true);
+}
+
+static void test_power_cut_lost_byte(void)
+{
+    _cutEveryByte(1, false);
+}
+
+static void test_power_cut_torn_byte(void)
+{
+    _cutEveryByte(1, true);
+}
+
+static void test_power_cut_ring_wrap(void)
+{
+    // the newest record goes to slot 0 again, the at rest one sits in the last slot
+    _cutEveryByte(0, false);
+    _cutEveryByte(0, true);
+}
+
+static void test_power_cut_last_slot(void)
+{
+    _cutEveryByte(TEST_JOURNAL_SLOTS - 1, true);
+}
+
+static void test_move_behind_busy_queue(void)
+{
+    CustomEEPROM eeprom;
+    eeprom.init();
+    _saveAtRest(eeprom, TEST_AT_REST_POSITION);
+
+    // a configuration save and an at rest record at once, the record goes first and leaves room for another
+    eeprom.setMaxPosition(TEST_MAX_POSITION);
+    eeprom.setPosition(TEST_AT_REST_POSITION + 1);
+    eeprom.setTargetPosition(TEST_AT_REST_POSITION + 1);
+    Simulator::advance(TEST_CHECK_PERIOD_CYCLES);
+    eeprom.handleEeprom();
+    TEST_ASSERT_TRUE(eeprom.isWriting());
+
+    // the record of the move start is queued behind it without waiting
+    uint64_t start = Simulator::cycles();
+    eeprom.setPosition(TEST_MOVING_POSITION);
+    eeprom.setTargetPosition(TEST_MOVING_POSITION + 1000);
+    eeprom.setPositionTrusted(false);
+    TEST_ASSERT_LESS_THAN(SIM_EEPROM_WRITE_CYCLES, Simulator::cycles() - start);
+    TEST_ASSERT_TRUE(eeprom.isWriting());
+    _waitForWrites(eeprom);
+
+    Simulator::powerCycle(false);
+    _assertRecovered(TEST_MOVING_POSITION, false);
+}
+
+static void test_configuration_behind_record(void)
+{
+    CustomEEPROM eeprom;
+    eeprom.init();
+    _saveAtRest(eeprom, TEST_AT_REST_POSITION);
+
+    // all fields of copy B and the record do not fit beside the reserved room, the configuration follows a check later
+    eeprom.setMaxPosition(TEST_MAX_POSITION);
+    eeprom.setPosition(TEST_AT_REST_POSITION + 1);
+    eeprom.setTargetPosition(TEST_AT_REST_POSITION + 1);
+    _saveConfiguration(eeprom, TEST_MAX_POSITION);
+    _saveConfiguration(eeprom, TEST_MAX_POSITION);
+
+    Simulator::powerCycle(false);
+    _assertConfiguration(TEST_MAX_POSITION, 90);
+
+    CustomEEPROM recovered;
+    recovered.init();
+    TEST_ASSERT_EQUAL_UINT32(TEST_AT_REST_POSITION + 1, recovered.getPosition());
+    TEST_ASSERT_TRUE(recovered.wasPositionTrusted());
+}
+
+static void test_power_cut_configuration(void)
+{
+    // the first save after boot writes all fields of copy A, the next ones the changed fields of B, then A
+    _cutConfigurationSave(0, false);
+    _cutConfigurationSave(0, true);
+    _cutConfigurationSave(1, true);
+    _cutConfigurationSave(2, false);
+}
+
+static void test_migrate_layout_2(void)
+{
+    _writeLayout2();
+    unsigned long eepromWrites = Simulator::eepromWrites();
+    _assertMigrated(TEST_AT_REST_POSITION, TEST_AT_REST_POSITION);
+    TEST_ASSERT_GREATER_THAN(eepromWrites, Simulator::eepromWrites());
+
+    // the next boot reads the current layout
+    Simulator::powerCycle(false);
+    _assertMigrated(TEST_AT_REST_POSITION, TEST_AT_REST_POSITION);
+}
+
+static void test_migrate_layout_2_power_cut(void)
+{
+    // one clean run to learn how many bytes copy B takes, the journal is formatted synchronously in init()
+    unsigned long migrationBytes;
+    {
+        _writeLayout2();
+
+        CustomEEPROM eeprom;
+        eeprom.init();
+        unsigned long eepromWrites = Simulator::eepromWrites();
+        _waitForWrites(eeprom);
+        migrationBytes = Simulator::eepromWrites() - eepromWrites;
+        TEST_ASSERT_GREATER_THAN(0, migrationBytes);
+    }
+
+    // copy B overwrites the old journal, the position may be lost but never the configuration
+    for (unsigned long bytes = 0; bytes <= migrationBytes; bytes++)
+    {
+        Simulator::reset();
+        _writeLayout2();
+        {
+            CustomEEPROM eeprom;
+            eeprom.init();
+            _cutPowerAfter(bytes, true);
+        }
+
+        CustomEEPROM eeprom;
+        eeprom.init();
+        _waitForWrites(eeprom);
+        TEST_ASSERT_FALSE(eeprom.wasPositionTrusted());
+        _assertConfiguration(TEST_MAX_POSITION, TEST_MOTOR_I_MOVE_MULTIPLIER);
+    }
+}
+
+static void test_migrate_original_layout(void)
+{
+    _writeOriginalLayout();
+    _assertMigrated(TEST_AT_REST_POSITION, TEST_AT_REST_POSITION + 1000);
+
+    Simulator::powerCycle(false);
+    _assertMigrated(TEST_AT_REST_POSITION, TEST_AT_REST_POSITION + 1000);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_blank_eeprom);
+    RUN_TEST(test_warm_boot);
+    RUN_TEST(test_power_cut_lost_byte);
+    RUN_TEST(test_power_cut_torn_byte);
+    RUN_TEST(test_power_cut_ring_wrap);
+    RUN_TEST(test_power_cut_last_slot);
+    RUN_TEST(test_move_behind_busy_queue);
+    RUN_TEST(test_configuration_behind_record);
+    RUN_TEST(test_power_cut_configuration);
+    RUN_TEST(test_migrate_layout_2);
+    RUN_TEST(test_migrate_layout_2_power_cut);
+    RUN_TEST(test_migrate_original_layout);
+    return UNITY_END();
+}
@@ -0,0 +1,305 @@
+#include <unity.h>
+#include <math.h>
+#include "BaudRate.h"
+#include "BinaryProtocol.h"
+#include "CustomEEPROM.h"
+#include "Homing.h"
+#include "Motor.h"
+#include "Scheduler.h"
+#include "SensorSampler.h"
+#include "StringProxy.h"
+
+/**
+ * Full home search on the synthetic Hall curve of the simulator (a Gaussian
+ * dip with noise, see SIM_HOME_SENSOR_*), the home angle moved around the
+ * ring. Every search starts where the previous one ended, the rotator must
+ * stop on the dip and report position 0. Warm boots power cycle the simulator
+ * and start over with fresh firmware objects on the EEPROM left behind. Runs
+ * in the native_cable_wrap environment as well.
+ */
+#define TEST_POLL_CYCLES (F_CPU / 1000)
+#define TEST_CHECK_PERIOD_CYCLES ((EEPROM_CHECK_PERIOD_MS + 1) * (F_CPU / 1000))
+#define TEST_TIMEOUT_S 600.0
+#define TEST_TOLERANCE_DEG 0.5
+#define TEST_PARK_HUNDREDTHS 9000
+#define TEST_CONFIRM_PATH_HUNDREDTHS (TEST_PARK_HUNDREDTHS + 5 * HOME_FINE_WINDOW_HUNDREDTHS) // to one window before home, across it and back
+
+static BaudRate _baudRate;
+static BinaryProtocol _binaryProtocol;
+static CustomEEPROM _eeprom;
+static Homing _homing;
+static Motor _motor;
+static Scheduler _scheduler;
+static SensorSampler _sensor;
+static StringProxy _stringProxy;
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// a reset: the EEPROM and the rotator keep their state, the firmware starts over
+static void _boot()
+{
+    _eeprom = CustomEEPROM();
+    _motor = Motor();
+    _sensor = SensorSampler();
+    _homing = Homing();
+
+    _eeprom.init();
+    _sensor.init();
+    _motor.init(_eeprom);
+    _stringProxy.init(_eeprom, _motor, _sensor, _scheduler, _baudRate, _binaryProtocol);
+    _homing.init(_eeprom, _motor, _stringProxy, _sensor);
+}
+
+// runs homing like the scheduler does, the motor task first, returns the steps turned either way
+static unsigned long _home()
+{
+    double timeout = Simulator::seconds() + TEST_TIMEOUT_S;
+    unsigned long path = 0;
+
+    _homing.begin();
+    TEST_ASSERT_TRUE(_homing.isHoming());
+    TEST_ASSERT_TRUE(_eeprom.isHoming());
+
+    do
+    {
+        long motorSteps = Simulator::motorSteps();
+        Simulator::advance(TEST_POLL_CYCLES);
+        _motor.handleMotor();
+        path += labs(Simulator::motorSteps() - motorSteps);
+        TEST_ASSERT_LESS_THAN(timeout, Simulator::seconds());
+    } while (_homing.handle());
+
+    return path;
+}
+
+static void _waitForEeprom()
+{
+    while (_eeprom.isWriting())
+        Simulator::advance(TEST_POLL_CYCLES);
+}
+
+// parks the rotator after homing, the at rest record is written once the check period passed
+static void _park()
+{
+    TEST_ASSERT_TRUE(_eeprom.setTargetPosition(_stringProxy.hundredthsToSteps(TEST_PARK_HUNDREDTHS)));
+    _motor.startMotor();
+    while (_motor.handleMotor())
+        Simulator::advance(TEST_POLL_CYCLES);
+
+    Simulator::advance(TEST_CHECK_PERIOD_CYCLES);
+    _eeprom.handleEeprom();
+    _waitForEeprom();
+}
+
+static double _degreesOffHome(double homeDegrees)
+{
+    double offset = fmod(fabs(Simulator::rotatorDegrees() - homeDegrees), 360.0);
+    return offset > 180.0 ? 360.0 - offset : offset;
+}
+
+static void _assertAtHome(double homeDegrees)
+{
+    TEST_ASSERT_TRUE(_homing.isHomed());
+    TEST_ASSERT_FALSE(_homing.isHoming());
+    TEST_ASSERT_FALSE(_eeprom.isHoming());
+    TEST_ASSERT_FALSE(_motor.isMoving());
+    TEST_ASSERT_EQUAL_UINT32(0, _eeprom.getPosition());
+    TEST_ASSERT_EQUAL_UINT32(0, _eeprom.getTargetPosition());
+    TEST_ASSERT_LESS_OR_EQUAL(TEST_TOLERANCE_DEG, _degreesOffHome(homeDegrees));
+}
+
+static void _assertHomed(double homeDegrees)
+{
+    Simulator::setHomeDegrees(homeDegrees);
+    _home();
+    _assertAtHome(homeDegrees);
+}
+
+static void test_home_ahead(void)
+{
+    // the rotator starts at 0 deg, home lies within the first coarse segment or further around
+    _assertHomed(SIM_HOME_DEG);
+    _assertHomed(200.0);
+}
+
+static void test_home_on_segment_boundary(void)
+{
+    // the dip straddles the end of a 90 deg coarse segment
+    double start = Simulator::rotatorDegrees();
+    _assertHomed(fmod(start + HOME_SWEEP_SEGMENT_HUNDREDTHS / 100.0 + 0.02 * HOME_FINE_WINDOW_HUNDREDTHS, 360.0));
+}
+
+static void test_home_behind(void)
+{
+    // just behind the start: the coarse sweep goes almost all the way around
+    double start = Simulator::rotatorDegrees();
+    _assertHomed(fmod(start + 350.0, 360.0));
+}
+
+static void test_home_at_start(void)
+{
+    // already on the dip, the fine pass has to go back behind the start
+    double start = fmod(Simulator::rotatorDegrees(), 360.0);
+    _assertHomed(start);
+    _assertHomed(fmod(start + 359.5, 360.0));
+}
+
+static void test_home_confirmed(void)
+{
+    // below the threshold and within the tolerance on either side of the expected position
+    TEST_ASSERT_TRUE(Homing::isHomeConfirmed(HOME_SENSOR_THRESHOLD - 1, 1000, 1000, 50));
+    TEST_ASSERT_TRUE(Homing::isHomeConfirmed(300, 950, 1000, 50));
+    TEST_ASSERT_TRUE(Homing::isHomeConfirmed(300, 1050, 1000, 50));
+    TEST_ASSERT_FALSE(Homing::isHomeConfirmed(300, 949, 1000, 50));
+    TEST_ASSERT_FALSE(Homing::isHomeConfirmed(300, 1051, 1000, 50));
+    TEST_ASSERT_FALSE(Homing::isHomeConfirmed(HOME_SENSOR_THRESHOLD, 1000, 1000, 50));
+    TEST_ASSERT_FALSE(Homing::isHomeConfirmed(0xFFFF, 1000, 1000, 50)); // no sample taken
+}
+
+static void test_warm_boot_confirmed(void)
+{
+    Simulator::setHomeDegrees(SIM_HOME_DEG);
+    _home();
+    _park();
+
+    Simulator::powerCycle(false);
+    _boot();
+    TEST_ASSERT_TRUE(_eeprom.wasPositionTrusted());
+
+    unsigned long path = _home();
+    _assertAtHome(SIM_HOME_DEG);
+
+#if ROTATOR_CABLE_WRAP_DEG > 0
+    // the cable wrap count is not stored, the full search runs and the count starts over at home
+    TEST_ASSERT_GREATER_THAN(_stringProxy.hundredthsToSteps(TEST_CONFIRM_PATH_HUNDREDTHS), path);
+#else
+    // straight back to home and one fine pass across it
+    TEST_ASSERT_LESS_OR_EQUAL(_stringProxy.hundredthsToSteps(TEST_CONFIRM_PATH_HUNDREDTHS), path);
+    TEST_ASSERT_GREATER_OR_EQUAL(_stringProxy.hundredthsToSteps(TEST_PARK_HUNDREDTHS), path);
+#endif
+}
+
+static void test_warm_boot_not_confirmed(void)
+{
+    Simulator::setHomeDegrees(SIM_HOME_DEG);
+    _home();
+    _park();
+
+    // turned by hand while powered off, the dip is 30 deg away from the expected home
+    Simulator::powerCycle(false);
+    Simulator::setHomeDegrees(SIM_HOME_DEG + 30.0);
+    _boot();
+    TEST_ASSERT_TRUE(_eeprom.wasPositionTrusted());
+
+    // the confirmation fails and the full search finds the new home
+    unsigned long path = _home();
+    _assertAtHome(SIM_HOME_DEG + 30.0);
+    TEST_ASSERT_GREATER_THAN(_stringProxy.hundredthsToSteps(TEST_CONFIRM_PATH_HUNDREDTHS), path);
+}
+
+static void test_warm_boot_untrusted(void)
+{
+    Simulator::setHomeDegrees(SIM_HOME_DEG);
+    _home();
+
+    // power lost in the middle of a move, only the record of its start is left
+    TEST_ASSERT_TRUE(_eeprom.setTargetPosition(_stringProxy.hundredthsToSteps(TEST_PARK_HUNDREDTHS)));
+    _motor.startMotor();
+    _waitForEeprom();
+    Simulator::advance(F_CPU);
+    TEST_ASSERT_TRUE(_motor.handleMotor());
+
+    Simulator::powerCycle(false);
+    _boot();
+    TEST_ASSERT_FALSE(_eeprom.wasPositionTrusted());
+
+    // full search forward from wherever the rotator stopped, almost once around
+    unsigned long path = _home();
+    _assertAtHome(SIM_HOME_DEG);
+    TEST_ASSERT_GREATER_THAN(_stringProxy.hundredthsToSteps(TEST_CONFIRM_PATH_HUNDREDTHS), path);
+}
+
+static void test_halt_aborts_homing(void)
+{
+    char halt[] = "FH";
+    char move[] = "MS";
+    char noArgument[] = "";
+    char moveArgument[] = "1000";
+
+    Simulator::setHomeDegrees(SIM_HOME_DEG);
+    _home();
+    _park();
+
+    // FH one second into homing: homing ends at once, the motor decelerates
+    _homing.begin();
+    for (int i = 0; i < 1000; i++)
+    {
+        Simulator::advance(TEST_POLL_CYCLES);
+        _motor.handleMotor();
+        TEST_ASSERT_TRUE(_homing.handle());
+    }
+
+    TEST_ASSERT_TRUE(_motor.isMoving());
+    TEST_ASSERT_EQUAL_STRING("FH:1", _stringProxy.processFalconCommand(halt, noArgument, 0));
+    TEST_ASSERT_FALSE(_eeprom.isHoming());
+    TEST_ASSERT_FALSE(_homing.handle());
+    TEST_ASSERT_FALSE(_homing.isHoming());
+    TEST_ASSERT_FALSE(_homing.isHomed());
+    TEST_ASSERT_TRUE(_motor.isMoving());
+
+    while (_motor.handleMotor())
+        Simulator::advance(TEST_POLL_CYCLES);
+
+    // moves are accepted again, but no position is trusted until homing runs again
+    TEST_ASSERT_EQUAL_STRING("MS:1000", _stringProxy.processFalconCommand(move, moveArgument, 4));
+    while (_motor.handleMotor())
+        Simulator::advance(TEST_POLL_CYCLES);
+    TEST_ASSERT_EQUAL_UINT32(1000, _eeprom.getPosition());
+
+    // the EEPROM task writes the idle position after a while, still without the at rest flag
+    for (unsigned long ms = 0; ms <= _eeprom.getIdleEepromWriteMs() + EEPROM_CHECK_PERIOD_MS; ms += 10)
+    {
+        Simulator::advance(F_CPU / 100);
+        _eeprom.handleEeprom();
+    }
+    _waitForEeprom();
+
+    Simulator::powerCycle(false);
+    _boot();
+    TEST_ASSERT_FALSE(_eeprom.wasPositionTrusted());
+    TEST_ASSERT_EQUAL_UINT32(1000, _eeprom.getPosition());
+}
+
+static void test_halt_while_idle(void)
+{
+    char halt[] = "FH";
+    char noArgument[] = "";
+
+    Simulator::setHomeDegrees(SIM_HOME_DEG);
+    _home();
+
+    TEST_ASSERT_FALSE(_motor.halt());
+    TEST_ASSERT_EQUAL_STRING("FH:1", _stringProxy.processFalconCommand(halt, noArgument, 0));
+    TEST_ASSERT_FALSE(_motor.isMoving());
+    TEST_ASSERT_EQUAL_UINT32(0, _eeprom.getPosition());
+}
+
+int main(int argc, char **argv)
+{
+    _boot();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_home_ahead);
+    RUN_TEST(test_home_on_segment_boundary);
+    RUN_TEST(test_home_behind);
+    RUN_TEST(test_home_at_start);
+    RUN_TEST(test_home_confirmed);
+    RUN_TEST(test_warm_boot_confirmed);
+    RUN_TEST(test_warm_boot_not_confirmed);
+    RUN_TEST(test_warm_boot_untrusted);
+    RUN_TEST(test_halt_aborts_homing);
+    RUN_TEST(test_halt_while_idle);
+    return UNITY_END();
+}
@@ -0,0 +1,270 @@
+#include <unity.h>
+#include <vector>
+#include "MotorDriver.h"
+#include "MotionPlanner.h"
+#include "StepGenerator.h"
+
+/**
+ * MotionPlanner splits and the intervals StepGenerator runs from them on the
+ * simulated Timer1, for every speed mode at full step (ULN2003 and TMC220x
+ * at step mode 1) and 16 microsteps. Steps are timed like test_step_generator.
+ */
+#define TEST_CYCLES_PER_TICK (F_CPU / 1000000UL / STEP_TIMER_TICKS_PER_US)
+#define TEST_TICKS_PER_S (STEP_TIMER_TICKS_PER_US * 1000000.0)
+#define TEST_POLL_CYCLES 64
+#define TEST_START_TOLERANCE_TICKS 4
+#define TEST_MIRROR_TOLERANCE 0.005 // deceleration replays the ramp, the remainders differ
+#define TEST_FULL_STEPS 4000
+
+class ExpectedPlan
+{
+public:
+    unsigned long cruiseTicks;
+    unsigned long firstTicks;
+    unsigned long accelSteps;
+};
+
+// c0 = 0.676 * sqrt(2 / 500) s, n = ceil(v^2 / (2 * 500) * step mode)
+static const ExpectedPlan FULL_STEP_PLANS[MOTOR_SPEED_MODES] = {
+    {192000, 192000, 0},
+    {96000, 96000, 0},
+    {48000, 85507, 2},
+    {16000, 85507, 16},
+    {8000, 85507, 63}};
+
+static const ExpectedPlan MICROSTEP_16_PLANS[MOTOR_SPEED_MODES] = {
+    {12000, 21376, 2},
+    {6000, 21376, 7},
+    {3000, 21376, 28},
+    {1000, 21376, 250},
+    {500, 21376, 1000}};
+
+static StepGenerator _stepGenerator;
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+#if MOTOR_DRIVER == MOTOR_DRIVER_ULN2003
+static const uint8_t ULN2003_SEQUENCE[8] = {0x01, 0x03, 0x02, 0x06, 0x04, 0x0C, 0x08, 0x09};
+
+static uint64_t _stepWriteCycles(long motorSteps)
+{
+    uint8_t changed = ULN2003_SEQUENCE[motorSteps & 7] ^ ULN2003_SEQUENCE[(motorSteps - 1) & 7];
+    uint8_t pin = 0;
+    while (!(changed & (1 << pin)))
+        pin++;
+
+    return (pin + 1) * SIM_CALL_CYCLES;
+}
+#else
+static uint64_t _stepWriteCycles(long motorSteps)
+{
+    return SIM_CALL_CYCLES;
+}
+#endif
+
+static void _run(const MotionPlan &plan, std::vector<unsigned long> &intervals)
+{
+    intervals.clear();
+    long motorSteps = Simulator::motorSteps();
+
+    _stepGenerator.start(plan, true);
+    uint64_t lastCycle = Simulator::cycles();
+
+    while (_stepGenerator.isRunning())
+    {
+        Simulator::advance(TEST_POLL_CYCLES);
+        if (Simulator::motorSteps() == motorSteps)
+            continue;
+
+        TEST_ASSERT_EQUAL_INT32(motorSteps + 1, Simulator::motorSteps());
+        motorSteps++;
+
+        uint64_t cycle = Simulator::motorStepCycle() - SIM_ISR_CYCLES - _stepWriteCycles(motorSteps);
+        intervals.push_back((cycle - lastCycle + TEST_CYCLES_PER_TICK / 2) / TEST_CYCLES_PER_TICK);
+        lastCycle = cycle;
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(plan.totalSteps, intervals.size());
+    TEST_ASSERT_EQUAL_UINT32(plan.totalSteps, _stepGenerator.getStepsDone());
+}
+
+static void _assertMirrored(const std::vector<unsigned long> &intervals, unsigned long rampSteps)
+{
+    size_t last = intervals.size() - 1;
+    for (size_t i = 1; i < rampSteps; i++)
+        TEST_ASSERT_UINT32_WITHIN(intervals[i] * TEST_MIRROR_TOLERANCE + 1, intervals[i], intervals[last - i]);
+}
+
+static void _assertPlans(const ExpectedPlan *expectedPlans, unsigned short stepMode)
+{
+    for (unsigned char speedMode = 1; speedMode <= MOTOR_SPEED_MODES; speedMode++)
+    {
+        const ExpectedPlan &expected = expectedPlans[speedMode - 1];
+        unsigned long steps = TEST_FULL_STEPS * (unsigned long)stepMode;
+
+        MotionPlan plan;
+        MotionPlanner::plan(steps, speedMode, stepMode, plan);
+
+        TEST_ASSERT_EQUAL_UINT32(steps, plan.totalSteps);
+        TEST_ASSERT_EQUAL_UINT32(expected.cruiseTicks, plan.cruiseTicks);
+        TEST_ASSERT_EQUAL_UINT32(expected.firstTicks, plan.firstTicks);
+        TEST_ASSERT_EQUAL_UINT32(expected.accelSteps, plan.accelSteps);
+        TEST_ASSERT_EQUAL_UINT32(steps - expected.accelSteps, plan.decelStart);
+        TEST_ASSERT_EQUAL_UINT32(0, plan.cruiseRest);
+
+        std::vector<unsigned long> intervals;
+        _run(plan, intervals);
+
+        // first interval is c0 (or the cruise interval without a ramp), the last mirrors it
+        TEST_ASSERT_UINT32_WITHIN(TEST_START_TOLERANCE_TICKS, expected.firstTicks, intervals[0]);
+        TEST_ASSERT_UINT32_WITHIN(expected.firstTicks * TEST_MIRROR_TOLERANCE, expected.firstTicks, intervals[steps - 1]);
+
+        // cruise exactly between the planned split points, never faster
+        unsigned long accelSteps = expected.accelSteps;
+        for (unsigned long i = 1; i < steps; i++)
+        {
+            if (i < accelSteps || i >= steps - accelSteps)
+                TEST_ASSERT_GREATER_THAN(expected.cruiseTicks, intervals[i]);
+            else
+                TEST_ASSERT_EQUAL_UINT32(expected.cruiseTicks, intervals[i]);
+        }
+
+        if (accelSteps == 0)
+            continue;
+
+        _assertMirrored(intervals, accelSteps);
+
+        // cruise speed over the ramp time, c0 of 0.676 accelerates a little faster on the first steps
+        double rampSeconds = 0.0;
+        for (unsigned long i = 0; i < accelSteps; i++)
+            rampSeconds += intervals[i] / TEST_TICKS_PER_S;
+
+        double acceleration = TEST_TICKS_PER_S / expected.cruiseTicks / stepMode / rampSeconds;
+        TEST_ASSERT_GREATER_THAN(MOTOR_ACCELERATION, acceleration);
+        TEST_ASSERT_LESS_THAN(MOTOR_ACCELERATION * (accelSteps < 16 ? 1.25 : 1.1), acceleration);
+    }
+}
+
+static void test_full_step(void)
+{
+    _assertPlans(FULL_STEP_PLANS, 1);
+}
+
+static void test_microstep_16(void)
+{
+    _assertPlans(MICROSTEP_16_PLANS, 16);
+}
+
+static void test_short_move_triangle(void)
+{
+    // speed mode 5 never reaches cruise within 2 * 10 steps, odd counts keep the peak for one step
+    static const unsigned long STEPS[] = {20, 21, 2, 3};
+
+    for (unsigned long steps : STEPS)
+    {
+        MotionPlan plan;
+        MotionPlanner::plan(steps, 5, 1, plan);
+
+        TEST_ASSERT_EQUAL_UINT32(steps / 2, plan.accelSteps);
+        TEST_ASSERT_EQUAL_UINT32(steps - steps / 2, plan.decelStart);
+        TEST_ASSERT_EQUAL_UINT32(85507, plan.firstTicks);
+
+        std::vector<unsigned long> intervals;
+        _run(plan, intervals);
+
+        TEST_ASSERT_UINT32_WITHIN(TEST_START_TOLERANCE_TICKS, 85507, intervals[0]);
+        TEST_ASSERT_UINT32_WITHIN(85507 * TEST_MIRROR_TOLERANCE, 85507, intervals[steps - 1]);
+        _assertMirrored(intervals, steps / 2);
+
+        // accelerate up to the middle, then decelerate, always slower than cruise
+        size_t peak = (steps - 1) / 2;
+        for (size_t i = 1; i < steps; i++)
+        {
+            TEST_ASSERT_GREATER_THAN(plan.cruiseTicks, intervals[i]);
+            if (i <= peak)
+                TEST_ASSERT_LESS_OR_EQUAL(intervals[i - 1], intervals[i]);
+            else
+                TEST_ASSERT_GREATER_OR_EQUAL(intervals[i - 1], intervals[i]);
+        }
+    }
+
+    // at 16 microsteps speed mode 4 needs 250 steps to reach cruise
+    MotionPlan plan;
+    MotionPlanner::plan(320, 4, 16, plan);
+    TEST_ASSERT_EQUAL_UINT32(160, plan.accelSteps);
+    TEST_ASSERT_EQUAL_UINT32(160, plan.decelStart);
+
+    std::vector<unsigned long> intervals;
+    _run(plan, intervals);
+    _assertMirrored(intervals, 160);
+    TEST_ASSERT_EQUAL_UINT32(intervals[159], intervals[160]);
+}
+
+static void test_single_step(void)
+{
+    MotionPlan plan;
+    MotionPlanner::plan(1, 5, 1, plan);
+
+    TEST_ASSERT_EQUAL_UINT32(0, plan.accelSteps);
+    TEST_ASSERT_EQUAL_UINT32(1, plan.decelStart);
+
+    std::vector<unsigned long> intervals;
+    _run(plan, intervals);
+}
+
+static void test_limits(void)
+{
+    MotionPlan plan;
+    MotionPlan expected;
+
+    MotionPlanner::plan(1000, 0, 1, plan);
+    MotionPlanner::plan(1000, 1, 1, expected);
+    TEST_ASSERT_EQUAL_UINT32(expected.cruiseTicks, plan.cruiseTicks);
+
+    MotionPlanner::plan(1000, MOTOR_SPEED_MODES + 1, 1, plan);
+    MotionPlanner::plan(1000, MOTOR_SPEED_MODES, 1, expected);
+    TEST_ASSERT_EQUAL_UINT32(expected.cruiseTicks, plan.cruiseTicks);
+    TEST_ASSERT_EQUAL_UINT32(expected.accelSteps, plan.accelSteps);
+
+    MotionPlanner::plan(1000, 5, 0, plan);
+    MotionPlanner::plan(1000, 5, 1, expected);
+    TEST_ASSERT_EQUAL_UINT32(expected.cruiseTicks, plan.cruiseTicks);
+    TEST_ASSERT_EQUAL_UINT32(expected.accelSteps, plan.accelSteps);
+}
+
+static void test_halt_during_ramp(void)
+{
+    // decelerate() in the middle of the ramp stops within the steps already accelerated
+    MotionPlan plan;
+    MotionPlanner::plan(TEST_FULL_STEPS, 5, 1, plan);
+
+    long motorSteps = Simulator::motorSteps();
+    _stepGenerator.start(plan, true);
+    while (_stepGenerator.getStepsDone() < 30)
+        Simulator::advance(TEST_POLL_CYCLES);
+
+    _stepGenerator.decelerate();
+    while (_stepGenerator.isRunning())
+        Simulator::advance(TEST_POLL_CYCLES);
+
+    TEST_ASSERT_LESS_OR_EQUAL(61, Simulator::motorSteps() - motorSteps);
+    TEST_ASSERT_GREATER_OR_EQUAL(31, Simulator::motorSteps() - motorSteps);
+}
+
+int main(int argc, char **argv)
+{
+    MotorDriver::initPins();
+    MotorDriver::setDirection(true, false);
+    _stepGenerator.init();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_full_step);
+    RUN_TEST(test_microstep_16);
+    RUN_TEST(test_short_move_triangle);
+    RUN_TEST(test_single_step);
+    RUN_TEST(test_limits);
+    RUN_TEST(test_halt_during_ramp);
+    return UNITY_END();
+}
@@ -0,0 +1,186 @@
+#include <unity.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "StringProxy.h"
+
+/**
+ * PS:interval:delta events of the whole firmware (setup() and loop() of
+ * main.cpp), read like a host: PP during a move, one at its start and then
+ * every interval ms or delta steps, PC once with the settled position that
+ * FA reports afterwards. PS:0:0 ends them.
+ */
+#define TEST_MOVE "MD:45"
+#define TEST_RETURN "MD:0"
+#define TEST_INTERVAL_MS 100
+#define TEST_DELTA_STEPS 200
+#define TEST_SLACK_MS 30 // an event waits for the loop and the line before it on the wire
+#define TEST_TIMEOUT_S 600.0
+
+void setup();
+void loop();
+
+static bool _isBooted = false;
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static std::string _text(size_t line)
+{
+    std::string text = Simulator::deviceLines()[line].text;
+    if (!text.empty() && text[text.size() - 1] == ';')
+        text.erase(text.size() - 1);
+
+    return text;
+}
+
+// the host sends a command and waits for its reply, the firmware loops meanwhile
+static std::string _command(const std::string &text)
+{
+    size_t lines = Simulator::deviceLines().size();
+    double timeout = Simulator::seconds() + TEST_TIMEOUT_S;
+    Simulator::sendToDevice(text + "\n");
+
+    while (Simulator::deviceLines().size() == lines)
+    {
+        loop();
+        TEST_ASSERT_LESS_THAN(timeout, Simulator::seconds());
+    }
+
+    return _text(lines);
+}
+
+static void _pollUntilStopped()
+{
+    while (_command("FR") != "FR:0")
+        ;
+}
+
+// the firmware boots once, homing answers moves (KO) until the first accepted one ends it
+static void _boot()
+{
+    if (_isBooted)
+        return;
+
+    Simulator::reset();
+    setup();
+    while (_command(TEST_RETURN) == "(KO)")
+        ;
+
+    _pollUntilStopped();
+    _isBooted = true;
+}
+
+// the lines after the reply to a move up to its PC, PP and PC only when subscribed
+static std::vector<SimLine> _move(const std::string &text)
+{
+    size_t line = Simulator::deviceLines().size() + 1;
+    double timeout = Simulator::seconds() + TEST_TIMEOUT_S;
+    TEST_ASSERT_EQUAL_STRING(text.c_str(), _command(text).substr(0, text.size()).c_str());
+
+    std::vector<SimLine> events;
+    while (events.empty() || events.back().text.compare(0, 3, "PC:") != 0)
+    {
+        loop();
+        TEST_ASSERT_LESS_THAN(timeout, Simulator::seconds());
+
+        for (; line < Simulator::deviceLines().size(); line++)
+        {
+            events.push_back(Simulator::deviceLines()[line]);
+            events.back().text = _text(line);
+        }
+    }
+
+    return events;
+}
+
+static unsigned long _steps(const SimLine &event)
+{
+    return strtoul(event.text.c_str() + 3, NULL, 10);
+}
+
+static double _ms(uint64_t cycles)
+{
+    return cycles * 1000.0 / F_CPU;
+}
+
+// PP events, then one PC with the position FP and FD report at rest
+static void _assertEvents(const std::vector<SimLine> &events)
+{
+    TEST_ASSERT_GREATER_THAN(2, events.size());
+    for (size_t event = 0; event + 1 < events.size(); event++)
+        TEST_ASSERT_EQUAL_STRING("PP:", events[event].text.substr(0, 3).c_str());
+
+    std::string complete = "PC:" + _command("FP").substr(3) + ":" + _command("FD").substr(3);
+    TEST_ASSERT_EQUAL_STRING(complete.c_str(), events.back().text.c_str());
+}
+
+static void test_interval(void)
+{
+    _boot();
+    TEST_ASSERT_EQUAL_STRING("PS:100:0", _command("PS:100:0").c_str());
+
+    std::vector<SimLine> events = _move(TEST_MOVE);
+    _assertEvents(events);
+
+    for (size_t event = 1; event + 1 < events.size(); event++)
+    {
+        double gap = _ms(events[event].cycle - events[event - 1].cycle);
+        TEST_ASSERT_GREATER_OR_EQUAL(TEST_INTERVAL_MS - TEST_SLACK_MS, (int)gap);
+        TEST_ASSERT_LESS_OR_EQUAL(TEST_INTERVAL_MS + TEST_SLACK_MS, (int)gap);
+        TEST_ASSERT_GREATER_THAN(_steps(events[event - 1]), _steps(events[event]));
+    }
+
+    _assertEvents(_move(TEST_RETURN));
+}
+
+static void test_delta(void)
+{
+    _boot();
+    TEST_ASSERT_EQUAL_STRING("PS:0:200", _command("PS:0:200").c_str());
+
+    std::vector<SimLine> events = _move(TEST_MOVE);
+    _assertEvents(events);
+
+    // an event is due once the rotator moved delta steps, it is sent on the next loop
+    for (size_t event = 1; event + 1 < events.size(); event++)
+    {
+        unsigned long moved = _steps(events[event]) - _steps(events[event - 1]);
+        TEST_ASSERT_GREATER_OR_EQUAL(TEST_DELTA_STEPS, moved);
+        TEST_ASSERT_LESS_THAN(2 * TEST_DELTA_STEPS, moved);
+    }
+
+    // back down, the positions fall
+    events = _move(TEST_RETURN);
+    _assertEvents(events);
+    for (size_t event = 1; event + 1 < events.size(); event++)
+        TEST_ASSERT_GREATER_OR_EQUAL(TEST_DELTA_STEPS, _steps(events[event - 1]) - _steps(events[event]));
+    TEST_ASSERT_EQUAL_UINT32(0, _steps(events.back()));
+}
+
+static void test_unsubscribe(void)
+{
+    _boot();
+    TEST_ASSERT_EQUAL_STRING("PS:100:0", _command("PS:100:0").c_str());
+    TEST_ASSERT_EQUAL_STRING("PS:0:0", _command("PS:0:0").c_str());
+
+    // only the replies to FR until the rotator is at rest
+    size_t lines = Simulator::deviceLines().size();
+    _command(TEST_MOVE);
+    _pollUntilStopped();
+    _command(TEST_RETURN);
+    _pollUntilStopped();
+
+    for (size_t line = lines; line < Simulator::deviceLines().size(); line++)
+        TEST_ASSERT_NOT_EQUAL(0, _text(line).compare(0, 1, "P"));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_interval);
+    RUN_TEST(test_delta);
+    RUN_TEST(test_unsubscribe);
+    return UNITY_END();
+}
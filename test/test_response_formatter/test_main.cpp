@@ -0,0 +1,221 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include "ResponseFormatter.h"
+#include "StepConverter.h"
+
+/**
+ * Replies of ResponseFormatter against the dtostrf + sprintf replies they
+ * replaced. The old path is rebuilt with the AVR float arithmetic (double is
+ * float there) and dtostrf(value, 1, 2), which rounds half up on the decimal
+ * expansion of the float.
+ *
+ * The only positions where the replies differ are exact ties, steps half a
+ * hundredth between two: the float quotient lands just below some of them
+ * and the old reply rounded down, StepConverter rounds every tie up.
+ */
+#define TEST_ROTATOR_GEAR_TEETH 100
+#define TEST_MOTOR_GEAR_TEETH 20
+#define TEST_BUFFER_SIZE 48
+#define TEST_DEGREES_SIZE 16
+
+class TestDriver
+{
+public:
+    unsigned long stepsPerRevolution; // motor shaft
+    const char *name;
+};
+
+static const TestDriver DRIVERS[] = {
+    {4096, "ULN2003"},
+    {400, "TMC220X, full steps"},
+    {400 * 16, "TMC220X, 16 microsteps"},
+    {400 * 256, "TMC220X, 256 microsteps"}};
+
+static StepConverter _converter;
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static float _oldStepsPerDeg(const TestDriver &driver)
+{
+    float stepsPerDeg = (float)driver.stepsPerRevolution;
+    stepsPerDeg *= (100.0f / 20.0f);
+    stepsPerDeg /= 360.0f;
+
+    return stepsPerDeg;
+}
+
+static void _dtostrf(float value, char *out)
+{
+    // the float is exact as a double, only the rounding digit is looked at
+    double hundredths = floor(fabs((double)value) * 100.0 + 0.5);
+    sprintf(out, "%s%.0f.%02.0f", value < 0 ? "-" : "", floor(hundredths / 100.0), fmod(hundredths, 100.0));
+}
+
+static bool _isTie(const TestDriver &driver, unsigned long steps)
+{
+    unsigned long long twice = (unsigned long long)steps * 2 * STEP_CONVERTER_HUNDREDTHS_PER_REVOLUTION * TEST_MOTOR_GEAR_TEETH;
+    unsigned long long unit = (unsigned long long)driver.stepsPerRevolution * TEST_ROTATOR_GEAR_TEETH;
+
+    return twice % unit == 0 && (twice / unit) % 2 == 1;
+}
+
+static void _assertReplies(const TestDriver &driver, unsigned long steps)
+{
+    char degrees[TEST_DEGREES_SIZE];
+    char expected[TEST_BUFFER_SIZE];
+    char actual[TEST_BUFFER_SIZE];
+    char message[TEST_BUFFER_SIZE * 2];
+    static const char *const PREFIXES[] = {"FD:", "MD:", "SD:"};
+
+    unsigned long hundredths = _converter.stepsToHundredths(steps);
+    // a tie rounds up, whichever side of it the float quotient fell
+    if (_isTie(driver, steps))
+        snprintf(degrees, sizeof(degrees), "%u.%02u", (unsigned int)(hundredths / 100), (unsigned int)(hundredths % 100));
+    else
+        _dtostrf(steps / _oldStepsPerDeg(driver), degrees);
+
+    snprintf(message, sizeof(message), "%s, %lu steps", driver.name, steps);
+
+    for (const char *prefix : PREFIXES)
+    {
+        snprintf(expected, sizeof(expected), "%s%s", prefix, degrees);
+        ResponseFormatter::writeFixed2(ResponseFormatter::writeText(actual, prefix), hundredths);
+        TEST_ASSERT_EQUAL_STRING_MESSAGE(expected, actual, message);
+    }
+
+    for (int flags = 0; flags < 4; flags++)
+    {
+        bool isMoving = flags & 1;
+        bool isReversed = flags & 2;
+        snprintf(expected, sizeof(expected), "FR_OK:%lu:%s:%c:0:0:%c", steps, degrees, isMoving ? '1' : '0', isReversed ? '1' : '0');
+
+        char *out = ResponseFormatter::writeText(actual, "FR_OK:");
+        out = ResponseFormatter::writeUnsigned(out, steps);
+        out = ResponseFormatter::writeChar(out, ':');
+        out = ResponseFormatter::writeFixed2(out, hundredths);
+        out = ResponseFormatter::writeChar(out, ':');
+        out = ResponseFormatter::writeFlag(out, isMoving);
+        out = ResponseFormatter::writeText(out, ":0:0:");
+        ResponseFormatter::writeFlag(out, isReversed);
+        TEST_ASSERT_EQUAL_STRING_MESSAGE(expected, actual, message);
+    }
+}
+
+static void test_steps_per_degree(void)
+{
+    char expected[TEST_BUFFER_SIZE];
+    char actual[TEST_BUFFER_SIZE];
+    char degrees[TEST_DEGREES_SIZE];
+
+    for (const TestDriver &driver : DRIVERS)
+    {
+        _converter.configure(driver.stepsPerRevolution, TEST_ROTATOR_GEAR_TEETH, TEST_MOTOR_GEAR_TEETH);
+
+        _dtostrf(_oldStepsPerDeg(driver), degrees);
+        snprintf(expected, sizeof(expected), "FS:%s", degrees);
+        ResponseFormatter::writeFixed2(ResponseFormatter::writeText(actual, "FS:"), _converter.getStepsPerDegHundredths());
+        TEST_ASSERT_EQUAL_STRING_MESSAGE(expected, actual, driver.name);
+    }
+}
+
+static void test_formatting(void)
+{
+    // the formatter alone, any hundredths the old path could print
+    static const unsigned long HUNDREDTHS[] = {0, 1, 5, 9, 10, 99, 100, 101, 995, 999, 1000, 35999, 36000, 99999, 100000, 999999};
+    static const char *const PREFIXES[] = {"FD:", "FS:", "MD:", "SD:"};
+    char degrees[TEST_DEGREES_SIZE];
+    char expected[TEST_BUFFER_SIZE];
+    char actual[TEST_BUFFER_SIZE];
+
+    for (unsigned long hundredths : HUNDREDTHS)
+    {
+        _dtostrf(hundredths / 100.0f, degrees);
+
+        for (const char *prefix : PREFIXES)
+        {
+            snprintf(expected, sizeof(expected), "%s%s", prefix, degrees);
+            ResponseFormatter::writeFixed2(ResponseFormatter::writeText(actual, prefix), hundredths);
+            TEST_ASSERT_EQUAL_STRING(expected, actual);
+        }
+    }
+
+    // FA with the largest position an unsigned long can hold
+    snprintf(expected, sizeof(expected), "FR_OK:%lu:%s:%c:0:0:%c", 4294967295UL, "359.99", '1', '0');
+    char *out = ResponseFormatter::writeText(actual, "FR_OK:");
+    out = ResponseFormatter::writeUnsigned(out, 4294967295UL);
+    out = ResponseFormatter::writeChar(out, ':');
+    out = ResponseFormatter::writeFixed2(out, 35999);
+    out = ResponseFormatter::writeChar(out, ':');
+    out = ResponseFormatter::writeFlag(out, true);
+    out = ResponseFormatter::writeText(out, ":0:0:");
+    ResponseFormatter::writeFlag(out, false);
+    TEST_ASSERT_EQUAL_STRING(expected, actual);
+}
+
+static void test_edge_positions(void)
+{
+    for (const TestDriver &driver : DRIVERS)
+    {
+        _converter.configure(driver.stepsPerRevolution, TEST_ROTATOR_GEAR_TEETH, TEST_MOTOR_GEAR_TEETH);
+        unsigned long maxSteps = _converter.getStepsPerRevolution();
+
+        // 0, 0.01, 359.99 and a full revolution, the last steps before it and the largest position
+        unsigned long steps[] = {
+            0, 1, _converter.hundredthsToSteps(1), _converter.hundredthsToSteps(35999),
+            maxSteps - 1, maxSteps, _converter.hundredthsToSteps(18000), maxSteps / 3};
+
+        for (unsigned long step : steps)
+            _assertReplies(driver, step);
+    }
+}
+
+static void test_rounding_boundaries(void)
+{
+    for (const TestDriver &driver : DRIVERS)
+    {
+        _converter.configure(driver.stepsPerRevolution, TEST_ROTATOR_GEAR_TEETH, TEST_MOTOR_GEAR_TEETH);
+        unsigned long maxSteps = _converter.getStepsPerRevolution();
+
+        // ties round up, the steps next to them agree with the old replies
+        for (unsigned long steps = 1; steps < maxSteps; steps++)
+        {
+            if (!_isTie(driver, steps))
+                continue;
+
+            _assertReplies(driver, steps - 1);
+            _assertReplies(driver, steps);
+            _assertReplies(driver, steps + 1);
+            unsigned long long twice = (unsigned long long)steps * 2 * STEP_CONVERTER_HUNDREDTHS_PER_REVOLUTION * TEST_MOTOR_GEAR_TEETH;
+            TEST_ASSERT_EQUAL_UINT32((twice / (driver.stepsPerRevolution * TEST_ROTATOR_GEAR_TEETH) + 1) / 2, _converter.stepsToHundredths(steps));
+        }
+    }
+}
+
+static void test_every_position(void)
+{
+    // below 256 microsteps a revolution is short enough to try every step
+    for (const TestDriver &driver : DRIVERS)
+    {
+        _converter.configure(driver.stepsPerRevolution, TEST_ROTATOR_GEAR_TEETH, TEST_MOTOR_GEAR_TEETH);
+        unsigned long maxSteps = _converter.getStepsPerRevolution();
+        unsigned long stride = maxSteps > 100000 ? 7 : 1;
+
+        for (unsigned long steps = 0; steps <= maxSteps; steps += stride)
+            _assertReplies(driver, steps);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_formatting);
+    RUN_TEST(test_steps_per_degree);
+    RUN_TEST(test_edge_positions);
+    RUN_TEST(test_rounding_boundaries);
+    RUN_TEST(test_every_position);
+    return UNITY_END();
+}
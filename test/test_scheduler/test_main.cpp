@@ -0,0 +1,167 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string>
+#include "Scheduler.h"
+
+/**
+ * Scheduler statistics: a late periodic run counts as one overrun, however
+ * late. Then the whole firmware (setup() and loop() of main.cpp) runs in
+ * simulated time through homing, a move and an EEPROM save while the host
+ * polls over serial, and every task, above all the serial one, has to keep
+ * its deadline. TS:n reports the statistics like a host would read them.
+ */
+#define TEST_PASS_CYCLES (F_CPU / 10000) // 100us between scheduler passes
+#define TEST_PERIOD_MS 10
+#define TEST_DEADLINE_US 1000UL
+#define TEST_TIMEOUT_S 600.0
+#define TEST_TASKS 5                    // motor, serial, homing, driver, EEPROM, see main.cpp
+#define TEST_SERIAL_TASK 1
+#define TEST_SERIAL_DEADLINE_US 5000UL  // TASK_SERIAL_DEADLINE_US of main.cpp
+#define TEST_EEPROM_CHECK_MS 6000       // EEPROM_CHECK_PERIOD_MS and the bytes programmed after it
+
+void setup();
+void loop();
+
+static Scheduler _scheduler;
+static unsigned long _blockMs = 0;
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static void _runBlocking()
+{
+    if (_blockMs > 0)
+        delay(_blockMs);
+
+    _blockMs = 0;
+}
+
+static void _runPeriodic() {}
+
+static void _runPasses(unsigned long ms)
+{
+    uint64_t end = Simulator::cycles() + (uint64_t)ms * (F_CPU / 1000);
+    while (Simulator::cycles() < end)
+    {
+        _scheduler.run();
+        Simulator::advance(TEST_PASS_CYCLES);
+    }
+}
+
+static void test_late_periodic_run(void)
+{
+    _scheduler.add(_runBlocking, 0, SCHEDULER_CONTINUOUS, 1000000UL);
+    unsigned char periodic = _scheduler.add(_runPeriodic, 1, TEST_PERIOD_MS, TEST_DEADLINE_US);
+    const SchedulerTask &task = _scheduler.getTask(periodic);
+
+    // on time, 100us passes are well within the deadline
+    _runPasses(10 * TEST_PERIOD_MS);
+    TEST_ASSERT_EQUAL_UINT32(0, task.overruns);
+    TEST_ASSERT_LESS_OR_EQUAL(TEST_DEADLINE_US, task.maxLatencyUs);
+
+    // past the deadline within the period: one overrun
+    _blockMs = TEST_PERIOD_MS / 2;
+    _runPasses(2 * TEST_PERIOD_MS);
+    TEST_ASSERT_EQUAL_UINT32(1, task.overruns);
+
+    // more than two periods behind: one overrun for the late run, the missed ones are dropped
+    _blockMs = 2 * TEST_PERIOD_MS + TEST_PERIOD_MS / 2;
+    _runPasses(4 * TEST_PERIOD_MS);
+    TEST_ASSERT_EQUAL_UINT32(2, task.overruns);
+    TEST_ASSERT_GREATER_OR_EQUAL((unsigned long)TEST_PERIOD_MS * 1000UL, task.maxLatencyUs);
+
+    // back on the grid
+    _runPasses(10 * TEST_PERIOD_MS);
+    TEST_ASSERT_EQUAL_UINT32(2, task.overruns);
+}
+
+// the host sends a command and waits for its reply, the firmware loops meanwhile
+static std::string _command(const char *text)
+{
+    size_t lines = Simulator::deviceLines().size();
+    double timeout = Simulator::seconds() + TEST_TIMEOUT_S;
+    Simulator::sendToDevice(std::string(text) + "\n");
+
+    while (Simulator::deviceLines().size() == lines)
+    {
+        loop();
+        TEST_ASSERT_LESS_THAN(timeout, Simulator::seconds());
+    }
+
+    std::string reply = Simulator::deviceLines()[lines].text;
+    if (!reply.empty() && reply[reply.size() - 1] == ';')
+        reply.erase(reply.size() - 1);
+
+    return reply;
+}
+
+static void _pollUntilStopped()
+{
+    std::string reply;
+    do
+    {
+        _command("FA");
+        reply = _command("FR");
+    } while (reply != "FR:0");
+}
+
+static void _assertTasksInTime()
+{
+    for (int id = 0; id < TEST_TASKS; id++)
+    {
+        char text[8];
+        snprintf(text, sizeof(text), "TS:%d", id);
+        std::string reply = _command(text);
+
+        int replyId;
+        unsigned long runs, overruns, maxLatencyUs, maxRunUs;
+        TEST_ASSERT_EQUAL_INT(5, sscanf(reply.c_str(), "TS:%d:%lu:%lu:%lu:%lu", &replyId, &runs, &overruns, &maxLatencyUs, &maxRunUs));
+        TEST_ASSERT_EQUAL_INT(id, replyId);
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, overruns, reply.c_str());
+
+        if (id == TEST_SERIAL_TASK)
+        {
+            TEST_ASSERT_GREATER_THAN(0, runs);
+            TEST_ASSERT_LESS_OR_EQUAL(TEST_SERIAL_DEADLINE_US, maxLatencyUs);
+        }
+    }
+}
+
+static void test_firmware_tasks(void)
+{
+    setup();
+
+    // homing: moves answer (KO) until home is found, the first accepted one ends it
+    std::string reply;
+    do
+    {
+        _command("FA");
+        reply = _command("MD:0");
+    } while (reply == "(KO)");
+    _pollUntilStopped();
+    _assertTasksInTime();
+
+    // a move polled all the way
+    TEST_ASSERT_EQUAL_STRING("MD:180.00", _command("MD:180").c_str());
+    _pollUntilStopped();
+    _assertTasksInTime();
+
+    // another step mode is saved once the check period passed, polled until it is programmed
+    unsigned long eepromWrites = Simulator::eepromWrites();
+    TEST_ASSERT_EQUAL_STRING("(OK)", _command("SS:8").c_str());
+    double end = Simulator::seconds() + TEST_EEPROM_CHECK_MS / 1000.0;
+    while (Simulator::seconds() < end)
+        _command("FA");
+
+    TEST_ASSERT_GREATER_THAN(eepromWrites, Simulator::eepromWrites());
+    _assertTasksInTime();
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_late_periodic_run);
+    RUN_TEST(test_firmware_tasks);
+    return UNITY_END();
+}
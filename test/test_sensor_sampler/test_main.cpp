@@ -0,0 +1,125 @@
+#include <unity.h>
+#include "CustomEEPROM.h"
+#include "Motor.h"
+#include "SensorSampler.h"
+
+/**
+ * SensorSampler on the simulated ADC: filtered readings of the Hall sensor
+ * and the input voltage, and the delay the ADC interrupt adds to the Timer1
+ * steps of a derotation. The simulation counts interrupt entry and register
+ * accesses, an interrupt that filters costs more on the real chip.
+ */
+#define TEST_CYCLES_PER_HUNDREDTH_MS (F_CPU / 100000UL)
+#define TEST_INTERVAL_HUNDREDTHS_MS 100 // 1 ms per step
+#define TEST_SETTLE_STEPS 104           // the untrusted record of the start is written meanwhile
+#define TEST_STEPS 104                  // the phase to the conversions repeats every 13 steps, the coil pattern every 8
+#define TEST_TIMER_TICK_CYCLES 8        // prescaler 8
+#define TEST_CONVERSION_CYCLES (SIM_ADC_CONVERSION_CLOCKS * 128UL)
+#define TEST_PHASE_CYCLES 128           // steps (16000 cycles) and conversions (1664 cycles) meet at multiples of it
+#define TEST_MAX_STEP_DELAY_CYCLES (SIM_ISR_CYCLES + TEST_TIMER_TICK_CYCLES) // interrupt entry and a few register accesses
+#define TEST_START_POSITION 500000UL
+
+static CustomEEPROM _eeprom;
+static Motor _motor;
+static SensorSampler _sensor;
+
+void setUp(void) {}
+
+void tearDown(void)
+{
+    _motor.stopMotor();
+}
+
+// derotates starting offsetCycles after a conversion started at phaseCycle would, once
+// the EEPROM is idle stores the delay from the compare match to the step for TEST_STEPS steps
+static void _measureLatencies(uint64_t phaseCycle, uint64_t offsetCycles, uint64_t latencies[])
+{
+    uint64_t intervalCycles = (uint64_t)TEST_INTERVAL_HUNDREDTHS_MS * TEST_CYCLES_PER_HUNDREDTH_MS;
+
+    // after the format of the blank EEPROM
+    _eeprom.syncPosition(TEST_START_POSITION);
+    while (_eeprom.isWriting())
+        Simulator::advance(TEST_CONVERSION_CYCLES);
+
+    Simulator::advance(TEST_CONVERSION_CYCLES - (Simulator::cycles() - phaseCycle) % TEST_CONVERSION_CYCLES + offsetCycles);
+    _motor.startDerotation(TEST_INTERVAL_HUNDREDTHS_MS, true);
+    uint64_t startCycle = Simulator::cycles();
+
+    for (unsigned long step = 1; step <= TEST_SETTLE_STEPS + TEST_STEPS; step++)
+    {
+        uint64_t stepCycle = startCycle + step * intervalCycles;
+        Simulator::advanceTo(stepCycle + intervalCycles / 2);
+        TEST_ASSERT_TRUE(_motor.handleMotor());
+
+        if (step == TEST_SETTLE_STEPS)
+            TEST_ASSERT_FALSE(_eeprom.isWriting());
+        else if (step > TEST_SETTLE_STEPS)
+            latencies[step - TEST_SETTLE_STEPS - 1] = Simulator::motorStepCycle() - stepCycle;
+    }
+
+    _motor.stopMotor();
+}
+
+static void test_step_jitter(void)
+{
+    // the driver pin writes alone, each step keeps the same delay in every run
+    static uint64_t withoutSampler[TEST_STEPS];
+    static uint64_t latencies[TEST_STEPS];
+    _measureLatencies(0, 0, withoutSampler);
+
+    // the ADC interrupt every 104us hits some of the steps, a run for every
+    // Timer1 tick of phase between the two, delaying each by no more than itself
+    _sensor.init();
+    uint64_t phaseCycle = Simulator::cycles();
+    uint64_t maxDelay = 0;
+    for (uint64_t offset = 0; offset < TEST_PHASE_CYCLES; offset += TEST_TIMER_TICK_CYCLES)
+    {
+        _measureLatencies(phaseCycle, offset, latencies);
+        for (unsigned long step = 0; step < TEST_STEPS; step++)
+        {
+            TEST_ASSERT_GREATER_OR_EQUAL(withoutSampler[step], latencies[step]);
+            uint64_t delay = latencies[step] - withoutSampler[step];
+            maxDelay = delay > maxDelay ? delay : maxDelay;
+        }
+    }
+
+    TEST_ASSERT_GREATER_THAN(SIM_ISR_CYCLES - TEST_TIMER_TICK_CYCLES, maxDelay);
+    TEST_ASSERT_LESS_OR_EQUAL(TEST_MAX_STEP_DELAY_CYCLES, maxDelay);
+}
+
+static void test_home_sensor(void)
+{
+    // far from the dip the reading stays within the noise of the idle level
+    Simulator::setHomeDegrees(Simulator::rotatorDegrees() + 180.0);
+    Simulator::advance(F_CPU / 100);
+
+    TEST_ASSERT_INT_WITHIN(SIM_HOME_SENSOR_NOISE, SIM_HOME_SENSOR_IDLE, _sensor.read(SENSOR_CHANNEL_HOME));
+
+    // right at home the whole window is down in the dip
+    Simulator::setHomeDegrees(Simulator::rotatorDegrees());
+    Simulator::advance(F_CPU / 100);
+
+    TEST_ASSERT_INT_WITHIN(SIM_HOME_SENSOR_NOISE + 1, SIM_HOME_SENSOR_IDLE - SIM_HOME_SENSOR_DIP, _sensor.read(SENSOR_CHANNEL_HOME));
+}
+
+static void test_voltage(void)
+{
+#if SENSOR_VOLTAGE_ENABLED
+    // 12V behind the 3:1 divider, within one ADC step
+    TEST_ASSERT_INT_WITHIN(SENSOR_VOLTAGE_FULL_SCALE_HUNDREDTHS / SENSOR_ADC_MAX + 1, 1200, _sensor.readVoltageHundredths());
+#else
+    TEST_ASSERT_EQUAL_UINT32(SENSOR_VOLTAGE_FIXED_HUNDREDTHS, _sensor.readVoltageHundredths());
+#endif
+}
+
+int main(int argc, char **argv)
+{
+    _eeprom.init();
+    _motor.init(_eeprom);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_step_jitter);
+    RUN_TEST(test_home_sensor);
+    RUN_TEST(test_voltage);
+    return UNITY_END();
+}
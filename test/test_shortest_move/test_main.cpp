@@ -0,0 +1,96 @@
+#include <unity.h>
+#include "CustomEEPROM.h"
+#include "Motor.h"
+
+/**
+ * Moves on the modular axis without a cable wrap limit (pio test -e native_modular),
+ * run to the end on the simulated motor. 20480 steps per revolution (ULN2003, SR:100:20).
+ */
+#if !ROTATOR_MODULAR_AXIS || ROTATOR_CABLE_WRAP_DEG > 0
+#error "test_shortest_move needs -D ROTATOR_MODULAR_AXIS=1 without ROTATOR_CABLE_WRAP_DEG"
+#endif
+
+#define TEST_POLL_CYCLES (F_CPU / 100)
+
+static CustomEEPROM _eeprom;
+static Motor _motor;
+static unsigned long _stepsPerRevolution;
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+// moves from position to target, returns the signed steps the motor made
+static long _move(unsigned long position, unsigned long targetPosition)
+{
+    _eeprom.setPosition(position);
+    TEST_ASSERT_TRUE(_eeprom.setTargetPosition(targetPosition));
+
+    long motorSteps = Simulator::motorSteps();
+    _motor.startMotor(5);
+    while (_motor.handleMotor())
+        Simulator::advance(TEST_POLL_CYCLES);
+
+    TEST_ASSERT_EQUAL_UINT32(targetPosition % _stepsPerRevolution, _eeprom.getPosition());
+    TEST_ASSERT_EQUAL_UINT32(_eeprom.getPosition(), _eeprom.getTargetPosition());
+
+    return Simulator::motorSteps() - motorSteps;
+}
+
+static void test_steps_per_revolution(void)
+{
+    TEST_ASSERT_TRUE(_motor.isUartInitialized());
+    TEST_ASSERT_EQUAL_UINT32(20480, _stepsPerRevolution);
+}
+
+static void test_half_revolution_tie(void)
+{
+    // exactly 180 deg either way keeps the direction of the plain difference
+    long half = _stepsPerRevolution / 2;
+
+    TEST_ASSERT_EQUAL_INT32(half, _move(0, half));
+    TEST_ASSERT_EQUAL_INT32(-half, _move(half, 0));
+    TEST_ASSERT_EQUAL_INT32(-half, _move(_stepsPerRevolution * 3 / 4, _stepsPerRevolution / 4));
+    TEST_ASSERT_EQUAL_INT32(half, _move(_stepsPerRevolution / 4, _stepsPerRevolution * 3 / 4));
+
+    // one step off the tie takes the shorter way
+    TEST_ASSERT_EQUAL_INT32(-(half - 1), _move(0, half + 1));
+    TEST_ASSERT_EQUAL_INT32(half - 1, _move(half + 1, 0));
+}
+
+static void test_crossing_zero(void)
+{
+    unsigned long deg359 = _motor.getStepConverter().hundredthsToSteps(35900);
+    unsigned long deg1 = _motor.getStepConverter().hundredthsToSteps(100);
+
+    // 359 deg -> 1 deg turns 2 deg forward across 0, and back
+    TEST_ASSERT_EQUAL_INT32(_stepsPerRevolution - deg359 + deg1, _move(deg359, deg1));
+    TEST_ASSERT_EQUAL_INT32(-(long)(_stepsPerRevolution - deg359 + deg1), _move(deg1, deg359));
+
+    // onto 0 from either side
+    TEST_ASSERT_EQUAL_INT32(_stepsPerRevolution - deg359, _move(deg359, 0));
+    TEST_ASSERT_EQUAL_INT32(-(long)(_stepsPerRevolution - deg359), _move(0, deg359));
+    TEST_ASSERT_EQUAL_INT32(-(long)deg1, _move(deg1, 0));
+    TEST_ASSERT_EQUAL_INT32(1, _move(_stepsPerRevolution - 1, 0));
+    TEST_ASSERT_EQUAL_INT32(-1, _move(0, _stepsPerRevolution - 1));
+}
+
+static void test_no_move(void)
+{
+    TEST_ASSERT_EQUAL_INT32(0, _move(1234, 1234));
+    TEST_ASSERT_EQUAL_INT32(0, _move(0, 0));
+}
+
+int main(int argc, char **argv)
+{
+    _eeprom.init();
+    _motor.init(_eeprom);
+    _stepsPerRevolution = _motor.getStepsPerRevolution();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_steps_per_revolution);
+    RUN_TEST(test_half_revolution_tie);
+    RUN_TEST(test_crossing_zero);
+    RUN_TEST(test_no_move);
+    return UNITY_END();
+}
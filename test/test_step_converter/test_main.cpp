@@ -0,0 +1,176 @@
+#include <unity.h>
+#include "StepConverter.h"
+
+/**
+ * StepConverter against exact rational arithmetic: every conversion has to
+ * equal the rounded (half up) value of the unreduced fraction, whichever of
+ * the 32 or 64 bit paths of _mulDivRound it takes.
+ */
+#define TEST_HUNDREDTHS_359_99 35999UL
+
+class TestGearing
+{
+public:
+    unsigned long motorStepsPerRevolution;
+    unsigned char rotatorGearTeeth;
+    unsigned char motorGearTeeth;
+};
+
+static const TestGearing GEARINGS[] = {
+    {4096, 100, 20},      // ULN2003, default SR:100:20
+    {400 * 16, 100, 20},  // TMC2208 at 16 microsteps, default gearing
+    {400 * 256, 100, 20}, // 256 microsteps, more than one step per hundredth
+    {4096, 97, 13},       // odd ratios, nothing cancels
+    {400 * 256, 255, 7},
+    {400, 1, 255},
+    {4076, 255, 1}};
+
+static StepConverter _converter;
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+static unsigned long long _roundedDivision(unsigned long long numerator, unsigned long long denominator)
+{
+    return (numerator + denominator / 2) / denominator;
+}
+
+static unsigned long long _expectedSteps(const TestGearing &gearing, unsigned long hundredths)
+{
+    return _roundedDivision(
+        (unsigned long long)hundredths * gearing.motorStepsPerRevolution * gearing.rotatorGearTeeth,
+        (unsigned long long)gearing.motorGearTeeth * STEP_CONVERTER_HUNDREDTHS_PER_REVOLUTION);
+}
+
+static unsigned long long _expectedHundredths(const TestGearing &gearing, unsigned long steps)
+{
+    return _roundedDivision(
+        (unsigned long long)steps * gearing.motorGearTeeth * STEP_CONVERTER_HUNDREDTHS_PER_REVOLUTION,
+        (unsigned long long)gearing.motorStepsPerRevolution * gearing.rotatorGearTeeth);
+}
+
+static void _configure(const TestGearing &gearing)
+{
+    _converter.configure(gearing.motorStepsPerRevolution, gearing.rotatorGearTeeth, gearing.motorGearTeeth);
+}
+
+static void test_default_gearing(void)
+{
+    _configure(GEARINGS[0]);
+
+    // 4096 * 100 / 20 steps per revolution
+    TEST_ASSERT_EQUAL_UINT32(20480, _converter.getStepsPerRevolution());
+    TEST_ASSERT_EQUAL_UINT32(5689, _converter.getStepsPerDegHundredths()); // 56.888..
+    TEST_ASSERT_EQUAL_UINT32(0, _converter.hundredthsToSteps(0));
+    TEST_ASSERT_EQUAL_UINT32(0, _converter.stepsToHundredths(0));
+    TEST_ASSERT_EQUAL_UINT32(10240, _converter.hundredthsToSteps(18000));
+    TEST_ASSERT_EQUAL_UINT32(20479, _converter.hundredthsToSteps(TEST_HUNDREDTHS_359_99)); // 20479.43
+    TEST_ASSERT_EQUAL_UINT32(35998, _converter.stepsToHundredths(20479));                  // 35998.24
+}
+
+static void test_conversions_round_exactly(void)
+{
+    static const unsigned long HUNDREDTHS[] = {0, 1, 49, 50, 51, 100, 9000, 18000, 27000, TEST_HUNDREDTHS_359_99, 36000, 72000, 1000000};
+
+    for (const TestGearing &gearing : GEARINGS)
+    {
+        _configure(gearing);
+
+        for (unsigned long hundredths : HUNDREDTHS)
+        {
+            unsigned long long steps = _expectedSteps(gearing, hundredths);
+            TEST_ASSERT_EQUAL_UINT32(steps, _converter.hundredthsToSteps(hundredths));
+            TEST_ASSERT_EQUAL_UINT32(_expectedHundredths(gearing, steps), _converter.stepsToHundredths(steps));
+        }
+
+        TEST_ASSERT_EQUAL_UINT32(_expectedSteps(gearing, STEP_CONVERTER_HUNDREDTHS_PER_REVOLUTION), _converter.getStepsPerRevolution());
+        TEST_ASSERT_EQUAL_UINT32(_expectedSteps(gearing, 10000), _converter.getStepsPerDegHundredths());
+    }
+}
+
+static void test_round_trip(void)
+{
+    for (const TestGearing &gearing : GEARINGS)
+    {
+        _configure(gearing);
+
+        // half of one step in hundredths, or half of one hundredth in steps, rounded up
+        unsigned long long stepUnits = (unsigned long long)gearing.motorStepsPerRevolution * gearing.rotatorGearTeeth;
+        unsigned long long hundredthUnits = (unsigned long long)gearing.motorGearTeeth * STEP_CONVERTER_HUNDREDTHS_PER_REVOLUTION;
+        bool isStepFinerThanHundredth = stepUnits >= hundredthUnits;
+
+        // the coarser unit survives the round trip through the finer one unchanged
+        for (unsigned long hundredths = 0; hundredths <= TEST_HUNDREDTHS_359_99; hundredths += 7)
+        {
+            unsigned long back = _converter.stepsToHundredths(_converter.hundredthsToSteps(hundredths));
+            if (isStepFinerThanHundredth)
+                TEST_ASSERT_EQUAL_UINT32(hundredths, back);
+            else
+                TEST_ASSERT_UINT32_WITHIN(hundredthUnits / stepUnits / 2 + 1, hundredths, back);
+        }
+
+        unsigned long lastStep = _converter.hundredthsToSteps(TEST_HUNDREDTHS_359_99);
+        for (unsigned long steps = 0; steps <= lastStep; steps += 13)
+        {
+            unsigned long back = _converter.hundredthsToSteps(_converter.stepsToHundredths(steps));
+            if (isStepFinerThanHundredth)
+                TEST_ASSERT_UINT32_WITHIN(stepUnits / hundredthUnits / 2 + 1, steps, back);
+            else
+                TEST_ASSERT_EQUAL_UINT32(steps, back);
+        }
+
+        // 359.99 deg and back
+        unsigned long steps = _converter.hundredthsToSteps(TEST_HUNDREDTHS_359_99);
+        TEST_ASSERT_EQUAL_UINT32(_expectedHundredths(gearing, steps), _converter.stepsToHundredths(steps));
+    }
+}
+
+static void test_64_bit_fallback(void)
+{
+    // 256 microsteps with SR:255:7 reduces to 2176/21, from 100 revolutions on
+    // hundredths * 2176 and from 204 million steps on steps * 21 exceed 32 bit
+    const TestGearing &gearing = GEARINGS[4];
+    _configure(gearing);
+
+    unsigned long stepsPerRevolution = _converter.getStepsPerRevolution();
+    TEST_ASSERT_EQUAL_UINT32(_expectedSteps(gearing, STEP_CONVERTER_HUNDREDTHS_PER_REVOLUTION), stepsPerRevolution);
+    TEST_ASSERT_GREATER_THAN(0xFFFFFFFFUL / 2176, 3600000UL);
+    TEST_ASSERT_GREATER_THAN(0xFFFFFFFFUL / 21, 4000000000UL);
+
+    static const unsigned long HUNDREDTHS[] = {TEST_HUNDREDTHS_359_99, 3600000UL, 36000000UL, 4000000000UL};
+    for (unsigned long hundredths : HUNDREDTHS)
+    {
+        unsigned long long steps = _expectedSteps(gearing, hundredths);
+        if (steps > 0xFFFFFFFFULL)
+            continue;
+
+        TEST_ASSERT_EQUAL_UINT32(steps, _converter.hundredthsToSteps(hundredths));
+        TEST_ASSERT_EQUAL_UINT32(_expectedHundredths(gearing, steps), _converter.stepsToHundredths(steps));
+    }
+
+    // large step counts need the 64 bit path the other way
+    static const unsigned long STEPS[] = {stepsPerRevolution - 1, 100000000UL, 4000000000UL};
+    for (unsigned long steps : STEPS)
+        TEST_ASSERT_EQUAL_UINT32(_expectedHundredths(gearing, steps), _converter.stepsToHundredths(steps));
+}
+
+static void test_invalid_gearing(void)
+{
+    // SR:0:n is refused by the EEPROM, the converter still stays defined
+    _converter.configure(4096, 0, 20);
+
+    TEST_ASSERT_EQUAL_UINT32(1234, _converter.hundredthsToSteps(1234));
+    TEST_ASSERT_EQUAL_UINT32(1234, _converter.stepsToHundredths(1234));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_default_gearing);
+    RUN_TEST(test_conversions_round_exactly);
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_64_bit_fallback);
+    RUN_TEST(test_invalid_gearing);
+    return UNITY_END();
+}
@@ -0,0 +1,202 @@
+#include <unity.h>
+#include <vector>
+#include "MotorDriver.h"
+#include "StepGenerator.h"
+
+/**
+ * StepGenerator on the simulated Timer1: every step the interrupt emits is
+ * timed from the cycle the simulated motor saw it, minus the interrupt entry
+ * and the pin writes the driver needed to get there, which leaves the compare
+ * match cycle, so intervals are exact timer ticks.
+ */
+#define TEST_CYCLES_PER_TICK (F_CPU / 1000000UL / STEP_TIMER_TICKS_PER_US)
+#define TEST_POLL_CYCLES 64
+#define TEST_START_TOLERANCE_TICKS 4 // timer started by the last register writes of start()
+
+static StepGenerator _stepGenerator;
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+#if MOTOR_DRIVER == MOTOR_DRIVER_ULN2003
+static const uint8_t ULN2003_SEQUENCE[8] = {0x01, 0x03, 0x02, 0x06, 0x04, 0x0C, 0x08, 0x09};
+
+// IN1..IN4 are written in order, the step is seen at the write of the one coil that changes
+static uint64_t _stepWriteCycles(long motorSteps)
+{
+    uint8_t changed = ULN2003_SEQUENCE[motorSteps & 7] ^ ULN2003_SEQUENCE[(motorSteps - 1) & 7];
+    uint8_t pin = 0;
+    while (!(changed & (1 << pin)))
+        pin++;
+
+    return (pin + 1) * SIM_CALL_CYCLES;
+}
+#else
+static uint64_t _stepWriteCycles(long motorSteps)
+{
+    return SIM_CALL_CYCLES;
+}
+#endif
+
+// runs the plan forward to the end, intervals[0] is the delay from start() to the first step
+static void _run(const MotionPlan &plan, std::vector<unsigned long> &intervals)
+{
+    intervals.clear();
+    long motorSteps = Simulator::motorSteps();
+
+    _stepGenerator.start(plan, true);
+    uint64_t lastCycle = Simulator::cycles();
+
+    while (_stepGenerator.isRunning())
+    {
+        Simulator::advance(TEST_POLL_CYCLES);
+        if (Simulator::motorSteps() == motorSteps)
+            continue;
+
+        TEST_ASSERT_EQUAL_INT32(motorSteps + 1, Simulator::motorSteps()); // polling faster than the shortest interval
+        motorSteps++;
+
+        uint64_t cycle = Simulator::motorStepCycle() - SIM_ISR_CYCLES - _stepWriteCycles(motorSteps);
+        intervals.push_back((cycle - lastCycle + TEST_CYCLES_PER_TICK / 2) / TEST_CYCLES_PER_TICK);
+        lastCycle = cycle;
+    }
+}
+
+static void _planCruise(unsigned long steps, unsigned long ticks, MotionPlan &plan)
+{
+    plan.totalSteps = steps;
+    plan.accelSteps = 0;
+    plan.decelStart = steps;
+    plan.firstTicks = ticks;
+    plan.cruiseTicks = ticks;
+    plan.cruiseRest = 0;
+    plan.cruiseDivisor = 1;
+}
+
+static void test_constant_interval(void)
+{
+    static const unsigned long TICKS[] = {STEP_TIMER_MIN_TICKS + 200, 1000, 8000, STEP_TIMER_MAX_TICKS, 192000};
+
+    for (unsigned long ticks : TICKS)
+    {
+        MotionPlan plan;
+        _planCruise(100, ticks, plan);
+
+        long motorSteps = Simulator::motorSteps();
+        std::vector<unsigned long> intervals;
+        _run(plan, intervals);
+
+        TEST_ASSERT_EQUAL_UINT32(100, intervals.size());
+        TEST_ASSERT_EQUAL_INT32(motorSteps + 100, Simulator::motorSteps());
+        TEST_ASSERT_EQUAL_UINT32(100, _stepGenerator.getStepsDone());
+        TEST_ASSERT_UINT32_WITHIN(TEST_START_TOLERANCE_TICKS, ticks, intervals[0]);
+
+        // longer than the 16 bit compare range: chunks add up to the interval
+        for (size_t i = 1; i < intervals.size(); i++)
+            TEST_ASSERT_EQUAL_UINT32(ticks, intervals[i]);
+    }
+}
+
+static void test_minimum_interval(void)
+{
+    MotionPlan plan;
+    _planCruise(50, STEP_TIMER_MIN_TICKS / 4, plan);
+
+    std::vector<unsigned long> intervals;
+    _run(plan, intervals);
+
+    TEST_ASSERT_EQUAL_UINT32(50, intervals.size());
+    for (size_t i = 1; i < intervals.size(); i++)
+        TEST_ASSERT_EQUAL_UINT32(STEP_TIMER_MIN_TICKS, intervals[i]);
+}
+
+static void test_fractional_interval_does_not_drift(void)
+{
+    // 1000 1/3 ticks, every third interval is one tick longer
+    MotionPlan plan;
+    _planCruise(301, 1000, plan);
+    plan.cruiseRest = 1;
+    plan.cruiseDivisor = 3;
+
+    std::vector<unsigned long> intervals;
+    _run(plan, intervals);
+
+    TEST_ASSERT_EQUAL_UINT32(301, intervals.size());
+
+    unsigned long total = 0;
+    for (size_t i = 1; i < intervals.size(); i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(i % 3 == 0 ? 1001 : 1000, intervals[i]);
+        total += intervals[i];
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(300 * 1000 + 100, total);
+}
+
+static void test_plan_constant(void)
+{
+    // 12.34ms per step, the derotation path
+    MotionPlan plan;
+    MotionPlanner::planConstant(25, 1234, plan);
+
+    TEST_ASSERT_EQUAL_UINT32(25, plan.totalSteps);
+    TEST_ASSERT_EQUAL_UINT32(0, plan.accelSteps);
+    TEST_ASSERT_EQUAL_UINT32(25, plan.decelStart);
+    TEST_ASSERT_EQUAL_UINT32(1234UL * STEP_TIMER_TICKS_PER_MS / 100, plan.cruiseTicks);
+    TEST_ASSERT_EQUAL_UINT32(plan.cruiseTicks, plan.firstTicks);
+    TEST_ASSERT_EQUAL_UINT32(0, plan.cruiseRest);
+
+    std::vector<unsigned long> intervals;
+    _run(plan, intervals);
+
+    TEST_ASSERT_EQUAL_UINT32(25, intervals.size());
+    for (size_t i = 1; i < intervals.size(); i++)
+        TEST_ASSERT_EQUAL_UINT32(24680, intervals[i]);
+}
+
+static void test_zero_steps(void)
+{
+    MotionPlan plan;
+    _planCruise(0, 1000, plan);
+
+    long motorSteps = Simulator::motorSteps();
+    _stepGenerator.start(plan, true);
+
+    TEST_ASSERT_FALSE(_stepGenerator.isRunning());
+    Simulator::advance(1000 * TEST_CYCLES_PER_TICK * 4);
+    TEST_ASSERT_EQUAL_INT32(motorSteps, Simulator::motorSteps());
+}
+
+static void test_stop(void)
+{
+    MotionPlan plan;
+    _planCruise(100, 1000, plan);
+
+    long motorSteps = Simulator::motorSteps();
+    _stepGenerator.start(plan, true);
+    Simulator::advance(10 * 1000 * TEST_CYCLES_PER_TICK + 500);
+    _stepGenerator.stop();
+
+    TEST_ASSERT_FALSE(_stepGenerator.isRunning());
+    TEST_ASSERT_EQUAL_UINT32(10, _stepGenerator.getStepsDone());
+
+    Simulator::advance(100 * 1000 * TEST_CYCLES_PER_TICK);
+    TEST_ASSERT_EQUAL_INT32(motorSteps + 10, Simulator::motorSteps());
+}
+
+int main(int argc, char **argv)
+{
+    MotorDriver::initPins();
+    MotorDriver::setDirection(true, false);
+    _stepGenerator.init();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_constant_interval);
+    RUN_TEST(test_minimum_interval);
+    RUN_TEST(test_fractional_interval_does_not_drift);
+    RUN_TEST(test_plan_constant);
+    RUN_TEST(test_zero_steps);
+    RUN_TEST(test_stop);
+    return UNITY_END();
+}
@@ -0,0 +1,175 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string>
+#include "CustomEEPROM.h"
+#include "CustomSerial.h"
+#include "Telemetry.h"
+
+/**
+ * Every counter of TM counts on the path it names: EEPROM cells programmed
+ * by the write queue, writes postponed behind a full queue, and bytes of a
+ * line beyond SERIAL_COMMAND_MAX_LENGTH. The serial case runs the whole
+ * firmware (setup() and loop() of main.cpp) and reads TM like a host.
+ */
+#if !TELEMETRY_ENABLED
+#error "test_telemetry needs TELEMETRY_ENABLED"
+#endif
+
+#define TEST_CHECK_PERIOD_CYCLES ((EEPROM_CHECK_PERIOD_MS + 1) * (F_CPU / 1000))
+#define TEST_POLL_CYCLES 1000
+#define TEST_POSITION 12345UL
+#define TEST_QUEUED_MOVES ((EEPROM_WRITER_QUEUE_SIZE - 1) / sizeof(EEPROMRecord)) // untrusted records the queue holds
+#define TEST_FIELDS (1 + 2 * TELEMETRY_TIMER_COUNT + TELEMETRY_COUNTER_COUNT)
+#define TEST_DROPPED_BYTES 10
+#define TEST_TIMEOUT_S 600.0
+
+void setup();
+void loop();
+
+void setUp(void)
+{
+    Simulator::reset();
+    Telemetry::reset();
+}
+
+void tearDown(void) {}
+
+// the counters as TM writes them, behind the loop maximum and the timers
+static unsigned long _counter(const char *text, unsigned char counter)
+{
+    unsigned long fields[TEST_FIELDS] = {};
+    unsigned char field = 0;
+    const char *c = text;
+
+    while (field < TEST_FIELDS && *c)
+    {
+        fields[field] = strtoul(c, (char **)&c, 10);
+        field++;
+        if (*c == ':')
+            c++;
+    }
+
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(TEST_FIELDS, field, text);
+
+    return fields[1 + 2 * TELEMETRY_TIMER_COUNT + counter];
+}
+
+static unsigned long _counter(unsigned char counter)
+{
+    char text[STRING_PROXY_RESULT_SIZE];
+    Telemetry::write(text);
+
+    return _counter(text, counter);
+}
+
+static void _waitForWrites(CustomEEPROM &eeprom)
+{
+    while (eeprom.isWriting())
+        Simulator::advance(TEST_POLL_CYCLES);
+}
+
+// the defaults of a blank EEPROM are saved at boot, counting starts once they landed
+static void _boot(CustomEEPROM &eeprom)
+{
+    eeprom.init();
+    _waitForWrites(eeprom);
+    Simulator::eepromWait();
+    Telemetry::reset();
+}
+
+static void test_eeprom_writes(void)
+{
+    CustomEEPROM eeprom;
+    _boot(eeprom);
+    unsigned long eepromWrites = Simulator::eepromWrites();
+
+    // the rotator came to rest: one record once the check period passed
+    eeprom.setPositionTrusted(false);
+    eeprom.setPosition(TEST_POSITION);
+    eeprom.setTargetPosition(TEST_POSITION);
+    eeprom.setPositionTrusted(true);
+    Simulator::advance(TEST_CHECK_PERIOD_CYCLES);
+    eeprom.handleEeprom();
+    _waitForWrites(eeprom);
+
+    TEST_ASSERT_GREATER_THAN(eepromWrites, Simulator::eepromWrites());
+    TEST_ASSERT_EQUAL_UINT32(Simulator::eepromWrites() - eepromWrites, _counter(TELEMETRY_COUNTER_EEPROM_WRITES));
+    TEST_ASSERT_EQUAL_UINT32(0, _counter(TELEMETRY_COUNTER_EEPROM_DEFERRED));
+}
+
+static void test_eeprom_deferred(void)
+{
+    CustomEEPROM eeprom;
+    _boot(eeprom);
+    unsigned long eepromWrites = Simulator::eepromWrites();
+
+    // moves started back to back queue one record each, the queue takes TEST_QUEUED_MOVES of them
+    for (unsigned long move = 0; move < TEST_QUEUED_MOVES + 2; move++)
+    {
+        eeprom.setPositionTrusted(true);
+        eeprom.setPosition(TEST_POSITION + move);
+        eeprom.setTargetPosition(TEST_POSITION + move + 1000);
+        eeprom.setPositionTrusted(false);
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(2, _counter(TELEMETRY_COUNTER_EEPROM_DEFERRED));
+
+    // cells count as they are programmed, those already holding the value are skipped
+    _waitForWrites(eeprom);
+    TEST_ASSERT_LESS_OR_EQUAL(TEST_QUEUED_MOVES * sizeof(EEPROMRecord), Simulator::eepromWrites() - eepromWrites);
+    TEST_ASSERT_EQUAL_UINT32(Simulator::eepromWrites() - eepromWrites, _counter(TELEMETRY_COUNTER_EEPROM_WRITES));
+
+    // with the queue drained the next move start is queued again
+    eeprom.setPositionTrusted(true);
+    eeprom.setPosition(TEST_POSITION);
+    eeprom.setPositionTrusted(false);
+    TEST_ASSERT_TRUE(eeprom.isWriting());
+    TEST_ASSERT_EQUAL_UINT32(2, _counter(TELEMETRY_COUNTER_EEPROM_DEFERRED));
+}
+
+// the host sends a command and waits for its reply, the firmware loops meanwhile
+static std::string _command(const std::string &text)
+{
+    size_t lines = Simulator::deviceLines().size();
+    double timeout = Simulator::seconds() + TEST_TIMEOUT_S;
+    Simulator::sendToDevice(text + "\n");
+
+    while (Simulator::deviceLines().size() == lines)
+    {
+        loop();
+        TEST_ASSERT_LESS_THAN(timeout, Simulator::seconds());
+    }
+
+    std::string reply = Simulator::deviceLines()[lines].text;
+    if (!reply.empty() && reply[reply.size() - 1] == ';')
+        reply.erase(reply.size() - 1);
+
+    return reply;
+}
+
+static void test_serial_dropped(void)
+{
+    setup();
+    std::string reply = _command("TM:1");
+    TEST_ASSERT_EQUAL_STRING("TM:", reply.substr(0, 3).c_str());
+
+    // the first SERIAL_COMMAND_MAX_LENGTH bytes are kept and run as F# with a long parameter
+    std::string line = "F#:" + std::string(SERIAL_COMMAND_MAX_LENGTH - 3 + TEST_DROPPED_BYTES, '0');
+    TEST_ASSERT_EQUAL_STRING("FR_OK", _command(line).c_str());
+
+    reply = _command("TM:1");
+    TEST_ASSERT_EQUAL_UINT32(TEST_DROPPED_BYTES, _counter(reply.c_str() + 3, TELEMETRY_COUNTER_SERIAL_DROPPED));
+
+    // TM:1 read and reset them
+    reply = _command("TM");
+    TEST_ASSERT_EQUAL_UINT32(0, _counter(reply.c_str() + 3, TELEMETRY_COUNTER_SERIAL_DROPPED));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_eeprom_writes);
+    RUN_TEST(test_eeprom_deferred);
+    RUN_TEST(test_serial_dropped);
+    return UNITY_END();
+}